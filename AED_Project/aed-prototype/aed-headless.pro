@@ -0,0 +1,38 @@
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = aed-headless
+
+source_dir = src
+
+include(engine.pri)
+
+SOURCES += \
+    $${source_dir}/headless/main.cpp \
+    $${source_dir}/headless/benchmarks.cpp \
+    $${source_dir}/headless/fleetrun.cpp \
+    $${source_dir}/headless/headlessdriver.cpp \
+    $${source_dir}/headless/headlessmode.cpp \
+    $${source_dir}/headless/replaycheck.cpp \
+    $${source_dir}/headless/scenario.cpp \
+    $${source_dir}/headless/scenariobatch.cpp \
+    $${source_dir}/headless/scenariorunner.cpp \
+    $${source_dir}/headless/telemetrywatch.cpp
+
+HEADERS += \
+    $${source_dir}/headless/benchmarks.h \
+    $${source_dir}/headless/fleetrun.h \
+    $${source_dir}/headless/headlessdriver.h \
+    $${source_dir}/headless/headlessmode.h \
+    $${source_dir}/headless/replaycheck.h \
+    $${source_dir}/headless/scenario.h \
+    $${source_dir}/headless/scenariobatch.h \
+    $${source_dir}/headless/scenariorunner.h \
+    $${source_dir}/headless/telemetrywatch.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
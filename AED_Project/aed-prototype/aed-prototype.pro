@@ -2,7 +2,7 @@ QT       += core gui multimedia
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
-CONFIG += c++11
+CONFIG += c++17
 
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
@@ -12,14 +12,24 @@ source_dir = src
 forms_dir = ui
 resources_dir = res
 
+include(engine.pri)
+
 SOURCES += \
     $${source_dir}/main.cpp \
     $${source_dir}/mainwindow.cpp \
-    src/AED.cpp
+    $${source_dir}/ecgtracewidget.cpp \
+    $${source_dir}/promptcache.cpp \
+    $${source_dir}/promptplayer.cpp \
+    $${source_dir}/assetatlas.cpp \
+    $${source_dir}/devicepanel.cpp
 
 HEADERS += \
     $${source_dir}/mainwindow.h \
-    src/AED.h
+    $${source_dir}/ecgtracewidget.h \
+    $${source_dir}/promptcache.h \
+    $${source_dir}/promptplayer.h \
+    $${source_dir}/assetatlas.h \
+    $${source_dir}/devicepanel.h
 
 FORMS += \
     $${forms_dir}/mainwindow.ui
@@ -29,5 +39,21 @@ qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
-RESOURCES += \
-    $${resources_dir}/aed.qrc
+# CONFIG+=external_resources leaves the images and audio out of the binary and builds them into
+# aed.rcc next to it instead, which main.cpp maps at startup. The audio is stored zlib-compressed;
+# the PNGs are compressed already and stay stored, which the threshold sees to.
+external_resources {
+    DEFINES += AED_EXTERNAL_RESOURCES
+    qtPrepareLibExecTool(QMAKE_RCC, rcc)
+
+    resource_pack.target = aed.rcc
+    resource_pack.commands = $$QMAKE_RCC -binary -compress-algo zlib -compress 9 -threshold 10 \
+        $$PWD/$${resources_dir}/aed.qrc -o aed.rcc
+    resource_pack.depends = $$PWD/$${resources_dir}/aed.qrc $$files($$PWD/$${resources_dir}/*, true)
+    QMAKE_EXTRA_TARGETS += resource_pack
+    PRE_TARGETDEPS += aed.rcc
+    QMAKE_CLEAN += aed.rcc
+} else {
+    RESOURCES += \
+        $${resources_dir}/aed.qrc
+}
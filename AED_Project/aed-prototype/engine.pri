@@ -0,0 +1,74 @@
+# GUI-free AED protocol engine.
+# Shared by the simulator (aed-prototype.pro) and the headless scenario runner (aed-headless.pro);
+# only depends on QtCore, and QtNetwork for the instructor server's local socket.
+
+QT += core network
+
+INCLUDEPATH += $$PWD/src
+
+# The resource URLs listed in aed.qrc, as a constexpr table for the compile-time checks of the prompt
+# catalog (promptcatalog.h). Written whenever qmake runs; aed.qrc is a dependency of the Makefile, so
+# editing it re-runs qmake.
+QRC_LINES = $$cat($$PWD/res/aed.qrc, lines)
+QRC_URLS = "// Generated by qmake from res/aed.qrc, do not edit" \
+    "$${LITERAL_HASH}ifndef QRCURLS_H" "$${LITERAL_HASH}define QRCURLS_H" \
+    "constexpr const char16_t* QRC_URLS[] = {"
+for(line, QRC_LINES) {
+    contains(line, "^\\s*<file>.*</file>\\s*$") {
+        file = $$replace(line, "^\\s*<file>(.*)</file>\\s*$", "\\1")
+        QRC_URLS += "    u\"qrc:/$$file\","
+    }
+}
+QRC_URLS += "};" "$${LITERAL_HASH}endif"
+write_file($$OUT_PWD/qrcurls.h, QRC_URLS)|error("Cannot write $$OUT_PWD/qrcurls.h")
+QMAKE_INTERNAL_INCLUDED_FILES += $$PWD/res/aed.qrc
+INCLUDEPATH += $$OUT_PWD
+
+SOURCES += \
+    $$PWD/src/AED.cpp \
+    $$PWD/src/batterymodel.cpp \
+    $$PWD/src/clock.cpp \
+    $$PWD/src/connectionmonitor.cpp \
+    $$PWD/src/cpranalyzer.cpp \
+    $$PWD/src/deviceinputs.cpp \
+    $$PWD/src/devicelink.cpp \
+    $$PWD/src/devicepool.cpp \
+    $$PWD/src/ecggenerator.cpp \
+    $$PWD/src/eventlog.cpp \
+    $$PWD/src/eventrecorder.cpp \
+    $$PWD/src/histogram.cpp \
+    $$PWD/src/instructorserver.cpp \
+    $$PWD/src/loopwatchdog.cpp \
+    $$PWD/src/metricscollector.cpp \
+    $$PWD/src/promptcatalog.cpp \
+    $$PWD/src/protocolmetrics.cpp \
+    $$PWD/src/rhythmclassifier.cpp \
+    $$PWD/src/sessionreplay.cpp \
+    $$PWD/src/telemetryexport.cpp \
+    $$PWD/src/updatequeue.cpp \
+    $$PWD/src/wfdbrecord.cpp
+
+HEADERS += \
+    $$PWD/src/AED.h \
+    $$PWD/src/batterymodel.h \
+    $$PWD/src/clock.h \
+    $$PWD/src/connectionmonitor.h \
+    $$PWD/src/cpranalyzer.h \
+    $$PWD/src/deviceinputs.h \
+    $$PWD/src/devicelink.h \
+    $$PWD/src/devicepool.h \
+    $$PWD/src/ecgsource.h \
+    $$PWD/src/ecggenerator.h \
+    $$PWD/src/eventlog.h \
+    $$PWD/src/eventrecorder.h \
+    $$PWD/src/histogram.h \
+    $$PWD/src/instructorserver.h \
+    $$PWD/src/loopwatchdog.h \
+    $$PWD/src/metricscollector.h \
+    $$PWD/src/promptcatalog.h \
+    $$PWD/src/protocolmetrics.h \
+    $$PWD/src/rhythmclassifier.h \
+    $$PWD/src/sessionreplay.h \
+    $$PWD/src/telemetryexport.h \
+    $$PWD/src/updatequeue.h \
+    $$PWD/src/wfdbrecord.h
@@ -1,19 +1,201 @@
 #include "AED.h"
-
-AED* AED::INSTANCE = NULL;
+#include "ecggenerator.h"
+#include "loopwatchdog.h"
+#include <QtMath>
+
+// --- Protocol tables ---
+
+// One row per state, in State order: entry action, how long the step lasts before its Timeout
+// event, and whether the step is suspended while the pads are off the patient.
+const AED::StateInfo AED::STATES[] = {
+    // state                name                    entry action                    hold (ms)       pads
+    { Off,                  "Off",                  &AED::enterOff,                 WaitForInput,   false },
+    { SelfTestLights,       "SelfTestLights",       &AED::enterSelfTestLights,      2000,           false },
+    { SelfTestBattery,      "SelfTestBattery",      &AED::enterSelfTestBattery,     2000,           false },
+    { BatteryOk,            "BatteryOk",            &AED::enterBatteryOk,           2000,           false },
+    { ChangeBatteries,      "ChangeBatteries",      &AED::enterChangeBatteries,     WaitForInput,   false },
+    { UnitFailed,           "UnitFailed",           &AED::enterUnitFailed,          WaitForInput,   false },
+    { SelfTestPassed,       "SelfTestPassed",       &AED::enterSelfTestPassed,      2000,           false },
+    { UnitOk,               "UnitOk",               &AED::enterUnitOk,              3000,           false },
+    { StayCalm,             "StayCalm",             &AED::enterStayCalm,            2000,           false },
+    { CheckResponsiveness,  "CheckResponsiveness",  &AED::enterCheckResponsiveness, 4000,           false },
+    { CallForHelp,          "CallForHelp",          &AED::enterCallForHelp,         4000,           false },
+    { AttachPads,           "AttachPads",           &AED::enterAttachPads,          0,              false },
+    { PlacingPads,          "PlacingPads",          &AED::enterPlacingPads,         2000,           true  },
+    { PadsPlaced,           "PadsPlaced",           &AED::enterPadsPlaced,          2000,           true  },
+    { PadsAnalyzing,        "PadsAnalyzing",        &AED::enterPadsAnalyzing,       2000,           true  },
+    { PadsOnStartup,        "PadsOnStartup",        &AED::enterPadsOnStartup,       2000,           true  },
+    { AwaitRhythm,          "AwaitRhythm",          &AED::enterAwaitRhythm,         WaitForInput,   true  },
+    { Analyzing,            "Analyzing",            &AED::enterAnalyzing,           4000,           true  },
+    { ShockAdvised,         "ShockAdvised",         &AED::enterShockAdvised,        2000,           true  },
+    { ShockReady,           "ShockReady",           &AED::enterShockReady,          WaitForInput,   true  },
+    { ShockRefused,         "ShockRefused",         &AED::enterShockRefused,        WaitForInput,   true  },
+    { ShockDelivering,      "ShockDelivering",      &AED::enterShockDelivering,     4000,           true  },
+    { ShockTone,            "ShockTone",            &AED::enterShockTone,           2000,           false },
+    { ShockDelivered,       "ShockDelivered",       &AED::enterShockDelivered,      3000,           false },
+    { NoShockPea,           "NoShockPea",           &AED::enterNoShockPea,          2000,           true  },
+    { NoShockAsystole,      "NoShockAsystole",      &AED::enterNoShockAsystole,     2000,           false },
+    { PatientDeceased,      "PatientDeceased",      &AED::enterPatientDeceased,     WaitForInput,   false },
+    { NoShockRegular,       "NoShockRegular",       &AED::enterNoShockRegular,      2000,           false },
+    { RegularHeartbeat,     "RegularHeartbeat",     &AED::enterRegularHeartbeat,    WaitForInput,   false },
+    { StartCpr,             "StartCpr",             &AED::enterStartCpr,            WaitForInput,   true  },
+    { CprCoaching,          "CprCoaching",          &AED::enterCprCoaching,         6000,           true  },
+    { CprFeedback,          "CprFeedback",          &AED::enterCprFeedback,         5000,           true  },
+    { CprStop,              "CprStop",              &AED::enterCprStop,             3000,           true  },
+    { CprDone,              "CprDone",              &AED::enterCprDone,             WaitForInput,   true  },
+    { ResumeAnalysis,       "ResumeAnalysis",       &AED::enterResumeAnalysis,      0,              true  },
+    { PadsDisconnected,     "PadsDisconnected",     &AED::enterPadsDisconnected,    WaitForInput,   false },
+    { BatteryDisconnected,  "BatteryDisconnected",  &AED::enterBatteryDisconnected, WaitForInput,   false },
+};
+
+// Every transition of the protocol. The first row matching the current state, the event and the
+// guard wins, so guarded rows come before their fallback.
+const AED::Transition AED::TRANSITIONS[] = {
+    // from                 event               guard                       to
+
+    // Power and interruptions, valid in any step
+    { AnyState,             PowerOff,           &AED::isPowered,            Off },
+    { AnyState,             BatteryDrained,     &AED::isPowered,            Off },
+    { AnyState,             BatteryRemoved,     &AED::isPowered,            BatteryDisconnected },
+    { BatteryDisconnected,  BatteryInserted,    nullptr,                    Resume },
+    { AnyState,             PadsRemoved,        &AED::isPadsRequired,       PadsDisconnected },
+    { PadsDisconnected,     PadsAttached,       nullptr,                    Resume },
+
+    // Power on and self test
+    { Off,                  PowerOn,            nullptr,                    SelfTestLights },
+    { SelfTestLights,       Timeout,            nullptr,                    SelfTestBattery },
+    { SelfTestBattery,      Timeout,            &AED::hasBatteryCharge,     BatteryOk },
+    { SelfTestBattery,      Timeout,            nullptr,                    ChangeBatteries },
+    { BatteryOk,            Timeout,            &AED::isSelfTestOk,         SelfTestPassed },
+    { BatteryOk,            Timeout,            nullptr,                    UnitFailed },
+    { SelfTestPassed,       Timeout,            nullptr,                    UnitOk },
+
+    // If the electrodes are already connected, skip to the analyzing step
+    { UnitOk,               Timeout,            &AED::isPadsConnected,      PadsOnStartup },
+    { UnitOk,               Timeout,            nullptr,                    StayCalm },
+
+    // Rescue preparation
+    { StayCalm,             Timeout,            nullptr,                    CheckResponsiveness },
+    { CheckResponsiveness,  Timeout,            nullptr,                    CallForHelp },
+    { CallForHelp,          Timeout,            nullptr,                    AttachPads },
+    { AttachPads,           Timeout,            &AED::isPadsAttached,       PlacingPads },
+    { AttachPads,           PadsAttached,       nullptr,                    PlacingPads },
+    { PlacingPads,          Timeout,            nullptr,                    PadsPlaced },
+    { PadsPlaced,           Timeout,            nullptr,                    PadsAnalyzing },
+    { PadsAnalyzing,        Timeout,            nullptr,                    AwaitRhythm },
+    { PadsOnStartup,        Timeout,            nullptr,                    AwaitRhythm },
+
+    // Rhythm analysis
+    { AwaitRhythm,          RhythmSelected,     nullptr,                    Analyzing },
+    { Analyzing,            Timeout,            &AED::isShockable,          ShockAdvised },
+    { Analyzing,            Timeout,            &AED::isPea,                NoShockPea },
+    { Analyzing,            Timeout,            &AED::isAsystole,           NoShockAsystole },
+    { Analyzing,            Timeout,            nullptr,                    NoShockRegular },
+
+    // Shock delivery
+    { ShockAdvised,         Timeout,            nullptr,                    ShockReady },
+    { ShockReady,           ShockPressed,       &AED::hasShockCharge,       ShockDelivering },
+    { ShockReady,           ShockPressed,       nullptr,                    ShockRefused },
+    { ShockRefused,         ShockPressed,       &AED::hasShockCharge,       ShockDelivering },
+    { ShockRefused,         ShockPressed,       nullptr,                    ShockRefused },
+    { ShockDelivering,      Timeout,            nullptr,                    ShockTone },
+    { ShockTone,            Timeout,            nullptr,                    ShockDelivered },
+    { ShockDelivered,       Timeout,            nullptr,                    StartCpr },
+
+    // No shock advised
+    { NoShockPea,           Timeout,            nullptr,                    StartCpr },
+    { NoShockAsystole,      Timeout,            nullptr,                    PatientDeceased },
+    { NoShockRegular,       Timeout,            nullptr,                    RegularHeartbeat },
+
+    // CPR; a second press of the CPR button ends it at any point
+    { StartCpr,             CprPressed,         nullptr,                    CprCoaching },
+    { CprCoaching,          Timeout,            nullptr,                    CprFeedback },
+    { CprFeedback,          Timeout,            nullptr,                    CprStop },
+    { CprStop,              Timeout,            nullptr,                    CprDone },
+    { CprCoaching,          CprPressed,         nullptr,                    ResumeAnalysis },
+    { CprFeedback,          CprPressed,         nullptr,                    ResumeAnalysis },
+    { CprStop,              CprPressed,         nullptr,                    ResumeAnalysis },
+    { CprDone,              CprPressed,         nullptr,                    ResumeAnalysis },
+    { ResumeAnalysis,       Timeout,            nullptr,                    AwaitRhythm },
+};
 
 AED::AED(QObject *parent)
     : QObject{parent}
 {
-    audioOutput = new QAudioOutput;
-    player = new QMediaPlayer;
-    player->setAudioOutput(audioOutput);
-    audioOutput->setVolume(100);
+    static_assert(sizeof(STATES) / sizeof(STATES[0]) == StateCount, "STATES must list every State");
+    for (int i = 0; i < StateCount; i++) {
+        Q_ASSERT(STATES[i].state == i);
+    }
 
     shockCount = 0; //default 0 shocks
-    batteryLevel = 100; //default full battery
+    batteryLevel = battery.getLevel(); //default full battery
+    batteryMsec = 0;
     powerState = false; //default device OFF
     electrodePadConnected = false; //default no pad connected
+
+    selfTestPassed = true; //default self test passes
+    appliedInputs = inputs.load();
+    powerButtonDown = false;
+    cprDepth = 0;
+    cprSimulated = true;
+    selectedRhythm = NoRhythm;
+
+    state = Off;
+    interruptedState = Off;
+    transitionCount = 0;
+
+    // Pads and battery changes suspend and resume the protocol as soon as they are reported
+    connections = new ConnectionMonitor(this);
+    connect(connections, &ConnectionMonitor::padsChanged, this, &AED::onPadsConnectionChanged);
+    connect(connections, &ConnectionMonitor::batteryChanged, this, &AED::onBatteryConnectionChanged);
+
+    // Every wait and timer runs on the device clock so runs can be sped up
+    clock = new Clock(this);
+
+    stepTimer = new ClockTimer(clock, this);
+    stepTimer->setSingleShot(true);
+
+    buttonHoldTimer = new ClockTimer(clock, this);
+    buttonHoldTimer->setInterval(5000);  // 5000 milliseconds = 5 seconds
+    buttonHoldTimer->setSingleShot(true);  // one power toggle per press
+
+    elapsedTimer = new ClockTimer(clock, this);
+    elapsedSeconds = 0;
+
+    batteryDrainTimer = new ClockTimer(clock, this);
+
+    connect(stepTimer, &ClockTimer::timeout, this, &AED::onStepTimeout);
+    connect(buttonHoldTimer, &ClockTimer::timeout, this, &AED::checkButtonHoldDuration);
+    connect(elapsedTimer, &ClockTimer::timeout, this, &AED::updateElapsedTimer);
+    connect(batteryDrainTimer, &ClockTimer::timeout, this, &AED::onBatteryTimeDrain);
+
+    ecg = new EcgGenerator(500);
+    ecg->setNoise(0.02);
+    seed = 1;
+    ecg->setSeed(seed);
+    ecgSource = nullptr;
+    ecgStartMsec = 0;
+    ecgEmitted = 0;
+    ecgStreaming = false;
+    ecgHistory.resize(ecg->getSampleRate() * AnalysisWindowMsec / 1000);
+    ecgHistoryPos = 0;
+    ecgHistoryCount = 0;
+    analysis = RhythmClassifier::Result();
+    analysisValid = false;
+    cprStartMsec = 0;
+    cprFeedback = -1;
+    cprTimer = new ClockTimer(clock, this);
+    cprTimer->setInterval(CprSampleMsec);
+    connect(cprTimer, &ClockTimer::timeout, this, &AED::onCprSample);
+
+    ecgTimer = new ClockTimer(clock, this);
+    ecgTimer->setInterval(20);
+    connect(ecgTimer, &ClockTimer::timeout, this, &AED::onEcgTick);
+}
+
+AED::~AED()
+{
+    delete ecg;
 }
 
 void AED::run()
@@ -24,188 +206,689 @@ void AED::run()
     // Only turn on if
     // - Battery level some charge, > 0
     // - Battery is connected
-    if( batteryLevel > 0 && emit batteryStatus()) {
+    // Standby draw since the last time the device was on
+    updateBattery();
+    publishBatteryLevel(false);
+
+    if( batteryLevel > 0 && connections->isBatteryConnected()) {
         setPowerState(true);
-        emit setPowerButtonStyleSheet("QPushButton {image: url(:/buttons/powerbuttonON.png);border-radius: 20px;}QPushButton:hover {image: url(:/buttons/powerButton.png);border-radius: 20px;}");
 
-        if (!selfTest()) {
-            // Stop program if selftest fails
-            return;
-        }
+        // Pads placed before power on: the protocol skips straight to analyzing
+        setElectrodeConnected(connections->isPadsAttached());
 
-        // If the electrodes are already connected, skip to step 4. Stop current code
-        // Enable toggleRhythmoptions will allow the 4th analyzing step to start from
-        if (electrodePadConnected) {
-            emit updateLight(true, 4);
-            emit voiceText("DO NOT TOUCH PATIENT.\n        ANALYZING");
-            playAudio("qrc:/audio/DoNotTouchPatient.aiff");
-            emit informUser("DO NOT TOUCH PATIENT.\n        ANALYZING");
+        dispatch(PowerOn);
+    }
+    else {
+        setPowerState(false);
+        emit rescueEnded();
+    }
+}
 
-            delay(2);
+// --- State machine ---
 
-            emit toggleRhythmOptions();
+void AED::dispatch(Event event)
+{
+    const int count = sizeof(TRANSITIONS) / sizeof(TRANSITIONS[0]);
+
+    for (int i = 0; i < count; i++) {
+        const Transition& t = TRANSITIONS[i];
 
-            return;
+        if (t.event != event || (t.from != AnyState && t.from != state)) {
+            continue;
         }
+        if (t.guard != nullptr && !(this->*t.guard)()) {
+            continue;
+        }
+
+        enterState(t.to);
+        return;
+    }
+}
 
-        emit updateLight(true, 1);
-        emit voiceText("     STAY CALM");
-        playAudio("qrc:/audio/StayCalm.aiff");
-        delay(2);
+void AED::enterState(State next)
+{
+    if (next == Resume) {
+        next = interruptedState;
+    }
 
-        checkResponsiveness();
+    // A step that needs the battery or the pads is held until they are back
+    State target = next;
+    if (next != Off && next != BatteryDisconnected && !connections->isBatteryConnected()) {
+        target = BatteryDisconnected;
+    }
+    else if (STATES[next].padsRequired && !isPadsAttached()) {
+        target = PadsDisconnected;
+    }
+
+    bool interrupt = (target == PadsDisconnected || target == BatteryDisconnected);
+    if (interrupt && target != next) {
+        interruptedState = next;
+    }
+    else if (interrupt && state != PadsDisconnected && state != BatteryDisconnected) {
+        interruptedState = state;
+    }
 
-        call911();
+    stepTimer->stop();
+    state = target;
+    int transition = ++transitionCount;
+    emit stateChanged(state);
 
-        electrodePad();
+    {
+        // A stall inside the entry action is attributed to the step
+        LoopWatchdog::Scope scope(STATES[state].name);
+        (this->*STATES[state].enter)();
+    }
+
+    // The entry action may already have moved the protocol on (e.g. shut down on a drained battery)
+    if (transition != transitionCount) {
+        return;
+    }
+
+    updateCprSampling();
+
+    if (STATES[state].holdMsec != WaitForInput) {
+        stepTimer->start(STATES[state].holdMsec);
+    }
+}
+
+void AED::onStepTimeout()
+{
+    LoopWatchdog::Scope scope("AED::onStepTimeout");
+    dispatch(Timeout);
+}
+
+AED::State AED::getState()
+{
+    return state;
+}
+
+// --- ECG ---
+
+EcgGenerator* AED::getEcg()
+{
+    return ecg;
+}
+
+int AED::getEcgSampleRate()
+{
+    return activeEcgSource()->getSampleRate();
+}
+
+EcgSource* AED::activeEcgSource()
+{
+    return ecgSource != nullptr ? ecgSource : ecg;
+}
+
+void AED::setEcgSource(EcgSource* source)
+{
+    ecgSource = source;
+
+    int hz = activeEcgSource()->getSampleRate();
+    ecgHistory.fill(0.0f, hz * AnalysisWindowMsec / 1000);
+    ecgHistoryPos = 0;
+    ecgHistoryCount = 0;
+    ecgStartMsec = clock->now();
+    ecgEmitted = 0;
+    emit ecgSampleRateChanged(hz);
+}
+
+EcgSource* AED::getEcgSource()
+{
+    return ecgSource;
+}
+
+void AED::setEcgStreaming(bool enabled)
+{
+    ecgStreaming = enabled;
+    updateEcgStream();
+}
+
+bool AED::isEcgStreaming()
+{
+    return ecgStreaming;
+}
+
+void AED::updateEcgStream()
+{
+    bool run = ecgStreaming && powerState;
+    if (run == ecgTimer->isActive()) {
+        return;
+    }
+
+    if (run) {
+        ecgStartMsec = clock->now();
+        ecgEmitted = 0;
+        ecgHistoryCount = 0;
+        ecgTimer->start();
     }
     else {
-        setPowerState(false);
-        emit setPowerButtonStyleSheet("QPushButton {image: url(:/buttons/powerButton.png);border-radius: 20px;}QPushButton:hover {image: url(:/buttons/powerbuttonON.png);border-radius: 20px;}");
+        ecgTimer->stop();
+    }
+}
+
+void AED::onEcgTick()
+{
+    LoopWatchdog::Scope scope("AED::onEcgTick");
+
+    // The pads only see a rhythm once one has been presented; otherwise the trace is flat
+    Rhythm rhythm = isPadsAttached() ? selectedRhythm : NoRhythm;
+    if (ecg->getRhythm() != rhythm) {
+        ecg->setRhythm(rhythm);
+    }
+
+    EcgSource* source = activeEcgSource();
+    int hz = source->getSampleRate();
+
+    // Emit whatever is due on the device clock, so the trace keeps pace at any clock speed
+    qint64 due = (clock->now() - ecgStartMsec) * hz / 1000 - ecgEmitted;
+    if (due <= 0) {
+        return;
+    }
+
+    QVector<float> samples(int(qMin(due, qint64(hz))));
+    if (source == ecg || isPadsAttached()) {
+        source->readSamples(samples.data(), samples.size());
+    }
+    else {
+        // Recording playing but the leads are off
+        samples.fill(0.0f);
+    }
+    ecgEmitted += samples.size();
+    if (samples.size() < due) {
+        // Fell more than a second behind: drop the backlog rather than flood the monitor
+        ecgStartMsec = clock->now() - ecgEmitted * 1000 / hz;
+    }
+
+    for (float sample : samples) {
+        ecgHistory[ecgHistoryPos] = sample;
+        ecgHistoryPos = (ecgHistoryPos + 1) % ecgHistory.size();
     }
+    ecgHistoryCount += samples.size();
+
+    emit ecgSamples(samples);
 }
 
-bool AED::selfTest()
+const RhythmClassifier::Result& AED::currentAnalysis()
 {
+    if (analysisValid) {
+        return analysis;
+    }
+
+    int size = ecgHistory.size();
+    QVector<float> window(size);
+
+    if (ecgTimer->isActive() && ecgHistoryCount >= size) {
+        // Streaming: analyse exactly what was shown on the monitor, oldest sample first
+        for (int i = 0; i < size; i++) {
+            window[i] = ecgHistory[(ecgHistoryPos + i) % size];
+        }
+    }
+    else {
+        // Nothing streamed (e.g. headless): record a fresh window through the pads
+        ecg->setRhythm(isPadsAttached() ? selectedRhythm : NoRhythm);
+        activeEcgSource()->readSamples(window.data(), size);
+    }
+
+    analysis = classifier.classify(window.constData(), size, activeEcgSource()->getSampleRate());
+    analysisValid = true;
+
+    const char* verdict = analysis.shockable ? "shockable" : (analysis.asystole ? "asystole" : "not shockable");
+    qInfo("rhythm analysis: %s (confidence %.2f, TCI %.0f ms, leakage %.2f, %.1f Hz) in %.1f us",
+          verdict, analysis.confidence, analysis.tciMsec, analysis.leakage, analysis.dominantHz, analysis.nsec / 1000.0);
 
-    qInfo("initiating self test .... \n");
-    emit informUser(QString("initiating self test .... "));
+    // Noise, or a recorded ECG, can show the pads something other than the rhythm the scenario picked
+    bool selectedShockable = selectedRhythm == VF || selectedRhythm == VT;
+    if (selectedRhythm != NoRhythm
+        && (analysis.shockable != selectedShockable || analysis.asystole != (selectedRhythm == Asystole))) {
+        qWarning("rhythm analysis: %s selected but the ECG is %s", qPrintable(rhythmName(selectedRhythm)), verdict);
+    }
+    emit rhythmAnalyzed(analysis.shockable, analysis.confidence);
+    return analysis;
+}
+
+QString AED::stateName(State state)
+{
+    if (state >= 0 && state < StateCount) {
+        return STATES[state].name;
+    }
+    return state == Resume ? "Resume" : "Any";
+}
+
+// --- Guards ---
+
+bool AED::isPowered()
+{
+    return getPowerState();
+}
+
+bool AED::isPadsRequired()
+{
+    return STATES[state].padsRequired;
+}
+
+bool AED::hasBatteryCharge()
+{
+    return batteryLevel >= LowBatteryPercent && battery.predict(ShockJoules).shocks > 0;
+}
+
+// True for the BatteryDrained shutdown, which publishBatteryLevel() dispatches as the level hits 0
+bool AED::isBatteryDrained()
+{
+    return battery.getLevel() == 0;
+}
+
+bool AED::isSelfTestOk()
+{
+    return selfTestPassed;
+}
+
+bool AED::isPadsConnected()
+{
+    return electrodePadConnected;
+}
+
+// What the analysis found, in the terms of the rhythm buttons. The classifier only tells shockable,
+// asystole and organised rhythms apart, so the selected rhythm names the shockable one (NoRhythm if
+// it isn't VF or VT) and, since only the missing pulse tells PEA from a regular rhythm, the organised
+// one too.
+AED::Rhythm AED::detectedRhythm()
+{
+    const RhythmClassifier::Result &result = currentAnalysis();
+    if (result.shockable) {
+        return selectedRhythm == VF || selectedRhythm == VT ? selectedRhythm : NoRhythm;
+    }
+    if (result.asystole) {
+        return Asystole;
+    }
+    return selectedRhythm == PEA ? PEA : Regular;
+}
+
+// Every decision comes from the ECG itself
+bool AED::isShockable()
+{
+    return currentAnalysis().shockable;
+}
+
+bool AED::isPea()
+{
+    return detectedRhythm() == PEA;
+}
+
+bool AED::isAsystole()
+{
+    return currentAnalysis().asystole;
+}
+
+bool AED::hasShockCharge()
+{
+    return batteryLevel >= LowBatteryPercent
+        && battery.getAvailableMah() >= BatteryModel::shockMah(battery.getParameters(), ShockJoules);
+}
+
+// --- Entry actions ---
+
+void AED::enterOff()
+{
+    bool drained = isBatteryDrained();
+    if (drained) {
+        say(PromptCatalog::BatteryDrained);
+    }
+    shockCount = 0;
+    setPowerState(false);
+    electrodePadConnected = false;
+    selectedRhythm = NoRhythm;
+    elapsedSeconds = 0;
+
+    // Only a drained pack is swapped for a full one; a plain power-off keeps the charge left, so the
+    // level and the predictions carry over to the next session
+    if (drained) {
+        battery.setLevel(100);
+    }
+    publishBatteryLevel(true);
+    emit resetUI();
+    emit rescueEnded();
+}
+
+void AED::enterSelfTestLights()
+{
+    say(PromptCatalog::SelfTestStarting);
     // Turn on all lights
     emit updateLight(true, 1);
     emit updateLight(true, 2);
     emit updateLight(true, 3);
     emit updateLight(true, 4);
     emit updateLight(true, 5);
-    delay(2);
+}
 
-    if(getPowerState()){
-        qInfo("checking battery level...\n");
-        emit informUser("checking battery level...");
-        delay(2);
-
-        if (batteryLevel >= 5) {
-            qInfo("battery has enough charge\n");
-            emit informUser("battery has enough charge!");
-            delay(2);
-        }
-        else {
-            qInfo("change batteries\n");
-            emit informUser("change batteries");
-            emit voiceText("CHANGE BATTERIES");
-            playAudio("qrc:/audio/ChangeBatteries.aiff");
+void AED::enterSelfTestBattery()
+{
+    say(PromptCatalog::CheckingBattery);
+}
 
-            return false;
-        }
+void AED::enterBatteryOk()
+{
+    say(PromptCatalog::BatteryOk);
+}
 
-        if (emit getSelfTest()) {
-            qInfo("self test passed\n");
-            emit informUser("self test passed!");
-            delay(2);
-        }
-        else {
-            qInfo("self test failed\n");
-            emit informUser("self test failed");
-            emit voiceText("UNIT FAILED");
-            emit updateStatusIndicator(":/indicators/statusNotOk.png");
-            playAudio("qrc:/audio/UnitFailed.aiff");
-
-            return false;
-        }
+void AED::enterChangeBatteries()
+{
+    say(PromptCatalog::ChangeBatteries);
+
+    // Stop program if selftest fails
+    emit rescueEnded();
+}
 
-        // Set the existing QPixmap to the QLabel
-        emit updateStatusIndicator(QString(":/indicators/statusOk.png"));
+void AED::enterUnitFailed()
+{
+    emit updateStatusIndicator(false);
+    say(PromptCatalog::UnitFailed);
 
-        qInfo("Self test successful! device is on and the user can proceed now.\n");
-        emit informUser("Self test successful! device is on \nand the user can proceed now.");
+    // Stop program if selftest fails
+    emit rescueEnded();
+}
 
-        emit voiceText("     UNIT OK");
-        playAudio("qrc:/audio/UnitOkay.aiff");
+void AED::enterSelfTestPassed()
+{
+    say(PromptCatalog::SelfTestPassed);
+}
 
-        // Turn off all lights
-        emit updateLight(false, 1);
-        emit updateLight(false, 2);
-        emit updateLight(false, 3);
-        emit updateLight(false, 4);
-        emit updateLight(false, 5);
+void AED::enterUnitOk()
+{
+    emit updateStatusIndicator(true);
 
-        delay(3);
+    say(PromptCatalog::UnitOk);
 
-        return true;
-    }
+    // Turn off all lights
+    emit updateLight(false, 1);
+    emit updateLight(false, 2);
+    emit updateLight(false, 3);
+    emit updateLight(false, 4);
+    emit updateLight(false, 5);
 }
 
-void AED::checkResponsiveness()
+void AED::enterStayCalm()
 {
-    if(getPowerState()){
-        emit voiceText("  CHECK RESPONSIVENESS");
+    emit updateLight(true, 1);
+    say(PromptCatalog::StayCalm);
+}
 
-        playAudio("qrc:/audio/CheckResponsiveness.aiff");
-        delay(4);
+void AED::enterCheckResponsiveness()
+{
+    say(PromptCatalog::CheckResponsiveness);
+}
 
-        emit updateLight(false, 1);
-    }
+void AED::enterCallForHelp()
+{
+    emit updateLight(false, 1);
+    emit updateLight(true, 2);
+
+    say(PromptCatalog::CallForHelp);
 }
 
-void AED::call911()
+void AED::enterAttachPads()
 {
-    if(getPowerState()){
-        emit updateLight(true, 2);
+    emit updateLight(false, 2);
+    emit updateLight(true, 3);
 
-        emit voiceText("    CALL FOR HELP");
+    say(PromptCatalog::AttachPads);
 
-        playAudio("qrc:/audio/CallForHelp.aiff");
-        delay(4);
+    emit toggleElectrodeStates(true);
+}
 
-        emit updateLight(false, 2);
+void AED::enterPlacingPads()
+{
+    if (connections->isChildPads()) {
+        say(PromptCatalog::PlacingChildPads);
+    } else {
+        say(PromptCatalog::PlacingAdultPads);
     }
 }
 
-void AED::electrodePad()
+void AED::enterPadsPlaced()
 {
-    if(getPowerState()){
-        emit updateLight(true, 3);
+    emit updateElectrodeOverlay(true);
+    say(PromptCatalog::PadsConnected);
+}
+
+void AED::enterPadsAnalyzing()
+{
+    emit updateLight(false, 3);
+    emit updateLight(true, 4);
+
+    say(PromptCatalog::CheckingRhythm);
+    setElectrodeConnected(true);
+
+    say(PromptCatalog::DoNotTouchPatient);
+}
 
-        qInfo("Place adult/child electrode pads on the patient's bare chest.\n");
-        emit informUser("Place adult/child electrode pads on \nthe patient's bare chest.");
+void AED::enterPadsOnStartup()
+{
+    emit updateLight(true, 4);
+    say(PromptCatalog::DoNotTouchPatient);
+}
+
+void AED::enterAwaitRhythm()
+{
+    // Enable rhythm group box to select next rhythm
+    // Will trigger onRhythmSelected()
+    emit toggleRhythmOptions(true);
+}
 
-        emit voiceText("ATTACH DEFIBRILLATION\n      PADS TO PATIENTS \n          BARE CHEST");
+void AED::enterAnalyzing()
+{
+    analysisValid = false;
+    emit toggleRhythmOptions(false);
 
-        playAudio("qrc:/audio/DefibPadsToChest.aiff");
+    say(PromptCatalog::Analyzing);
+}
 
-        emit toggleElectrodeStates(true);
+void AED::enterShockAdvised()
+{
+    Rhythm rhythm = detectedRhythm();
+    say(PromptCatalog::ShockAdvised);
+    emit rhythmDetected(rhythm);
 
+    if (rhythm == VF) {
+        say(PromptCatalog::ShockableVf);
+    }
+    else if (rhythm == VT) {
+        say(PromptCatalog::ShockableVt);
     }
+    else {
+        say(PromptCatalog::Shockable);
+    }
+
+    emit updateLight(false, 4);
+    emit updateLight(true, 6);
 }
 
-bool AED::checkShockableRhythm()
+void AED::enterShockReady()
 {
-    if(disconnected() && getPowerState()){
-        if (electrodePadConnected) {
-            return (emit shockable());
-        }
-        else {
-            qInfo("electrode pads not connected!\n");
-            return false;
-        }
+    emit shockButton(true);
+    say(PromptCatalog::DeliverShock);
+}
+
+void AED::enterShockRefused()
+{
+    say(PromptCatalog::ChangeBatteries);
+}
+
+void AED::enterShockDelivering()
+{
+    emit shockButton(false);
+
+    say(PromptCatalog::ShockDelivering);
+}
+
+void AED::enterShockTone()
+{
+    incrementShock();
+    say(PromptCatalog::ShockTone);
+
+    updateBattery();
+    battery.deliverShock(ShockJoules);
+    publishBatteryLevel(false);
+}
+
+void AED::enterShockDelivered()
+{
+    say(PromptCatalog::ShockDelivered);
+}
+
+void AED::enterNoShockPea()
+{
+    say(PromptCatalog::NoShockAdvised);
+    emit rhythmDetected(detectedRhythm());
+
+    say(PromptCatalog::NoShockSinus);
+}
+
+void AED::enterNoShockAsystole()
+{
+    say(PromptCatalog::NoShockAdvised);
+    emit rhythmDetected(detectedRhythm());
+
+    say(PromptCatalog::NoShockAsystole);
+}
+
+void AED::enterPatientDeceased()
+{
+    say(PromptCatalog::PatientDeceased);
+
+    // Do nothing, end program but keep device on
+    emit rescueEnded();
+}
+
+void AED::enterNoShockRegular()
+{
+    say(PromptCatalog::NoShockAdvised);
+    emit rhythmDetected(detectedRhythm());
+
+    say(PromptCatalog::NoShockRegular);
+}
+
+void AED::enterRegularHeartbeat()
+{
+    say(PromptCatalog::RegularHeartbeat);
+
+    // Do nothing, end program but keep device on
+    emit rescueEnded();
+}
+
+void AED::enterStartCpr()
+{
+    emit cprButton(true);
+
+    emit updateLight(false, 4);
+    emit updateLight(false, 6);
+    emit updateLight(true, 5);
+
+    say(PromptCatalog::StartCpr);
+}
+
+void AED::enterCprCoaching()
+{
+    cpr.reset();
+    cprStartMsec = clock->now();
+    cprFeedback = -1;
+
+    emit displayCprBar(true);
+    emit cprStateChanged(true);
+    say(PromptCatalog::CprCoaching);
+}
+
+void AED::enterCprFeedback()
+{
+    // At least one prompt per cycle, then whenever the assessment changes (see onCprSample())
+    giveCprFeedback(true);
+}
+
+void AED::giveCprFeedback(bool force)
+{
+    CprAnalyzer::Feedback feedback = cpr.getFeedback();
+    if (!force && feedback == cprFeedback) {
+        return;
+    }
+    cprFeedback = feedback;
+
+    // The quality figures are the only text built at run time
+    QString quality = CprAnalyzer::qualityText(cpr.getQuality());
+    if (feedback == CprAnalyzer::PushHarder) {
+        say(PromptCatalog::PushHarder, quality);
+    }
+    else if (feedback == CprAnalyzer::PushGently){
+        say(PromptCatalog::PushGently, quality);
+    }
+    else{
+        say(PromptCatalog::MaintainDepth, quality);
     }
 }
 
-void AED::playAudio(QString audioFile)
+void AED::enterCprStop()
+{
+    qInfo("cpr: %s", qPrintable(CprAnalyzer::qualityText(cpr.getQuality())));
+    qInfo("cpr: %s", qPrintable(CprAnalyzer::statsText(cpr.getStats())));
+
+    say(PromptCatalog::StopCpr);
+}
+
+void AED::enterCprDone()
+{
+    // Waits for the second press of the CPR button
+}
+
+void AED::enterResumeAnalysis()
+{
+    emit cprStateChanged(false);
+
+    emit updateLight(false, 5);
+    emit updateLight(true, 4);
+
+    // Disable CPR button after CPR is performed
+    emit cprButton(false);
+
+    say(PromptCatalog::DoNotTouchPatient);
+}
+
+void AED::enterPadsDisconnected()
 {
-    // Bug fixed: play() will not replay the same audio twice. Select no file before playing to get around this
-    player->setSource(QUrl(""));
+    emit shockButton(false);
+    emit toggleRhythmOptions(false);
+    emit updateElectrodeOverlay(false);
+    say(PromptCatalog::PadsDisconnected);
+}
 
-    player->setSource(QUrl(audioFile));
-    player->play();
+void AED::enterBatteryDisconnected()
+{
+    emit shockButton(false);
+    emit toggleRhythmOptions(false);
+    say(PromptCatalog::BatteryDisconnected);
 }
 
-void AED::delay(int seconds)
+// --- Device state ---
+
+void AED::say(PromptCatalog::Prompt prompt, const QString &detail)
 {
-    QEventLoop loop;
-    QTimer t;
-    t.connect(&t, &QTimer::timeout, &loop, &QEventLoop::quit);
-    t.start(seconds*1000);
-    loop.exec();
+    const PromptCatalog::Entry& entry = PromptCatalog::ENTRIES[prompt];
+    if (entry.display != nullptr) {
+        // The log shows what the display shows, straight from the catalog
+        QString text = detail.isEmpty() ? PromptCatalog::display(prompt) : PromptCatalog::display(prompt) + "\n" + detail;
+        qInfo("%s", qPrintable(text));
+        emit informUser(text);
+    }
+    if (entry.voice != nullptr) {
+        emit voiceText(PromptCatalog::voice(prompt));
+    }
+    if (entry.audio != nullptr) {
+        playAudio(PromptCatalog::audio(prompt));
+    }
+}
+
+void AED::playAudio(QString audioFile)
+{
+    // Playback belongs to the front end; the engine only announces which prompt to play
+    battery.drawCharge(battery.getParameters().audioMa * PromptMsec / 3.6e6);
+    emit audio(audioFile);
 }
 
 bool AED::getPowerState()
@@ -215,7 +898,24 @@ bool AED::getPowerState()
 
 void AED::setPowerState(bool state)
 {
+    if (powerState == state) {
+        return;
+    }
+
+    updateBattery();
     powerState = state;
+    battery.setLoads(powerState ? BatteryModel::Running | BatteryModel::Display : 0);
+
+    // Only counts while on, and only ever runs on the device's thread
+    if (powerState) {
+        elapsedTimer->start(1000);
+    }
+    else {
+        elapsedTimer->stop();
+    }
+    updateBatteryTimer();
+    updateEcgStream();
+    emit powerStateChanged(powerState);
 }
 
 bool AED::getElectrodeConnected()
@@ -228,78 +928,96 @@ void AED::setElectrodeConnected(bool connected)
     electrodePadConnected = connected;
 }
 
-bool AED::detectRhythm(bool shockable){
-    if (disconnected() && getPowerState()){
-        int randInt = QRandomGenerator::global()->bounded(0,2);
-        emit voiceText("DO NOT TOUCH PATIENT.\n        ANALYZING");
-
-        playAudio("qrc:/audio/DoNotTouchPatient.aiff");
-        emit informUser("DO NOT TOUCH PATIENT.\n        ANALYZING");
-
-        delay(4);
-
-        if(disconnected() && getPowerState()){
-            if(shockable){
-                emit voiceText("SHOCK ADVISED");
-                playAudio("qrc:/audio/ShockAdvised.aiff");
-            }
-            else {
-                emit voiceText("NO SHOCK ADVISED");
-                playAudio("qrc:/audio/NoShockAdvised.aiff");
-            }
-
-            if (randInt == 0){
-                return true;
-                emit informUser("2");
-            }
-            //delay(4);
-            return false;
-        }
-    }
+bool AED::isPadsAttached()
+{
+    return connections->isPadsAttached();
 }
 
-void AED::shockSequence(){
-    if (disconnected() && getPowerState()){
-        emit shockButton(true);
-        emit informUser("Deliver shock to \nthe patient.");
-    }
+ConnectionMonitor* AED::getConnections()
+{
+    return connections;
+}
+
+DeviceInputs* AED::getInputs()
+{
+    return &inputs;
 }
 
 void AED::incrementShock(){
     shockCount += 1;
+    emit updateShockCount(shockCount);
 }
 
 int AED::getShockCount(){
     return shockCount;
 }
 
-void AED::cprSequence(){
-    if(disconnected() && getPowerState()){
-        emit updateLight(false, 4);
-        emit updateLight(false, 6);
-        emit updateLight(true, 5);
-
-        emit informUser("Perform CPR on patient.");
-        emit voiceText("START CPR");
+int AED::getElapsedSeconds()
+{
+    return elapsedSeconds;
+}
 
-        playAudio("qrc:/audio/StartCPR.aiff");
-    }
+Clock* AED::getClock()
+{
+    return clock;
 }
 
 void AED::onChangeBatteryLevel(int newBatteryLevel)
 {
+    emit inputApplied(InputBatteryLevel, newBatteryLevel);
+
     // Battery must be between 0 to 100
     if (newBatteryLevel < 0 || newBatteryLevel > 100) {
         return;
     }
 
-    batteryLevel = newBatteryLevel;
-    emit updateBatteryLevel(batteryLevel);
+    updateBattery();
+    battery.setLevel(newBatteryLevel);
+    publishBatteryLevel(true);
 }
 
 void AED::onBatteryTimeDrain()
 {
-    onChangeBatteryLevel(batteryLevel - 1);
+    updateBattery();
+    publishBatteryLevel(false);
+}
+
+void AED::updateBattery()
+{
+    // Nothing is drawn while the pack is out
+    qint64 now = clock->now();
+    if (connections->isBatteryConnected()) {
+        battery.advance((now - batteryMsec) / 1000.0);
+    }
+    batteryMsec = now;
+}
+
+void AED::updateBatteryTimer()
+{
+    // The level only needs refreshing while someone is watching it go down
+    if (powerState && connections->isBatteryConnected()) {
+        if (!batteryDrainTimer->isActive()) {
+            batteryDrainTimer->start(1000);
+        }
+    }
+    else {
+        batteryDrainTimer->stop();
+    }
+}
+
+void AED::publishBatteryLevel(bool force)
+{
+    int level = battery.getLevel();
+    if (level != batteryLevel || force) {
+        batteryLevel = level;
+        BatteryModel::Prediction prediction = battery.predict(ShockJoules);
+        emit updateBatteryLevel(batteryLevel);
+        emit updateBatteryPrediction(prediction.shocks, int(prediction.runMinutes));
+    }
+
+    if (batteryLevel == 0) {
+        dispatch(BatteryDrained);
+    }
 }
 
 int AED::getBatteryLevel()
@@ -307,33 +1025,278 @@ int AED::getBatteryLevel()
     return batteryLevel;
 }
 
-bool AED::disconnected(){
-    while(! emit isElectrodeConnected()){
-        emit setAEDStyleSheet("border-image: url(:/overlay/aedNoElectrode.png);background-color: rgba(255, 255, 255, 0);");
-        emit informUser("Electrode disconnected.\nPlease connect electrode.");
-        delay(1);
+BatteryModel* AED::getBattery()
+{
+    return &battery;
+}
+
+void AED::shutDownDevice(){
+    if (state != Off) {
+        enterState(Off);
     }
+}
 
-    while(! emit isBatteryConnected()){
-        emit informUser("Battery disconnected.\nPlease connect battery.");
-        delay(1);
+QString AED::rhythmName(Rhythm rhythm)
+{
+    switch (rhythm) {
+    case VF:
+        return "VF";
+    case VT:
+        return "VT";
+    case PEA:
+        return "PEA";
+    case Asystole:
+        return "Asystole";
+    case Regular:
+        return "Regular";
+    default:
+        return "None";
     }
+}
 
+// --- Inputs ---
 
-    if (getBatteryLevel() == 0){
-        shutDownDevice();
-        return false;
+void AED::onPowerButtonPressed()
+{
+    emit inputApplied(InputPowerPressed, 0);
+
+    // Start the timer when the button is pressed
+    powerButtonDown = true;
+    buttonHoldTimer->start();
+}
+
+void AED::onPowerButtonReleased()
+{
+    emit inputApplied(InputPowerReleased, 0);
+
+    // Stop the timer when the button is released
+    powerButtonDown = false;
+    buttonHoldTimer->stop();
+}
+
+void AED::checkButtonHoldDuration()
+{
+    LoopWatchdog::Scope scope("AED::checkButtonHoldDuration");
+
+    // This slot is called when the timer times out (after 5 seconds)
+    if(getPowerState()){
+        dispatch(PowerOff);
+    }
+    // Check if the button is still pressed after 5 seconds
+    else if(powerButtonDown)
+    {
+        run();
     }
-    return true;
 }
 
-void AED::shutDownDevice(){
-    emit informUser("Battery drained. \n Device shutting down.");
-    shockCount = 0;
-    batteryLevel = 100;
-    powerState = false;
-    electrodePadConnected = false;
-    emit resetUI();
+void AED::updateElapsedTimer()
+{
+    if(getPowerState()){
+        elapsedSeconds++;
+        emit updateElapsedTime(elapsedSeconds);
+    }
+}
+
+void AED::onBatteryConnected(bool connected)
+{
+    emit inputApplied(InputBattery, connected);
+    connections->setBatteryConnected(connected);
+}
+
+void AED::onBatteryConnectionChanged(bool connected)
+{
+    // Charge drawn up to the removal counts, the time without a pack is skipped
+    qint64 now = clock->now();
+    if (!connected) {
+        battery.advance((now - batteryMsec) / 1000.0);
+    }
+    batteryMsec = now;
+    updateBatteryTimer();
+
+    if (connected) {
+        say(PromptCatalog::BatteryConnected);
+        dispatch(BatteryInserted);
+    }
+    else {
+        dispatch(BatteryRemoved);
+    }
+}
+
+void AED::onSelfTestChanged(bool passed)
+{
+    emit inputApplied(InputSelfTest, passed);
+    selfTestPassed = passed;
+}
+
+void AED::onPadsChanged(bool adult, bool child)
+{
+    emit inputApplied(InputPads, (adult ? 1 : 0) | (child ? 2 : 0));
+    connections->setPads(adult, child);
+}
+
+void AED::onPadsConnectionChanged(bool attached)
+{
+    // Before power on the pads are picked up by run()
+    if (!getPowerState()) {
+        return;
+    }
+
+    if (attached) {
+        // Pads put back on after the device had already confirmed them
+        if (electrodePadConnected) {
+            emit updateElectrodeOverlay(true);
+        }
+        dispatch(PadsAttached);
+    }
+    else {
+        emit updateElectrodeOverlay(false);
+        dispatch(PadsRemoved);
+    }
+}
+
+void AED::onRhythmSelected(int rhythm)
+{
+    emit inputApplied(InputRhythm, rhythm);
+
+    if (rhythm < VF || rhythm > Regular || state != AwaitRhythm) {
+        return;
+    }
+
+    selectedRhythm = static_cast<Rhythm>(rhythm);
+    dispatch(RhythmSelected);
+}
+
+void AED::onShockPressed()
+{
+    emit inputApplied(InputShock, 0);
+    dispatch(ShockPressed);
+}
+
+void AED::onCprPressed()
+{
+    emit inputApplied(InputCpr, 0);
+    dispatch(CprPressed);
+}
+
+void AED::onCprDepthChanged(int depth)
+{
+    emit inputApplied(InputCprDepth, depth);
+    cprDepth = depth;
+}
+
+void AED::applyInput(int input, int value)
+{
+    switch (input) {
+    case InputPowerPressed:
+        onPowerButtonPressed();
+        break;
+    case InputPowerReleased:
+        onPowerButtonReleased();
+        break;
+    case InputBattery:
+        onBatteryConnected(value != 0);
+        break;
+    case InputSelfTest:
+        onSelfTestChanged(value != 0);
+        break;
+    case InputPads:
+        onPadsChanged(value & 1, value & 2);
+        break;
+    case InputRhythm:
+        onRhythmSelected(value);
+        break;
+    case InputShock:
+        onShockPressed();
+        break;
+    case InputCpr:
+        onCprPressed();
+        break;
+    case InputCprDepth:
+        onCprDepthChanged(value);
+        break;
+    case InputBatteryLevel:
+        onChangeBatteryLevel(value);
+        break;
+    default:
+        qWarning("unknown input %d", input);
+        break;
+    }
+}
+
+void AED::setSeed(quint32 seed)
+{
+    this->seed = seed;
+    ecg->setSeed(seed);
+}
+
+quint32 AED::getSeed()
+{
+    return seed;
+}
 
+// --- CPR ---
 
+void AED::setCprSimulation(bool enabled)
+{
+    cprSimulated = enabled;
+}
+
+CprAnalyzer* AED::getCprAnalyzer()
+{
+    return &cpr;
+}
+
+void AED::updateCprSampling()
+{
+    bool sampling = (state == CprCoaching || state == CprFeedback);
+    if (sampling && !cprTimer->isActive()) {
+        cprTimer->start();
+    }
+    else if (!sampling) {
+        cprTimer->stop();
+    }
+}
+
+void AED::onCprSample()
+{
+    LoopWatchdog::Scope scope("AED::onCprSample");
+
+    qint64 now = clock->now();
+
+    double depth = cprDepth;
+    if (cprSimulated) {
+        // Pushed down to the requested depth and released fully, at a steady rate
+        double phase = (now - cprStartMsec) * SimulatedCompressionsPerMinute / 60000.0;
+        depth = cprDepth * 0.5 * (1.0 - qCos(2.0 * M_PI * phase));
+    }
+
+    // Real-time prompts once a few compressions have been felt
+    if (cpr.addSample(now, depth) && cpr.getQuality().compressions >= 3) {
+        giveCprFeedback(false);
+    }
+}
+
+void AED::onInputsChanged()
+{
+    LoopWatchdog::Scope scope("AED::onInputsChanged");
+    DeviceInputs::Snapshot snapshot = inputs.take();
+    if (snapshot.sequence == appliedInputs.sequence) {
+        return;
+    }
+    DeviceInputs::Snapshot previous = appliedInputs;
+    appliedInputs = snapshot;
+
+    // Only the fields that changed are applied, so each one is a single input in the event log
+    if (snapshot.selfTestPassed != previous.selfTestPassed) {
+        onSelfTestChanged(snapshot.selfTestPassed);
+    }
+    if (snapshot.cprDepth != previous.cprDepth) {
+        onCprDepthChanged(snapshot.cprDepth);
+    }
+    if (snapshot.adultPads != previous.adultPads || snapshot.childPads != previous.childPads) {
+        onPadsChanged(snapshot.adultPads, snapshot.childPads);
+    }
+    if (snapshot.batteryConnected != previous.batteryConnected) {
+        onBatteryConnected(snapshot.batteryConnected);
+    }
 }
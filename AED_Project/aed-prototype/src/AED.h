@@ -5,55 +5,286 @@
 #include <string>
 #include <iostream>
 #include <QRandomGenerator>
-#include <QTimer>
-#include <QEventLoop>
-#include <QPixmap>
-#include <QtMultimedia>
+#include <QVector>
+#include "clock.h"
+#include "rhythmclassifier.h"
+#include "connectionmonitor.h"
+#include "deviceinputs.h"
+#include "batterymodel.h"
+#include "cpranalyzer.h"
+#include "promptcatalog.h"
 
+class EcgGenerator;
+class EcgSource;
+
+// GUI-free protocol engine.
+// All device inputs (buttons, pads, battery, rhythm selection, CPR depth) are pushed in through the
+// public slots below and every output is an emitted signal, so the same engine can be driven by
+// MainWindow or by the headless scenario runner.
+// Pad and battery inputs go through a ConnectionMonitor, which only reports real changes; the engine
+// suspends or resumes the protocol in the same call, nothing waits or polls for a connection.
+// A front end on another thread publishes those level inputs through getInputs() instead, and
+// receives the outputs through a DeviceLink.
+//
+// The rescue protocol is a non-blocking state machine. Every state and transition is listed in
+// the STATES and TRANSITIONS tables in AED.cpp; a step runs its entry action, arms the step timer
+// and returns to the event loop, so power-off and pad/battery changes take effect immediately.
 class AED : public QObject
 {
     Q_OBJECT
 
+public:
+    // Energy of every shock, and the level below which the self-test asks for a new battery
+    static const int ShockJoules = 200;
+    static const int LowBatteryPercent = 5;
+
+    // Rhythm selected by the trainer (matches the radio buttons in the rhythm group box)
+    enum Rhythm {
+        NoRhythm = 0,
+        VF = 1,
+        VT = 2,
+        PEA = 3,
+        Asystole = 4,
+        Regular = 5
+    };
+
+    // Protocol states, in the order of the STATES table
+    enum State {
+        Off,
+        SelfTestLights,
+        SelfTestBattery,
+        BatteryOk,
+        ChangeBatteries,
+        UnitFailed,
+        SelfTestPassed,
+        UnitOk,
+        StayCalm,
+        CheckResponsiveness,
+        CallForHelp,
+        AttachPads,
+        PlacingPads,
+        PadsPlaced,
+        PadsAnalyzing,
+        PadsOnStartup,
+        AwaitRhythm,
+        Analyzing,
+        ShockAdvised,
+        ShockReady,
+        ShockRefused,
+        ShockDelivering,
+        ShockTone,
+        ShockDelivered,
+        NoShockPea,
+        NoShockAsystole,
+        PatientDeceased,
+        NoShockRegular,
+        RegularHeartbeat,
+        StartCpr,
+        CprCoaching,
+        CprFeedback,
+        CprStop,
+        CprDone,
+        ResumeAnalysis,
+        PadsDisconnected,
+        BatteryDisconnected,
+        StateCount,
+
+        // Pseudo states used only in the transition table
+        AnyState,
+        Resume
+    };
+
+    // Inputs that drive transitions
+    enum Event {
+        Timeout,
+        PowerOn,
+        PowerOff,
+        BatteryDrained,
+        PadsAttached,
+        PadsRemoved,
+        BatteryRemoved,
+        BatteryInserted,
+        RhythmSelected,
+        ShockPressed,
+        CprPressed
+    };
+
+    // Trainee and trainer inputs as reported by inputApplied(), so a session can be recorded and replayed
+    enum Input {
+        InputPowerPressed,
+        InputPowerReleased,
+        InputBattery,           // value: connected
+        InputSelfTest,          // value: passed
+        InputPads,              // value: 1 adult pads | 2 child pads
+        InputRhythm,            // value: Rhythm
+        InputShock,
+        InputCpr,
+        InputCprDepth,          // value: depth
+        InputBatteryLevel       // value: level
+    };
+
 private:
-    // Private static singleton object
-    static AED* INSTANCE;
+    typedef void (AED::*Action)();
+    typedef bool (AED::*Guard)();
 
-    // Private Constructor
-    // Prevent objects from being made outside of itself
-    explicit AED(QObject *parent = nullptr);
+    // Holding time of a step that only leaves on an input event
+    static const int WaitForInput = -1;
+
+    // Speaker time charged to the battery per voice prompt
+    static const int PromptMsec = 2500;
 
-    int batteryLevel;
+    // CPR feedback samples the chest displacement at 100 Hz; synthesised compressions run at this rate
+    static const int CprSampleMsec = 10;
+    static const int SimulatedCompressionsPerMinute = 110;
+
+    // Length of ECG the shock advisory looks at
+    static const int AnalysisWindowMsec = 4000;
+
+    struct StateInfo {
+        State state;
+        const char* name;
+        Action enter;
+        int holdMsec;           // Timeout fires after this long, WaitForInput for none
+        bool padsRequired;      // the step is suspended while the pads are off
+    };
+
+    struct Transition {
+        State from;
+        Event event;
+        Guard guard;            // nullptr when unconditional
+        State to;
+    };
+
+    static const StateInfo STATES[];
+    static const Transition TRANSITIONS[];
+
+    BatteryModel battery;
+    int batteryLevel;           // last level reported to the front end
+    qint64 batteryMsec;         // device time the model was last advanced to
     int shockCount;
     bool electrodePadConnected;
     bool powerState;
-    QAudioOutput* audioOutput;
-    QMediaPlayer* player;
 
-    void delay(int seconds);    //custom function to create time delay
+    // Injected inputs
+    DeviceInputs inputs;
+    DeviceInputs::Snapshot appliedInputs;   // last snapshot applied
+    ConnectionMonitor* connections;
+    bool selfTestPassed;
+    bool powerButtonDown;
+    int cprDepth;
+    bool cprSimulated;
+    Rhythm selectedRhythm;
+    quint32 seed;
+
+    State state;
+    State interruptedState;     // step to resume after a pad or battery interruption
+    int transitionCount;
+
+    Clock* clock;
+    ClockTimer* stepTimer;
+    ClockTimer* buttonHoldTimer;
+    ClockTimer* elapsedTimer;
+    int elapsedSeconds;
+    ClockTimer* batteryDrainTimer;
+
+    // Patient signal seen through the pads
+    EcgGenerator* ecg;
+    EcgSource* ecgSource;           // replaces the generator when set (e.g. a recording)
+    ClockTimer* ecgTimer;
+    qint64 ecgStartMsec;
+    qint64 ecgEmitted;
+    bool ecgStreaming;
+    QVector<float> ecgHistory;      // the last AnalysisWindowMsec of streamed samples
+    int ecgHistoryPos;
+    qint64 ecgHistoryCount;
+
+    // Shock advisory on the analysis window
+    RhythmClassifier classifier;
+    RhythmClassifier::Result analysis;
+    bool analysisValid;
+
+    // CPR quality while coaching
+    CprAnalyzer cpr;
+    ClockTimer* cprTimer;
+    qint64 cprStartMsec;
+    int cprFeedback;            // last prompted CprAnalyzer::Feedback, -1 for none yet
+
+    void updateCprSampling();
+    void giveCprFeedback(bool force);
+
+    EcgSource* activeEcgSource();
+    void updateEcgStream();
+    const RhythmClassifier::Result& currentAnalysis();
+    Rhythm detectedRhythm();
+
+    void updateBattery();
+    void updateBatteryTimer();
+    void publishBatteryLevel(bool force);
+
+    void dispatch(Event event);
+    void enterState(State next);
+
+    // Shows, captions and plays whichever parts the prompt has; detail goes on a display line of its own
+    void say(PromptCatalog::Prompt prompt, const QString &detail = QString());
+
+    // Guards
+    bool isPowered();
+    bool isPadsRequired();
+    bool hasBatteryCharge();
+    bool isBatteryDrained();
+    bool isSelfTestOk();
+    bool isPadsConnected();
+    bool isShockable();
+    bool isPea();
+    bool isAsystole();
+    bool hasShockCharge();
+
+    // Entry actions
+    void enterOff();
+    void enterSelfTestLights();
+    void enterSelfTestBattery();
+    void enterBatteryOk();
+    void enterChangeBatteries();
+    void enterUnitFailed();
+    void enterSelfTestPassed();
+    void enterUnitOk();
+    void enterStayCalm();
+    void enterCheckResponsiveness();
+    void enterCallForHelp();
+    void enterAttachPads();
+    void enterPlacingPads();
+    void enterPadsPlaced();
+    void enterPadsAnalyzing();
+    void enterPadsOnStartup();
+    void enterAwaitRhythm();
+    void enterAnalyzing();
+    void enterShockAdvised();
+    void enterShockReady();
+    void enterShockRefused();
+    void enterShockDelivering();
+    void enterShockTone();
+    void enterShockDelivered();
+    void enterNoShockPea();
+    void enterNoShockAsystole();
+    void enterPatientDeceased();
+    void enterNoShockRegular();
+    void enterRegularHeartbeat();
+    void enterStartCpr();
+    void enterCprCoaching();
+    void enterCprFeedback();
+    void enterCprStop();
+    void enterCprDone();
+    void enterResumeAnalysis();
+    void enterPadsDisconnected();
+    void enterBatteryDisconnected();
 
 public:
-    // Singleton Constructor
-    static AED* instance() {
-        if (INSTANCE == NULL) {
-            INSTANCE = new AED();
-            return INSTANCE;
-        }
-        else {
-            return INSTANCE;
-        }
-    }
+    // Each device owns its clock, timers and battery; any number can live in one process
+    explicit AED(QObject *parent = nullptr);
+    ~AED();
 
     void run();
-    bool selfTest();
-    void checkResponsiveness();
-    void call911();
-    void electrodePad();
-    bool checkShockableRhythm();
-    void shockSequence();
-    void cprSequence();
     void playAudio(QString audioFile);
-    bool detectRhythm(bool shockable);
-    bool disconnected();
     void shutDownDevice();
 
     bool getPowerState();
@@ -64,29 +295,96 @@ public:
     int getShockCount();
     int getBatteryLevel();
 
+    // Temperature, age and load parameters of the pack; not thread-safe, set before the device starts
+    BatteryModel* getBattery();
+    int getElapsedSeconds();
+    Clock* getClock();
+    bool isPadsAttached();
+    ConnectionMonitor* getConnections();
+
+    // Level inputs published from another thread; call onInputsChanged() on the device's thread after
+    // DeviceInputs::publish() asks for a wake-up
+    DeviceInputs* getInputs();
+    State getState();
+    EcgGenerator* getEcg();
+    int getEcgSampleRate();
+
+    // With simulation on (the default) the CPR depth input is the depth the rescuer pushes to and the
+    // device synthesises compressions from it; off, the input is the measured chest displacement
+    void setCprSimulation(bool enabled);
+    CprAnalyzer* getCprAnalyzer();
+
+    // Feed the pads from another source; nullptr goes back to the generator. Not owned.
+    void setEcgSource(EcgSource* source);
+    EcgSource* getEcgSource();      // nullptr while the generator feeds the pads
+
+    // While powered, emit ecgSamples() in real time (off by default, the headless runner has no monitor).
+    // Analysis then classifies the streamed history rather than a fresh window, so a replay must match it.
+    void setEcgStreaming(bool enabled);
+    bool isEcgStreaming();
+
+    // Seeds the patient signal's noise; a session replays the same only with the same seed
+    void setSeed(quint32 seed);
+    quint32 getSeed();
+
+    // Calls the slot of an Input, as if it had come from the front end
+    void applyInput(int input, int value);
+
+    static QString rhythmName(Rhythm rhythm);
+    static QString stateName(State state);
+
 
 public slots:
     void onBatteryTimeDrain();
     void onChangeBatteryLevel(int newBatteryLevel);
 
+    // --- Inputs ---
+    void onPowerButtonPressed();
+    void onPowerButtonReleased();
+    void onBatteryConnected(bool connected);
+    void onSelfTestChanged(bool passed);
+    void onPadsChanged(bool adult, bool child);
+    void onRhythmSelected(int rhythm);
+    void onShockPressed();
+    void onCprPressed();
+    void onCprDepthChanged(int depth);
+    void onInputsChanged();     // applies the latest DeviceInputs snapshot
+
+private slots:
+    void checkButtonHoldDuration();
+    void updateElapsedTimer();
+    void onStepTimeout();
+    void onEcgTick();
+    void onCprSample();
+    void onPadsConnectionChanged(bool attached);
+    void onBatteryConnectionChanged(bool connected);
+
 signals:
     void informUser(QString);
     void voiceText(QString);
-    void setPowerButtonStyleSheet(QString styleSheet);
-    void setAEDStyleSheet(QString styleSheet);
-    void displayCprBar();
-    bool batteryStatus();
-    bool shockable();
-    void updateStatusIndicator(QString image);
+    void audio(QString audioFile);
+    void updateElectrodeOverlay(bool connected);    // case drawn with or without the pads
+    void displayCprBar(bool show);
+    void updateStatusIndicator(bool ok);
     void toggleElectrodeStates(bool state);
     void updateLight(bool state, int light);
     void shockButton(bool enable);
     void updateBatteryLevel(int batteryLevel);
-    bool getSelfTest();
-    bool isElectrodeConnected();
-    bool isBatteryConnected();
+    void updateBatteryPrediction(int shocks, int runMinutes);
+    void updateShockCount(int shockCount);
+    void updateElapsedTime(int seconds);
+    void rhythmDetected(int rhythm);
+    void cprButton(bool enable);
+    void cprStateChanged(bool active);
     void resetUI();
-    void toggleRhythmOptions();
+    void powerStateChanged(bool on);
+    void stateChanged(int state);
+    void rescueEnded();
+    void toggleRhythmOptions(bool enable);
+    void ecgSamples(QVector<float> samples);    // lead II, in millivolts
+    void rhythmAnalyzed(bool shockable, double confidence);
+    void ecgSampleRateChanged(int hz);
+    void inputApplied(int input, int value);        // emitted before the input takes effect
 };
 
 #endif // AED_H
@@ -0,0 +1,133 @@
+#include "assetatlas.h"
+#include <QDirIterator>
+#include <QImage>
+
+namespace {
+
+qint64 pixmapBytes(const QPixmap &pixmap)
+{
+    return qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+}
+
+}
+
+AssetAtlas::AssetAtlas()
+{
+    devicePixelRatio = 1.0;
+    counters = {};
+}
+
+void AssetAtlas::setDevicePixelRatio(qreal ratio)
+{
+    if (ratio <= 0 || ratio == devicePixelRatio) {
+        return;
+    }
+
+    // Scaled copies were rendered for the old density
+    devicePixelRatio = ratio;
+    for (Entry &entry : entries) {
+        for (const QPixmap &copy : entry.scaled) {
+            counters.bytes -= pixmapBytes(copy);
+        }
+        entry.scaled.clear();
+    }
+}
+
+int AssetAtlas::preload(QString root)
+{
+    QDirIterator it(root, QStringList() << "*.png", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        load(it.next());
+    }
+    return entries.size();
+}
+
+void AssetAtlas::prescale(QString path, QSize size)
+{
+    pixmap(path, size);
+}
+
+QPixmap AssetAtlas::pixmap(QString path)
+{
+    int decodes = counters.decodes;
+    Entry* entry = load(path);
+    if (entry == nullptr) {
+        return QPixmap();
+    }
+    if (counters.decodes == decodes) {
+        counters.hits++;
+    }
+    return entry->original;
+}
+
+QPixmap AssetAtlas::pixmap(QString path, QSize size)
+{
+    Entry* entry = load(path);
+    if (entry == nullptr || size.isEmpty()) {
+        return entry ? entry->original : QPixmap();
+    }
+
+    QSize target = size * devicePixelRatio;
+    for (const QPixmap &copy : entry->scaled) {
+        if (copy.size() == target) {
+            counters.hits++;
+            return copy;
+        }
+    }
+
+    QPixmap copy = entry->original.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    copy.setDevicePixelRatio(devicePixelRatio);
+    entry->scaled.append(copy);
+    counters.allocs++;
+    counters.bytes += pixmapBytes(copy);
+    return copy;
+}
+
+AssetAtlas::Counters AssetAtlas::getCounters()
+{
+    return counters;
+}
+
+QString AssetAtlas::countersText(const Counters &counters)
+{
+    return QString("%1 decodes, %2 pixmap allocs, %3 atlas hits")
+        .arg(counters.decodes)
+        .arg(counters.allocs)
+        .arg(counters.hits);
+}
+
+AssetAtlas::Counters AssetAtlas::difference(const Counters &now, const Counters &before)
+{
+    Counters delta;
+    delta.decodes = now.decodes - before.decodes;
+    delta.allocs = now.allocs - before.allocs;
+    delta.hits = now.hits - before.hits;
+    delta.bytes = now.bytes - before.bytes;
+    return delta;
+}
+
+AssetAtlas::Entry* AssetAtlas::load(QString path)
+{
+    // Style sheets and the .ui file name images by URL
+    if (path.startsWith("qrc:")) {
+        path = path.mid(3);
+    }
+
+    auto it = entries.find(path);
+    if (it != entries.end()) {
+        return &it.value();
+    }
+
+    QImage image(path);
+    if (image.isNull()) {
+        qWarning("assets: cannot decode %s", qPrintable(path));
+        return nullptr;
+    }
+    counters.decodes++;
+
+    Entry entry;
+    entry.original = QPixmap::fromImage(image);
+    counters.allocs++;
+    counters.bytes += pixmapBytes(entry.original);
+    return &entries.insert(path, entry).value();
+}
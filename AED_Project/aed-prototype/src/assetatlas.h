@@ -0,0 +1,53 @@
+#ifndef ASSETATLAS_H
+#define ASSETATLAS_H
+
+#include <QString>
+#include <QSize>
+#include <QPixmap>
+#include <QHash>
+#include <QList>
+
+// Every image in the resources, decoded once.
+// preload() decodes the originals at startup and prescale() prepares the copies the panel shows at
+// a fixed size, so switching a light or an indicator afterwards is a hash lookup that hands out an
+// implicitly shared QPixmap. Nothing is decoded or scaled on the hot path unless a caller asks for a
+// new image or size, and the counters make that visible.
+class AssetAtlas
+{
+public:
+    struct Counters {
+        int decodes;            // images read from the resources
+        int allocs;             // pixmaps created (originals and scaled copies)
+        int hits;               // lookups served from the atlas
+        qint64 bytes;           // pixel memory held
+    };
+
+    AssetAtlas();
+
+    void setDevicePixelRatio(qreal ratio);  // scaled copies are rendered for this screen density
+
+    // Decodes every .png under a resource directory, e.g. ":/". Returns the number of images.
+    int preload(QString root = ":/");
+    void prescale(QString path, QSize size);
+
+    QPixmap pixmap(QString path);               // original size
+    QPixmap pixmap(QString path, QSize size);   // scaled to a widget's size in device-independent pixels
+
+    Counters getCounters();
+    static QString countersText(const Counters &counters);
+    static Counters difference(const Counters &now, const Counters &before);
+
+private:
+    struct Entry {
+        QPixmap original;
+        QList<QPixmap> scaled;
+    };
+
+    qreal devicePixelRatio;
+    QHash<QString, Entry> entries;
+    Counters counters;
+
+    Entry* load(QString path);
+};
+
+#endif // ASSETATLAS_H
@@ -0,0 +1,204 @@
+#include "batterymodel.h"
+#include <QtMath>
+
+namespace {
+
+const double SECONDS_PER_DAY = 86400.0;
+const double SECONDS_PER_YEAR = 365.0 * SECONDS_PER_DAY;
+
+// Roughly a 12 V lithium manganese dioxide AED pack: ~300 capacitor charges at 200 J, ~4.5 hours running
+// and ~4 years in standby with daily self-tests
+const BatteryModel::Parameters DEFAULT_PARAMETERS = {
+    2800.0,     // capacityMah
+    12.0,       // voltage
+    0.5,        // chargerEfficiency
+    0.02,       // standbyMa
+    450.0,      // runningMa
+    150.0,      // displayMa
+    300.0,      // audioMa
+    1.2,        // selfTestMah
+    0.01,       // selfDischargePerYear
+    0.02,       // capacityFadePerYear
+};
+
+}
+
+BatteryModel::BatteryModel()
+{
+    parameters = DEFAULT_PARAMETERS;
+    chargeMah = parameters.capacityMah;
+    temperature = 25.0;
+    ageDays = 0.0;
+    loads = 0;
+}
+
+BatteryModel::Parameters BatteryModel::getParameters()
+{
+    return parameters;
+}
+
+void BatteryModel::setParameters(const Parameters &parameters)
+{
+    this->parameters = parameters;
+    chargeMah = qMin(chargeMah, getCapacityMah());
+}
+
+void BatteryModel::setTemperature(double celsius)
+{
+    temperature = celsius;
+}
+
+double BatteryModel::getTemperature()
+{
+    return temperature;
+}
+
+void BatteryModel::setAgeDays(double days)
+{
+    ageDays = qMax(0.0, days);
+    chargeMah = qMin(chargeMah, getCapacityMah());
+}
+
+double BatteryModel::getAgeDays()
+{
+    return ageDays;
+}
+
+void BatteryModel::setLoads(int loads)
+{
+    this->loads = loads;
+}
+
+int BatteryModel::getLoads()
+{
+    return loads;
+}
+
+void BatteryModel::advance(double seconds)
+{
+    if (seconds <= 0) {
+        return;
+    }
+
+    // Constant draw plus self-discharge proportional to the charge left:
+    // dQ/dt = -I - kQ, so Q(t) = (Q0 + I/k) e^(-kt) - I/k
+    double drawMah = loadMa() / 3600.0;     // per second
+    double k = selfDischargeRate();
+    double next;
+    if (k > 0) {
+        next = (chargeMah + drawMah / k) * qExp(-k * seconds) - drawMah / k;
+    }
+    else {
+        next = chargeMah - drawMah * seconds;
+    }
+
+    ageDays += seconds / SECONDS_PER_DAY;
+    chargeMah = qBound(0.0, next, getCapacityMah());
+}
+
+void BatteryModel::drawCharge(double mah)
+{
+    chargeMah = qMax(0.0, chargeMah - mah);
+}
+
+void BatteryModel::deliverShock(double joules)
+{
+    drawCharge(shockMah(parameters, joules));
+}
+
+int BatteryModel::getLevel()
+{
+    return qBound(0, int(100.0 * getAvailableMah() / parameters.capacityMah), 100);
+}
+
+void BatteryModel::setLevel(int percent)
+{
+    double available = parameters.capacityMah * qBound(0, percent, 100) / 100.0;
+    chargeMah = qMin(available / temperatureFactor(), getCapacityMah());
+}
+
+double BatteryModel::getAvailableMah()
+{
+    return chargeMah * temperatureFactor();
+}
+
+double BatteryModel::getCapacityMah()
+{
+    double years = ageDays / 365.0;
+    return parameters.capacityMah * qMax(0.5, 1.0 - parameters.capacityFadePerYear * years);
+}
+
+double BatteryModel::shockMah(const Parameters &parameters, double joules)
+{
+    // Energy drawn from the pack for one capacitor charge, in mAh
+    return joules / (parameters.voltage * parameters.chargerEfficiency) / 3.6;
+}
+
+BatteryModel::Prediction BatteryModel::predict(double joules)
+{
+    double available = getAvailableMah();
+    double runningMa = parameters.runningMa + parameters.displayMa;
+
+    // Each shock cycle: the capacitor charge plus about a minute of running (analysis, charging, CPR
+    // prompts) before the next one
+    double cycleMah = shockMah(parameters, joules) + runningMa / 60.0;
+
+    double dailyMah = parameters.standbyMa * 24.0 + parameters.selfTestMah
+                    + chargeMah * selfDischargeRate() * SECONDS_PER_DAY;
+
+    Prediction prediction;
+    prediction.shocks = int(available / cycleMah);
+    prediction.runMinutes = available / runningMa * 60.0;
+    prediction.standbyDays = dailyMah > 0 ? available / dailyMah : 0;
+    return prediction;
+}
+
+double BatteryModel::simulateStandby(double selfTestHours, int replacePercent, double maxDays)
+{
+    int saved = loads;
+    loads = 0;
+
+    // Closed-form integration between self-tests, so the cost is one step per test
+    double step = qMax(0.01, selfTestHours) * 3600.0;
+    double seconds = 0;
+    while (getLevel() >= replacePercent && seconds < maxDays * SECONDS_PER_DAY) {
+        advance(step);
+        drawCharge(parameters.selfTestMah);
+        seconds += step;
+    }
+
+    loads = saved;
+    return seconds / SECONDS_PER_DAY;
+}
+
+double BatteryModel::loadMa()
+{
+    if (loads == 0) {
+        return parameters.standbyMa;
+    }
+
+    double ma = 0;
+    if (loads & Running) {
+        ma += parameters.runningMa;
+    }
+    if (loads & Display) {
+        ma += parameters.displayMa;
+    }
+    return ma;
+}
+
+double BatteryModel::temperatureFactor()
+{
+    // Lithium chemistry gives up less of its charge in the cold; flat from 20 C up
+    if (temperature >= 20.0) {
+        return 1.0;
+    }
+    return qMax(0.3, 1.0 - 0.012 * (20.0 - temperature));
+}
+
+double BatteryModel::selfDischargeRate()
+{
+    // Doubles every 10 C above room temperature
+    double perYear = parameters.selfDischargePerYear * qPow(2.0, (temperature - 25.0) / 10.0);
+    return perYear / SECONDS_PER_YEAR;
+}
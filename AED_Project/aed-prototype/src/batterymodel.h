@@ -0,0 +1,85 @@
+#ifndef BATTERYMODEL_H
+#define BATTERYMODEL_H
+
+#include <QtGlobal>
+
+// Charge left in a non-rechargeable lithium AED pack.
+// The charge is integrated from the loads that are on over time: standby draw while the device is
+// off, the electronics and display while it runs, the speaker while it talks, and the capacitor
+// charge for every shock (energy / (pack voltage x charger efficiency)). Self-discharge grows with
+// temperature, capacity fades with age, and cold packs can only give part of their charge.
+// The level shown to the user is the available charge as a share of a new pack at room temperature.
+//
+// There is no timer in here: advance() integrates any span in one step, so a run of years of
+// standby with daily self-tests (simulateStandby()) takes microseconds.
+class BatteryModel
+{
+public:
+    struct Parameters {
+        double capacityMah;         // new pack at 25 C
+        double voltage;
+        double chargerEfficiency;   // share of the drawn energy that ends up in the capacitor
+        double standbyMa;           // device off, battery inserted
+        double runningMa;           // electronics while powered
+        double displayMa;
+        double audioMa;             // speaker while a prompt plays, drawn per prompt (see drawCharge())
+        double selfTestMah;         // one daily self-test
+        double selfDischargePerYear;    // share of the charge lost per year at 25 C
+        double capacityFadePerYear;     // share of the capacity lost per year of age
+    };
+
+    struct Prediction {
+        int shocks;                 // at the given energy, with the device running in between
+        double runMinutes;          // powered with the display on
+        double standbyDays;         // off, with daily self-tests
+    };
+
+    // Loads that can be on at the same time, see setLoads()
+    enum Load {
+        Running = 0x1,
+        Display = 0x2
+    };
+
+    BatteryModel();
+
+    Parameters getParameters();
+    void setParameters(const Parameters &parameters);
+
+    void setTemperature(double celsius);
+    double getTemperature();
+    void setAgeDays(double days);
+    double getAgeDays();
+
+    void setLoads(int loads);       // Load bits; none means standby
+    int getLoads();
+
+    // Integrates the current loads, self-discharge and ageing over `seconds`
+    void advance(double seconds);
+    void drawCharge(double mah);    // one-off draw, e.g. a prompt or a self-test
+    void deliverShock(double joules);
+
+    int getLevel();                 // percent, rounded down
+    void setLevel(int percent);     // a pack at this level, for the trainer
+    double getAvailableMah();
+    double getCapacityMah();        // at the current age
+
+    static double shockMah(const Parameters &parameters, double joules);
+    Prediction predict(double joules);
+
+    // Fast-forward: years of standby with one self-test every `selfTestHours`, until the level drops
+    // below `replacePercent`. Returns the days that took; the model is left at the end state.
+    double simulateStandby(double selfTestHours, int replacePercent, double maxDays = 10 * 365.0);
+
+private:
+    Parameters parameters;
+    double chargeMah;               // left at room temperature
+    double temperature;
+    double ageDays;
+    int loads;
+
+    double loadMa();
+    double temperatureFactor();     // share of the charge a cold pack can deliver
+    double selfDischargeRate();     // per second, at the current temperature
+};
+
+#endif // BATTERYMODEL_H
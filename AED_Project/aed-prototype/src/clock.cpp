@@ -0,0 +1,247 @@
+#include "clock.h"
+
+Clock::Clock(QObject *parent)
+    : QObject{parent}
+{
+    mode = RealTime;
+    scale = 1.0;
+    base = 0;
+    virtualNow = 0;
+    autoAdvance = false;
+    wall.start();
+
+    idlePump = new QTimer(this);
+    idlePump->setInterval(0);
+    connect(idlePump, &QTimer::timeout, this, &Clock::advanceToNext);
+}
+
+Clock::~Clock()
+{
+    // Timers may outlive the clock when both belong to the same parent
+    for (ClockTimer* t : timers) {
+        t->clock = nullptr;
+    }
+}
+
+void Clock::setMode(Mode mode, double scale)
+{
+    qint64 current = now();
+
+    this->mode = mode;
+    this->scale = (mode == Scaled && scale > 0) ? scale : 1.0;
+
+    virtualNow = current;
+    base = current;
+    wall.restart();
+
+    // Re-arm running timers against the new time base
+    for (ClockTimer* t : timers) {
+        if (t->active) {
+            t->arm();
+        }
+    }
+    updateIdlePump();
+}
+
+Clock::Mode Clock::getMode()
+{
+    return mode;
+}
+
+double Clock::getScale()
+{
+    return scale;
+}
+
+void Clock::setAutoAdvance(bool enabled)
+{
+    autoAdvance = enabled;
+    updateIdlePump();
+}
+
+qint64 Clock::now()
+{
+    if (mode == Instant) {
+        return virtualNow;
+    }
+    return base + qint64(wall.nsecsElapsed() / 1000000.0 * scale);
+}
+
+void Clock::advance(qint64 msec)
+{
+    if (mode != Instant) {
+        return;
+    }
+
+    qint64 target = virtualNow + msec;
+
+    // Fire every timer that comes due before the target, in deadline order.
+    // A periodic timer re-arms itself and can fire several times.
+    ClockTimer* t = nextDue(target);
+    while (t != nullptr) {
+        virtualNow = qMax(virtualNow, t->deadline);
+        t->fire();
+        t = nextDue(target);
+    }
+
+    // A timeout handler may itself have waited past the target
+    virtualNow = qMax(virtualNow, target);
+}
+
+bool Clock::advanceToNext()
+{
+    if (mode != Instant) {
+        return false;
+    }
+
+    ClockTimer* next = nullptr;
+    for (ClockTimer* t : timers) {
+        if (t->active && (next == nullptr || t->deadline < next->deadline)) {
+            next = t;
+        }
+    }
+
+    if (next == nullptr) {
+        return false;
+    }
+
+    advance(next->deadline - virtualNow);
+    return true;
+}
+
+const Histogram& Clock::getLateness()
+{
+    return lateness;
+}
+
+int Clock::toWallMsec(qint64 msec)
+{
+    if (msec <= 0) {
+        return 0;
+    }
+    return int(msec / scale + 0.5);
+}
+
+ClockTimer* Clock::nextDue(qint64 limit)
+{
+    ClockTimer* next = nullptr;
+    for (ClockTimer* t : timers) {
+        if (t->active && t->deadline <= limit && (next == nullptr || t->deadline < next->deadline)) {
+            next = t;
+        }
+    }
+    return next;
+}
+
+void Clock::updateIdlePump()
+{
+    if (mode == Instant && autoAdvance) {
+        idlePump->start();
+    }
+    else {
+        idlePump->stop();
+    }
+}
+
+ClockTimer::ClockTimer(Clock *clock, QObject *parent)
+    : QObject{parent}
+    , clock(clock)
+{
+    intervalMsec = 0;
+    singleShot = false;
+    active = false;
+    deadline = 0;
+
+    timer = new QTimer(this);
+    timer->setSingleShot(true);
+    timer->setTimerType(Qt::PreciseTimer);
+    connect(timer, &QTimer::timeout, this, &ClockTimer::fire);
+
+    clock->timers.append(this);
+}
+
+ClockTimer::~ClockTimer()
+{
+    if (clock != nullptr) {
+        clock->timers.removeAt(clock->timers.indexOf(this));
+    }
+}
+
+void ClockTimer::setInterval(int msec)
+{
+    intervalMsec = msec;
+}
+
+int ClockTimer::interval()
+{
+    return intervalMsec;
+}
+
+void ClockTimer::setSingleShot(bool singleShot)
+{
+    this->singleShot = singleShot;
+}
+
+bool ClockTimer::isActive()
+{
+    return active;
+}
+
+void ClockTimer::start(int msec)
+{
+    intervalMsec = msec;
+    start();
+}
+
+void ClockTimer::start()
+{
+    if (clock == nullptr) {
+        return;
+    }
+
+    active = true;
+    deadline = clock->now() + intervalMsec;
+    arm();
+}
+
+void ClockTimer::stop()
+{
+    active = false;
+    timer->stop();
+}
+
+void ClockTimer::arm()
+{
+    if (clock == nullptr) {
+        timer->stop();
+    }
+    else if (clock->mode == Clock::Instant) {
+        // The clock fires us from advance()
+        timer->stop();
+    }
+    else {
+        timer->start(clock->toWallMsec(deadline - clock->now()));
+    }
+}
+
+void ClockTimer::fire()
+{
+    if (!active) {
+        return;
+    }
+
+    if (clock != nullptr && clock->mode != Clock::Instant) {
+        clock->lateness.record(qint64((clock->now() - deadline) / clock->scale));
+    }
+
+    if (singleShot) {
+        active = false;
+    }
+    else {
+        // Keep a fixed cadence in simulated time, independent of how late this firing was
+        deadline += qMax(intervalMsec, 1);
+        arm();
+    }
+
+    emit timeout();
+}
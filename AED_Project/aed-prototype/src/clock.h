@@ -0,0 +1,101 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QList>
+#include "histogram.h"
+
+class ClockTimer;
+
+// Time source for the protocol.
+// Every wait and timer in the AED goes through a Clock so a run can happen in
+// - RealTime: simulated time follows the wall clock
+// - Scaled:   simulated time runs `scale` times faster than the wall clock (e.g. 10x)
+// - Instant:  simulated time only moves when advanced
+// All times are simulated milliseconds since the clock was created.
+class Clock : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Mode {
+        RealTime,
+        Scaled,
+        Instant
+    };
+
+    explicit Clock(QObject *parent = nullptr);
+    ~Clock();
+
+    void setMode(Mode mode, double scale = 1.0);
+    Mode getMode();
+    double getScale();
+
+    // In Instant mode, idle iterations of the event loop advance time to the next pending timer
+    void setAutoAdvance(bool enabled);
+
+    qint64 now();
+    void advance(qint64 msec);      // Instant mode: move time forward, firing due timers in order
+    bool advanceToNext();           // Instant mode: jump to the next timer deadline
+
+    // How late timers fired, in wall-clock milliseconds (RealTime and Scaled modes only)
+    const Histogram& getLateness();
+
+private:
+    friend class ClockTimer;
+
+    Mode mode;
+    double scale;
+    qint64 base;                // simulated time when the wall clock was last rebased
+    qint64 virtualNow;          // simulated time in Instant mode
+    QElapsedTimer wall;
+    QList<ClockTimer*> timers;
+    QTimer* idlePump;
+    bool autoAdvance;
+    Histogram lateness;
+
+    void rebase();
+    int toWallMsec(qint64 msec);
+    ClockTimer* nextDue(qint64 limit);
+    void updateIdlePump();
+};
+
+// QTimer look-alike whose interval is measured in simulated time
+class ClockTimer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ClockTimer(Clock *clock, QObject *parent = nullptr);
+    ~ClockTimer();
+
+    void setInterval(int msec);
+    int interval();
+    void setSingleShot(bool singleShot);
+    bool isActive();
+
+public slots:
+    void start(int msec);
+    void start();
+    void stop();
+
+signals:
+    void timeout();
+
+private:
+    friend class Clock;
+
+    Clock* clock;
+    QTimer* timer;
+    int intervalMsec;
+    bool singleShot;
+    bool active;
+    qint64 deadline;
+
+    void arm();
+    void fire();
+};
+
+#endif // CLOCK_H
@@ -0,0 +1,68 @@
+#include "connectionmonitor.h"
+
+ConnectionMonitor::ConnectionMonitor(QObject *parent)
+    : QObject{parent}
+{
+    adultPads = false;
+    childPads = false;
+    batteryConnected = true; //default battery inserted
+    changeCount = 0;
+}
+
+bool ConnectionMonitor::isPadsAttached()
+{
+    return adultPads || childPads;
+}
+
+bool ConnectionMonitor::isAdultPads()
+{
+    return adultPads;
+}
+
+bool ConnectionMonitor::isChildPads()
+{
+    return childPads;
+}
+
+bool ConnectionMonitor::isBatteryConnected()
+{
+    return batteryConnected;
+}
+
+int ConnectionMonitor::getConnections()
+{
+    return (isPadsAttached() ? Pads : 0) | (batteryConnected ? Battery : 0);
+}
+
+int ConnectionMonitor::getChangeCount()
+{
+    return changeCount;
+}
+
+void ConnectionMonitor::setPads(bool adult, bool child)
+{
+    bool wasAttached = isPadsAttached();
+    adultPads = adult;
+    childPads = child;
+
+    // Swapping adult for child pads keeps the patient connected
+    if (wasAttached == isPadsAttached()) {
+        return;
+    }
+
+    changeCount++;
+    emit padsChanged(isPadsAttached());
+    emit connectionsChanged(getConnections());
+}
+
+void ConnectionMonitor::setBatteryConnected(bool connected)
+{
+    if (batteryConnected == connected) {
+        return;
+    }
+
+    batteryConnected = connected;
+    changeCount++;
+    emit batteryChanged(batteryConnected);
+    emit connectionsChanged(getConnections());
+}
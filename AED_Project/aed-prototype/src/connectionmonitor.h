@@ -0,0 +1,46 @@
+#ifndef CONNECTIONMONITOR_H
+#define CONNECTIONMONITOR_H
+
+#include <QObject>
+
+// Connection state of the pads and the battery.
+// Inputs are pushed in as they happen and only real changes are announced, once, through the
+// signals below, so whoever depends on a connection (the protocol, a front end) reacts in the same
+// call instead of polling for it.
+class ConnectionMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Bits of getConnections()
+    enum Connection {
+        Pads = 0x1,
+        Battery = 0x2
+    };
+
+    explicit ConnectionMonitor(QObject *parent = nullptr);
+
+    bool isPadsAttached();
+    bool isAdultPads();
+    bool isChildPads();
+    bool isBatteryConnected();
+    int getConnections();
+    int getChangeCount();       // announced changes since construction
+
+public slots:
+    void setPads(bool adult, bool child);
+    void setBatteryConnected(bool connected);
+
+signals:
+    void padsChanged(bool attached);
+    void batteryChanged(bool connected);
+    void connectionsChanged(int connections);   // after either of the above, with every bit
+
+private:
+    bool adultPads;
+    bool childPads;
+    bool batteryConnected;
+    int changeCount;
+};
+
+#endif // CONNECTIONMONITOR_H
@@ -0,0 +1,211 @@
+#include "cpranalyzer.h"
+#include <QElapsedTimer>
+
+namespace {
+
+// More than four compressions a second is not CPR
+const int MAX_COMPRESSIONS_PER_SECOND = 4;
+
+}
+
+CprAnalyzer::CprAnalyzer(int sampleRate, int windowMsec, int fractionWindowMsec)
+{
+    this->sampleRate = qMax(1, sampleRate);
+    this->windowMsec = qMax(1000, windowMsec);
+
+    compressing.resize(qMax(1, this->sampleRate * this->windowMsec / 1000));
+    active.resize(qMax(1, this->sampleRate * fractionWindowMsec / 1000));
+    compressions.resize(this->windowMsec / 1000 * MAX_COMPRESSIONS_PER_SECOND + 1);
+
+    reset();
+}
+
+int CprAnalyzer::getSampleRate()
+{
+    return sampleRate;
+}
+
+void CprAnalyzer::reset()
+{
+    compressing.fill(0);
+    compressingPos = 0;
+    compressingFilled = 0;
+    compressingCount = 0;
+    active.fill(0);
+    activePos = 0;
+    activeFilled = 0;
+    activeCount = 0;
+
+    first = 0;
+    count = 0;
+    peakSum = 0;
+    recoiledCount = 0;
+    newestJudged = false;
+
+    inCompression = false;
+    armed = true;
+    peakMm = 0;
+    peakMsec = 0;
+    releasedSinceLast = true;
+    lastPeakMsec = -PauseMsec;
+
+    stats = {};
+    totalNsec = 0;
+}
+
+bool CprAnalyzer::addSample(qint64 msec, float depthMm)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    bool completed = false;
+    if (!inCompression) {
+        if (depthMm < RecoilMm) {
+            releasedSinceLast = true;
+        }
+        if (depthMm < StartMm) {
+            armed = true;
+        }
+        else if (armed) {
+            armed = false;
+            inCompression = true;
+            peakMm = depthMm;
+            peakMsec = msec;
+
+            // The previous compression is judged on whether the chest came all the way back up
+            if (count > 0 && releasedSinceLast) {
+                compressions[(first + count - 1) % compressions.size()].recoiled = true;
+                recoiledCount++;
+            }
+            newestJudged = true;
+        }
+    }
+    else if (depthMm > peakMm) {
+        peakMm = depthMm;
+        peakMsec = msec;
+    }
+    else if (depthMm < peakMm * 0.5f) {
+        inCompression = false;
+        releasedSinceLast = depthMm < RecoilMm;
+
+        Compression compression;
+        compression.peakMsec = peakMsec;
+        compression.peakMm = peakMm;
+        compression.recoiled = false;
+        pushCompression(compression);
+        lastPeakMsec = peakMsec;
+
+        stats.compressions++;
+        stats.lastFeedbackMsec = msec - peakMsec;
+        completed = true;
+    }
+
+    expire(msec);
+    pushFlag(compressing, compressingPos, compressingFilled, compressingCount, inCompression);
+    pushFlag(active, activePos, activeFilled, activeCount, inCompression || msec - lastPeakMsec < PauseMsec);
+
+    qint64 nsec = timer.nsecsElapsed();
+    stats.samples++;
+    totalNsec += nsec;
+    stats.maxNsec = qMax(stats.maxNsec, nsec);
+    return completed;
+}
+
+CprAnalyzer::Quality CprAnalyzer::getQuality()
+{
+    Quality quality;
+    quality.compressions = count;
+    quality.rate = 0;
+    if (count > 1) {
+        qint64 span = compressions[(first + count - 1) % compressions.size()].peakMsec - compressions[first].peakMsec;
+        quality.rate = span > 0 ? (count - 1) * 60000.0 / span : 0;
+    }
+    quality.depthMm = count > 0 ? peakSum / count : 0;
+
+    // Until the next compression starts, the newest one may still recoil
+    int judged = newestJudged ? count : count - 1;
+    quality.recoil = judged > 0 ? double(recoiledCount) / judged : 0;
+    quality.dutyCycle = compressingFilled > 0 ? double(compressingCount) / compressingFilled : 0;
+    quality.cprFraction = activeFilled > 0 ? double(activeCount) / activeFilled : 0;
+    return quality;
+}
+
+CprAnalyzer::Feedback CprAnalyzer::getFeedback()
+{
+    // Nothing felt through the pads is as shallow as it gets
+    double depth = count > 0 ? peakSum / count : 0;
+    if (depth < DepthLowMm) {
+        return PushHarder;
+    }
+    if (depth > DepthHighMm) {
+        return PushGently;
+    }
+    return MaintainDepth;
+}
+
+CprAnalyzer::Stats CprAnalyzer::getStats()
+{
+    Stats result = stats;
+    result.meanNsec = stats.samples > 0 ? double(totalNsec) / stats.samples : 0;
+    return result;
+}
+
+QString CprAnalyzer::qualityText(const Quality &quality)
+{
+    return QString("%1/min, %2 mm, %3% recoil, %4% duty, %5% CPR fraction")
+        .arg(quality.rate, 0, 'f', 0)
+        .arg(quality.depthMm, 0, 'f', 0)
+        .arg(quality.recoil * 100, 0, 'f', 0)
+        .arg(quality.dutyCycle * 100, 0, 'f', 0)
+        .arg(quality.cprFraction * 100, 0, 'f', 0);
+}
+
+QString CprAnalyzer::statsText(const Stats &stats)
+{
+    return QString("%1 samples, %2 compressions, %3 ns mean / %4 ns max per sample, feedback %5 ms after the peak")
+        .arg(stats.samples)
+        .arg(stats.compressions)
+        .arg(stats.meanNsec, 0, 'f', 0)
+        .arg(stats.maxNsec)
+        .arg(stats.lastFeedbackMsec);
+}
+
+void CprAnalyzer::pushCompression(const Compression &compression)
+{
+    // Full only at an impossible rate; the oldest one makes room
+    if (count == compressions.size()) {
+        peakSum -= compressions[first].peakMm;
+        recoiledCount -= compressions[first].recoiled ? 1 : 0;
+        first = (first + 1) % compressions.size();
+        count--;
+    }
+
+    compressions[(first + count) % compressions.size()] = compression;
+    count++;
+    newestJudged = false;
+    peakSum += compression.peakMm;
+}
+
+void CprAnalyzer::expire(qint64 msec)
+{
+    // Each compression leaves once, so this is constant time per sample on average
+    while (count > 0 && msec - compressions[first].peakMsec > windowMsec) {
+        peakSum -= compressions[first].peakMm;
+        recoiledCount -= compressions[first].recoiled ? 1 : 0;
+        first = (first + 1) % compressions.size();
+        count--;
+    }
+}
+
+void CprAnalyzer::pushFlag(QVector<char> &ring, int &pos, int &filled, int &sum, bool flag)
+{
+    if (filled == ring.size()) {
+        sum -= ring[pos];
+    }
+    else {
+        filled++;
+    }
+    ring[pos] = flag ? 1 : 0;
+    sum += ring[pos];
+    pos = (pos + 1) % ring.size();
+}
@@ -0,0 +1,109 @@
+#ifndef CPRANALYZER_H
+#define CPRANALYZER_H
+
+#include <QString>
+#include <QVector>
+
+// CPR quality from the chest displacement measured through the pads, sampled at a fixed rate.
+// Every sample goes into ring buffers with running sums, so rate, depth, recoil, duty cycle and CPR
+// fraction over their sliding windows are always current and a sample costs the same whatever the
+// window length. A compression is counted when the chest comes back up past half its peak depth;
+// that is also when the feedback can change, a quarter of a cycle after the peak.
+class CprAnalyzer
+{
+public:
+    enum Feedback {
+        PushHarder,
+        PushGently,
+        MaintainDepth
+    };
+
+    struct Quality {
+        int compressions;       // in the quality window
+        double rate;            // compressions per minute
+        double depthMm;         // mean peak depth
+        double recoil;          // share of compressions released fully before the next one
+        double dutyCycle;       // share of the time spent compressing
+        double cprFraction;     // share of the fraction window with compressions going on
+    };
+
+    struct Stats {
+        qint64 samples;
+        qint64 compressions;
+        double meanNsec;        // analysis cost per sample
+        qint64 maxNsec;
+        qint64 lastFeedbackMsec;    // from the peak of a compression to its assessment
+    };
+
+    // Depth band of the feedback prompts, in mm
+    static const int DepthLowMm = 40;
+    static const int DepthHighMm = 60;
+
+    explicit CprAnalyzer(int sampleRate = 100, int windowMsec = 5000, int fractionWindowMsec = 60000);
+
+    int getSampleRate();
+    void reset();
+
+    // Returns true when the sample completed a compression, i.e. the quality has just changed
+    bool addSample(qint64 msec, float depthMm);
+
+    Quality getQuality();
+    Feedback getFeedback();
+    Stats getStats();
+
+    static QString qualityText(const Quality &quality);
+    static QString statsText(const Stats &stats);
+
+private:
+    // A chest moving less than this is not being compressed, and counts as fully released below
+    // RecoilMm
+    static const int StartMm = 10;
+    static const int RecoilMm = 5;
+
+    // Without a compression for this long, CPR has paused
+    static const int PauseMsec = 2000;
+
+    struct Compression {
+        qint64 peakMsec;
+        float peakMm;
+        bool recoiled;
+    };
+
+    int sampleRate;
+    int windowMsec;
+
+    // Per-sample rings: compressing flags over the quality window, active flags over the fraction window
+    QVector<char> compressing;
+    int compressingPos;
+    int compressingFilled;
+    int compressingCount;
+    QVector<char> active;
+    int activePos;
+    int activeFilled;
+    int activeCount;
+
+    // Compressions over the quality window, oldest first
+    QVector<Compression> compressions;
+    int first;
+    int count;
+    double peakSum;
+    int recoiledCount;
+    bool newestJudged;          // the next compression has started, so the newest one's recoil is known
+
+    // Current stroke
+    bool inCompression;
+    bool armed;                 // came back up past StartMm since the last compression
+    float peakMm;
+    qint64 peakMsec;
+    bool releasedSinceLast;
+    qint64 lastPeakMsec;
+
+    Stats stats;
+    qint64 totalNsec;
+
+    void pushCompression(const Compression &compression);
+    void expire(qint64 msec);
+    static void pushFlag(QVector<char> &ring, int &pos, int &filled, int &sum, bool flag);
+};
+
+#endif // CPRANALYZER_H
@@ -0,0 +1,65 @@
+#include "deviceinputs.h"
+#include <QtGlobal>
+
+namespace {
+
+// Layout of the packed word, low bits first
+const int ADULT_PADS = 0;
+const int CHILD_PADS = 1;
+const int BATTERY = 2;
+const int SELF_TEST = 3;
+const int CPR_DEPTH = 8;        // 8 bits
+const int SEQUENCE = 32;        // 32 bits
+
+}
+
+DeviceInputs::DeviceInputs()
+{
+    Snapshot initial = {};
+    initial.batteryConnected = true; //default battery inserted
+    initial.selfTestPassed = true; //default self test passes
+    word.storeRelaxed(pack(initial));
+    wakeupPending.storeRelaxed(0);
+}
+
+DeviceInputs::Snapshot DeviceInputs::load() const
+{
+    return unpack(word.loadAcquire());
+}
+
+bool DeviceInputs::publish(Snapshot next)
+{
+    // Only the front end writes, so the sequence can simply follow the last store
+    next.sequence = unpack(word.loadRelaxed()).sequence + 1;
+    word.storeRelease(pack(next));
+    return wakeupPending.testAndSetOrdered(0, 1);
+}
+
+DeviceInputs::Snapshot DeviceInputs::take()
+{
+    // Cleared first: a publish racing with this read wakes the protocol again rather than being lost
+    wakeupPending.storeRelease(0);
+    return load();
+}
+
+quint64 DeviceInputs::pack(const Snapshot &snapshot)
+{
+    return (quint64(snapshot.adultPads) << ADULT_PADS)
+         | (quint64(snapshot.childPads) << CHILD_PADS)
+         | (quint64(snapshot.batteryConnected) << BATTERY)
+         | (quint64(snapshot.selfTestPassed) << SELF_TEST)
+         | (quint64(qBound(0, snapshot.cprDepth, 255)) << CPR_DEPTH)
+         | (quint64(snapshot.sequence) << SEQUENCE);
+}
+
+DeviceInputs::Snapshot DeviceInputs::unpack(quint64 word)
+{
+    Snapshot snapshot;
+    snapshot.adultPads = (word >> ADULT_PADS) & 1;
+    snapshot.childPads = (word >> CHILD_PADS) & 1;
+    snapshot.batteryConnected = (word >> BATTERY) & 1;
+    snapshot.selfTestPassed = (word >> SELF_TEST) & 1;
+    snapshot.cprDepth = int((word >> CPR_DEPTH) & 0xff);
+    snapshot.sequence = quint32(word >> SEQUENCE);
+    return snapshot;
+}
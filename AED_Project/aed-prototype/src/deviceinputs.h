@@ -0,0 +1,42 @@
+#ifndef DEVICEINPUTS_H
+#define DEVICEINPUTS_H
+
+#include <QAtomicInteger>
+
+// Level inputs of a device (pads, battery, self test, CPR depth) shared between a front end and a
+// protocol running on another thread.
+// A snapshot is packed into one 64-bit word: the front end publishes it with a single store and the
+// protocol reads it with a single load, so neither side ever waits for the other or sees half of an
+// update. Momentary inputs (buttons, rhythm selection) stay queued signals.
+class DeviceInputs
+{
+public:
+    struct Snapshot {
+        bool adultPads;
+        bool childPads;
+        bool batteryConnected;
+        bool selfTestPassed;
+        int cprDepth;           // mm, 0 to 255
+        quint32 sequence;       // bumped by every publish()
+    };
+
+    DeviceInputs();
+
+    Snapshot load() const;
+
+    // Front end: stores a new snapshot. Returns true when the protocol has read the previous one,
+    // i.e. when it needs a wake-up; until it calls take() further publishes coalesce.
+    bool publish(Snapshot next);
+
+    // Protocol: reads the latest snapshot and re-arms the wake-up
+    Snapshot take();
+
+private:
+    QAtomicInteger<quint64> word;
+    QAtomicInt wakeupPending;
+
+    static quint64 pack(const Snapshot &snapshot);
+    static Snapshot unpack(quint64 word);
+};
+
+#endif // DEVICEINPUTS_H
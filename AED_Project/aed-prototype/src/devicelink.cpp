@@ -0,0 +1,48 @@
+#include "devicelink.h"
+
+DeviceLink::DeviceLink(AED *aed)
+    : QObject{aed}
+{
+    // Direct connections: the entries are written on the thread that emits them
+    connect(aed, &AED::informUser, this, [this](QString text) { push(UpdateQueue::InformUser, 0, 0, text); }, Qt::DirectConnection);
+    connect(aed, &AED::voiceText, this, [this](QString text) { push(UpdateQueue::VoiceText, 0, 0, text); }, Qt::DirectConnection);
+    connect(aed, &AED::audio, this, [this](QString file) { push(UpdateQueue::Audio, 0, 0, file); }, Qt::DirectConnection);
+    connect(aed, &AED::updateElectrodeOverlay, this, [this](bool connected) { push(UpdateQueue::ElectrodeOverlay, connected); }, Qt::DirectConnection);
+    connect(aed, &AED::displayCprBar, this, [this](bool show) { push(UpdateQueue::CprBar, show); }, Qt::DirectConnection);
+    connect(aed, &AED::updateStatusIndicator, this, [this](bool ok) { push(UpdateQueue::StatusIndicator, ok); }, Qt::DirectConnection);
+    connect(aed, &AED::toggleElectrodeStates, this, [this](bool state) { push(UpdateQueue::ElectrodeStates, state); }, Qt::DirectConnection);
+    connect(aed, &AED::updateLight, this, [this](bool state, int light) { push(UpdateQueue::Light, state, light); }, Qt::DirectConnection);
+    connect(aed, &AED::shockButton, this, [this](bool enable) { push(UpdateQueue::ShockButton, enable); }, Qt::DirectConnection);
+    connect(aed, &AED::updateBatteryLevel, this, [this](int level) { push(UpdateQueue::BatteryLevel, level); }, Qt::DirectConnection);
+    connect(aed, &AED::updateBatteryPrediction, this, [this](int shocks, int minutes) { push(UpdateQueue::BatteryPrediction, shocks, minutes); }, Qt::DirectConnection);
+    connect(aed, &AED::updateShockCount, this, [this](int count) { push(UpdateQueue::ShockCount, count); }, Qt::DirectConnection);
+    connect(aed, &AED::updateElapsedTime, this, [this](int seconds) { push(UpdateQueue::ElapsedTime, seconds); }, Qt::DirectConnection);
+    connect(aed, &AED::rhythmDetected, this, [this](int rhythm) { push(UpdateQueue::RhythmDetected, rhythm); }, Qt::DirectConnection);
+    connect(aed, &AED::cprButton, this, [this](bool enable) { push(UpdateQueue::CprButton, enable); }, Qt::DirectConnection);
+    connect(aed, &AED::cprStateChanged, this, [this](bool active) { push(UpdateQueue::CprState, active); }, Qt::DirectConnection);
+    connect(aed, &AED::resetUI, this, [this]() { push(UpdateQueue::ResetUI); }, Qt::DirectConnection);
+    connect(aed, &AED::powerStateChanged, this, [this](bool on) { push(UpdateQueue::PowerState, on); }, Qt::DirectConnection);
+    connect(aed, &AED::stateChanged, this, [this](int state) { push(UpdateQueue::StateChanged, state); }, Qt::DirectConnection);
+    connect(aed, &AED::toggleRhythmOptions, this, [this](bool enable) { push(UpdateQueue::RhythmOptions, enable); }, Qt::DirectConnection);
+    connect(aed, &AED::ecgSamples, this, [this](QVector<float> samples) { push(UpdateQueue::EcgSamples, 0, 0, QString(), samples); }, Qt::DirectConnection);
+    connect(aed, &AED::ecgSampleRateChanged, this, [this](int hz) { push(UpdateQueue::EcgSampleRate, hz); }, Qt::DirectConnection);
+}
+
+UpdateQueue* DeviceLink::getQueue()
+{
+    return &queue;
+}
+
+void DeviceLink::push(UpdateQueue::Kind kind, int value, int arg, QString text, QVector<float> samples)
+{
+    UpdateQueue::Update update;
+    update.kind = kind;
+    update.value = value;
+    update.arg = arg;
+    update.text = text;
+    update.samples = samples;
+
+    if (queue.push(update) && queue.armWakeup()) {
+        emit updatesPending();
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef DEVICELINK_H
+#define DEVICELINK_H
+
+#include <QObject>
+#include "AED.h"
+#include "updatequeue.h"
+
+// Carries a device's outputs to a front end on another thread.
+// Created as a child of the AED, so it moves to the device thread with it. Every output signal is
+// turned into an UpdateQueue entry on the device thread, and updatesPending() is emitted once per
+// batch; the front end connects it with a queued connection and drains the queue on its own thread.
+// Nothing the front end does (painting, audio, a modal dialog) can hold the protocol up.
+class DeviceLink : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DeviceLink(AED *aed);
+
+    UpdateQueue* getQueue();
+
+signals:
+    void updatesPending();
+
+private:
+    UpdateQueue queue;
+
+    void push(UpdateQueue::Kind kind, int value = 0, int arg = 0, QString text = QString(),
+              QVector<float> samples = QVector<float>());
+};
+
+#endif // DEVICELINK_H
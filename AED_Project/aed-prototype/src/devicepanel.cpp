@@ -0,0 +1,279 @@
+#include "devicepanel.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QMouseEvent>
+
+namespace {
+
+// Layout of the face in the coordinates of the case artwork as laid out in mainwindow.ui
+const QSize DESIGN_SIZE(566, 663);
+const QRect SHOCK_BUTTON(220, 280, 131, 101);
+const QRect POWER_BUTTON(465, 558, 61, 46);
+const QRect STATUS_INDICATOR(54, 558, 100, 46);
+const QRect LIGHTS[DevicePanel::LightCount] = {
+    QRect(168, 247, 12, 12),
+    QRect(256, 142, 12, 12),
+    QRect(400, 295, 12, 12),
+    QRect(404, 403, 12, 12),
+    QRect(179, 409, 12, 12),
+    QRect(283, 317, 12, 12),
+};
+
+const char* STATUS_IMAGES[] = {
+    ":/indicators/statusOff.png",
+    ":/indicators/statusOk.png",
+    ":/indicators/statusNotOk.png",
+};
+
+// Largest rectangle with the image's aspect ratio centred in a box
+QRect fitted(QSize image, const QRect &box)
+{
+    if (image.isEmpty()) {
+        return box;
+    }
+    QSize size = image.scaled(box.size(), Qt::KeepAspectRatio);
+    return QRect(box.x() + (box.width() - size.width()) / 2, box.y() + (box.height() - size.height()) / 2,
+                 size.width(), size.height());
+}
+
+}
+
+DevicePanel::DevicePanel(QWidget *parent)
+    : QWidget{parent}
+{
+    assets = nullptr;
+    state = {};
+    state.status = StatusOff;
+
+    // Hover feedback on the power button
+    setMouseTracking(true);
+}
+
+void DevicePanel::setAssets(AssetAtlas* assets)
+{
+    this->assets = assets;
+    updateLayout();
+    update();
+}
+
+DevicePanel::VisualState DevicePanel::getVisualState()
+{
+    return state;
+}
+
+void DevicePanel::setVisualState(const VisualState &next)
+{
+    QRegion dirty = changedRegion(state, next);
+    state = next;
+    if (!dirty.isEmpty()) {
+        update(dirty);
+    }
+}
+
+QSize DevicePanel::sizeHint() const
+{
+    return DESIGN_SIZE;
+}
+
+void DevicePanel::setPowered(bool powered)
+{
+    VisualState next = state;
+    next.powered = powered;
+    setVisualState(next);
+}
+
+void DevicePanel::setPadsConnected(bool connected)
+{
+    VisualState next = state;
+    next.padsConnected = connected;
+    setVisualState(next);
+}
+
+void DevicePanel::setShockEnabled(bool enabled)
+{
+    VisualState next = state;
+    next.shockEnabled = enabled;
+    next.shockDown = next.shockDown && enabled;
+    setVisualState(next);
+}
+
+void DevicePanel::setStatus(int status)
+{
+    VisualState next = state;
+    next.status = Status(qBound(int(StatusOff), status, int(StatusNotOk)));
+    setVisualState(next);
+}
+
+void DevicePanel::setLight(bool on, int light)
+{
+    if (light < 1 || light > LightCount) {
+        return;
+    }
+
+    VisualState next = state;
+    if (on) {
+        next.lights |= 1 << (light - 1);
+    }
+    else {
+        next.lights &= ~(1 << (light - 1));
+    }
+    setVisualState(next);
+}
+
+void DevicePanel::reset()
+{
+    VisualState next = state;
+    next.powered = false;
+    next.shockEnabled = false;
+    next.shockDown = false;
+    next.status = StatusOff;
+    next.lights = 0;
+    setVisualState(next);
+}
+
+QRegion DevicePanel::changedRegion(const VisualState &from, const VisualState &to)
+{
+    // The case is the background of everything else
+    if (from.padsConnected != to.padsConnected) {
+        return QRegion(rect());
+    }
+
+    QRegion dirty;
+    if (from.powered != to.powered || from.powerHover != to.powerHover) {
+        dirty += powerRect;
+    }
+    if (from.shockEnabled != to.shockEnabled) {
+        // Light 6 sits on the shock button
+        dirty += shockRect;
+    }
+    if (from.status != to.status) {
+        dirty += statusRect;
+    }
+    int lights = from.lights ^ to.lights;
+    for (int i = 0; i < LightCount; i++) {
+        if (lights & (1 << i)) {
+            dirty += lightRects[i];
+        }
+    }
+    return dirty;
+}
+
+void DevicePanel::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+
+    // Qt clips to the region that needs repainting, so only the changed element costs anything
+    painter.drawPixmap(rect(), state.padsConnected ? caseWithPads : caseWithoutPads);
+
+    painter.setOpacity(state.shockEnabled ? 1.0 : 0.6);
+    painter.drawPixmap(shockRect, shockButton);
+    painter.setOpacity(1.0);
+
+    bool lit = state.powered != state.powerHover;
+    painter.drawPixmap(powerRect, lit ? powerOn : powerOff);
+
+    painter.drawPixmap(statusRect, statusImages[state.status]);
+
+    for (int i = 0; i < LightCount; i++) {
+        painter.drawPixmap(lightRects[i], (state.lights & (1 << i)) ? lightOn : lightOff);
+    }
+}
+
+void DevicePanel::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    updateLayout();
+}
+
+void DevicePanel::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton) {
+        return;
+    }
+
+    VisualState next = state;
+    if (powerRect.contains(event->pos())) {
+        next.powerDown = true;
+        setVisualState(next);
+        emit powerPressed();
+    }
+    else if (state.shockEnabled && shockRect.contains(event->pos())) {
+        next.shockDown = true;
+        setVisualState(next);
+    }
+}
+
+void DevicePanel::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton) {
+        return;
+    }
+
+    VisualState next = state;
+    if (state.powerDown) {
+        // Like a push button, the release counts wherever the mouse ends up
+        next.powerDown = false;
+        setVisualState(next);
+        emit powerReleased();
+    }
+    else if (state.shockDown) {
+        next.shockDown = false;
+        setVisualState(next);
+        if (shockRect.contains(event->pos())) {
+            emit shockClicked();
+        }
+    }
+}
+
+void DevicePanel::mouseMoveEvent(QMouseEvent *event)
+{
+    VisualState next = state;
+    next.powerHover = powerRect.contains(event->pos());
+    setVisualState(next);
+}
+
+void DevicePanel::leaveEvent(QEvent *event)
+{
+    Q_UNUSED(event);
+    VisualState next = state;
+    next.powerHover = false;
+    setVisualState(next);
+}
+
+QRect DevicePanel::fromDesign(const QRect &design)
+{
+    double sx = double(width()) / DESIGN_SIZE.width();
+    double sy = double(height()) / DESIGN_SIZE.height();
+    return QRect(qRound(design.x() * sx), qRound(design.y() * sy),
+                 qMax(1, qRound(design.width() * sx)), qMax(1, qRound(design.height() * sy)));
+}
+
+void DevicePanel::updateLayout()
+{
+    shockRect = fromDesign(SHOCK_BUTTON);
+    powerRect = fromDesign(POWER_BUTTON);
+    statusRect = fromDesign(STATUS_INDICATOR);
+    for (int i = 0; i < LightCount; i++) {
+        lightRects[i] = fromDesign(LIGHTS[i]);
+    }
+    if (assets == nullptr) {
+        return;
+    }
+
+    // The buttons keep their aspect ratio inside their area, the rest is stretched to fit
+    shockRect = fitted(assets->pixmap(":/buttons/shockButton.png").size(), shockRect);
+    powerRect = fitted(assets->pixmap(":/buttons/powerButton.png").size(), powerRect);
+
+    caseWithPads = assets->pixmap(":/overlay/aed.png", size());
+    caseWithoutPads = assets->pixmap(":/overlay/aedNoElectrode.png", size());
+    shockButton = assets->pixmap(":/buttons/shockButton.png", shockRect.size());
+    powerOn = assets->pixmap(":/buttons/powerbuttonON.png", powerRect.size());
+    powerOff = assets->pixmap(":/buttons/powerButton.png", powerRect.size());
+    for (int i = 0; i < 3; i++) {
+        statusImages[i] = assets->pixmap(STATUS_IMAGES[i], statusRect.size());
+    }
+    lightOn = assets->pixmap(":/indicators/lightOn.png", lightRects[0].size());
+    lightOff = assets->pixmap(":/indicators/lightOff.png", lightRects[0].size());
+}
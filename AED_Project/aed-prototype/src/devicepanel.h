@@ -0,0 +1,90 @@
+#ifndef DEVICEPANEL_H
+#define DEVICEPANEL_H
+
+#include <QWidget>
+#include <QPixmap>
+#include <QRect>
+#include <QRegion>
+#include "assetatlas.h"
+
+// Face of the AED: the case with or without pads, the shock and power buttons, the status indicator
+// and the six step lights, all painted by this one widget.
+// Everything it shows is described by a VisualState. Setters compare the new state with the old one
+// and only repaint the parts that changed; nothing is styled, so a change never re-polishes a widget.
+class DevicePanel : public QWidget
+{
+    Q_OBJECT
+
+public:
+    enum Status {
+        StatusOff,
+        StatusOk,
+        StatusNotOk
+    };
+
+    struct VisualState {
+        bool powered;           // power button lit
+        bool padsConnected;     // case shown with the pads attached
+        bool shockEnabled;
+        Status status;
+        int lights;             // bit n - 1 set while light n is on
+        bool powerHover;        // the power button shows the opposite state under the mouse
+        bool powerDown;         // pressed, waiting for the release
+        bool shockDown;
+    };
+
+    static const int LightCount = 6;
+
+    explicit DevicePanel(QWidget *parent = nullptr);
+
+    void setAssets(AssetAtlas* assets);     // not owned
+    VisualState getVisualState();
+    void setVisualState(const VisualState &next);
+
+    QSize sizeHint() const override;
+
+public slots:
+    void setPowered(bool powered);
+    void setPadsConnected(bool connected);
+    void setShockEnabled(bool enabled);
+    void setStatus(int status);
+    void setLight(bool on, int light);
+    void reset();               // everything off, as after power down
+
+signals:
+    void powerPressed();
+    void powerReleased();
+    void shockClicked();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void leaveEvent(QEvent *event) override;
+
+private:
+    AssetAtlas* assets;
+    VisualState state;
+
+    // Layout and pixmaps for the current size, rebuilt on resize
+    QRect shockRect;
+    QRect powerRect;
+    QRect statusRect;
+    QRect lightRects[LightCount];
+    QPixmap caseWithPads;
+    QPixmap caseWithoutPads;
+    QPixmap shockButton;
+    QPixmap powerOn;
+    QPixmap powerOff;
+    QPixmap statusImages[3];
+    QPixmap lightOn;
+    QPixmap lightOff;
+
+    void updateLayout();
+    QRect fromDesign(const QRect &design);
+    QRegion changedRegion(const VisualState &from, const VisualState &to);
+};
+
+#endif // DEVICEPANEL_H
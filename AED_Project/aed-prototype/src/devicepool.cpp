@@ -0,0 +1,117 @@
+#include "devicepool.h"
+#include <QFile>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+DevicePool::DevicePool(int threads, QObject *parent)
+    : QObject{parent}
+{
+    nextWorker = 0;
+
+    for (int i = 0; i < qMax(1, threads); i++) {
+        QThread* worker = new QThread(this);
+        worker->setObjectName(QString("aed-worker-%1").arg(i));
+        worker->start();
+        workers.append(worker);
+    }
+}
+
+DevicePool::~DevicePool()
+{
+    // Devices are deleted on their own workers, as QObjects with timers must be: each worker that
+    // stop() ended runs once more to finish again
+    for (int i = 0; i < devices.size(); i++) {
+        if (devices[i]->thread() == deviceWorkers[i]) {
+            connect(deviceWorkers[i], &QThread::finished, devices[i], &QObject::deleteLater);
+        }
+        else {
+            // Never started, so still on this thread
+            delete devices[i];
+        }
+    }
+    for (QThread* worker : workers) {
+        if (!worker->isRunning()) {
+            worker->start();
+        }
+    }
+    stop();
+}
+
+AED* DevicePool::createDevice()
+{
+    AED* device = new AED;
+    devices.append(device);
+    deviceWorkers.append(workers[nextWorker]);
+    nextWorker = (nextWorker + 1) % workers.size();
+    return device;
+}
+
+void DevicePool::attach(QObject* object, AED* device)
+{
+    helpers.append(object);
+    helperWorkers.append(deviceWorkers[devices.indexOf(device)]);
+}
+
+void DevicePool::start()
+{
+    // Timers can only be started on their own thread, so objects are moved once fully configured
+    for (int i = 0; i < devices.size(); i++) {
+        devices[i]->moveToThread(deviceWorkers[i]);
+    }
+    for (int i = 0; i < helpers.size(); i++) {
+        helpers[i]->moveToThread(helperWorkers[i]);
+    }
+}
+
+void DevicePool::stop()
+{
+    for (QThread* worker : workers) {
+        worker->quit();
+        worker->wait();
+    }
+}
+
+QList<AED*> DevicePool::getDevices()
+{
+    return devices;
+}
+
+QList<QThread*> DevicePool::getWorkers()
+{
+    return workers;
+}
+
+int DevicePool::getThreadCount()
+{
+    return workers.size();
+}
+
+qint64 DevicePool::residentBytes()
+{
+#ifdef Q_OS_LINUX
+    // Second field of statm is the resident set size in pages
+    QFile statm("/proc/self/statm");
+    if (statm.open(QIODevice::ReadOnly)) {
+        QList<QByteArray> fields = statm.readAll().split(' ');
+        if (fields.size() > 1) {
+            return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+        }
+    }
+#endif
+    return 0;
+}
+
+double DevicePool::cpuSeconds()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+             + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    }
+#endif
+    return 0;
+}
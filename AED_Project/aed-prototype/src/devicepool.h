@@ -0,0 +1,51 @@
+#ifndef DEVICEPOOL_H
+#define DEVICEPOOL_H
+
+#include <QObject>
+#include <QList>
+#include <QThread>
+#include "AED.h"
+
+// Hosts many independent AED devices in one process.
+// Devices are spread round-robin over a fixed set of worker threads; each device and all of its
+// timers live on its worker thread, so sessions only talk to it through queued connections.
+class DevicePool : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DevicePool(int threads = QThread::idealThreadCount(), QObject *parent = nullptr);
+    ~DevicePool();
+
+    // Creates a device on the calling thread and assigns it the next worker round-robin.
+    // Configure it (clock mode, inputs) before start().
+    AED* createDevice();
+
+    // Runs a helper object (e.g. a session driver) on the same worker as a device
+    void attach(QObject* object, AED* device);
+
+    // Moves every device and attached object onto its worker thread
+    void start();
+
+    // Stops the workers; the devices stay until the pool is deleted, so their state can be read.
+    // Deleting the pool deletes each device on its worker.
+    void stop();
+
+    QList<AED*> getDevices();
+    QList<QThread*> getWorkers();
+    int getThreadCount();
+
+    // Process-wide cost figures used to report per-instance overhead
+    static qint64 residentBytes();
+    static double cpuSeconds();
+
+private:
+    QList<QThread*> workers;
+    QList<AED*> devices;
+    QList<QThread*> deviceWorkers;
+    QList<QObject*> helpers;
+    QList<QThread*> helperWorkers;
+    int nextWorker;
+};
+
+#endif // DEVICEPOOL_H
@@ -0,0 +1,325 @@
+#include "ecggenerator.h"
+#include <QtMath>
+#include <cstring>
+
+namespace {
+
+// One deflection of a beat, as a Gaussian bump around the R peak
+struct Wave {
+    double offset;      // seconds from the R peak at 60 bpm
+    double width;       // standard deviation in seconds
+    double height;      // relative to the R wave
+};
+
+// P, Q, R, S, T
+const Wave SINUS_BEAT[] = {
+    { -0.160, 0.025,  0.15 },
+    { -0.030, 0.008, -0.10 },
+    {  0.000, 0.010,  1.00 },
+    {  0.030, 0.010, -0.25 },
+    {  0.280, 0.060,  0.30 },
+};
+
+// Organised but weak activity: slow, broad complexes with a flattened T wave
+const Wave PEA_BEAT[] = {
+    { -0.180, 0.030,  0.10 },
+    {  0.000, 0.025,  1.00 },
+    {  0.060, 0.025, -0.30 },
+    {  0.320, 0.080,  0.15 },
+};
+
+// Wide monomorphic complexes without P waves
+const Wave VT_BEAT[] = {
+    {  0.000, 0.040,  1.00 },
+    {  0.080, 0.040, -0.60 },
+    {  0.200, 0.050, -0.30 },
+};
+
+// Lead gains relative to lead II, in output order II, I, III (III = II - I)
+const float LEAD_GAIN[EcgGenerator::MaxLeads] = { 1.0f, 0.6f, 0.4f };
+
+// VF is rendered over a fixed period; its frequencies are rounded to multiples of 1 / period
+const double FIBRILLATION_PERIOD = 8.0;
+const double WANDER_PERIOD = 4.0;
+
+double defaultRate(AED::Rhythm rhythm)
+{
+    switch (rhythm) {
+    case AED::VF:       return 300.0;   // ~5 Hz fibrillation
+    case AED::VT:       return 180.0;
+    case AED::PEA:      return 45.0;
+    case AED::Regular:  return 75.0;
+    default:            return 60.0;
+    }
+}
+
+double defaultAmplitude(AED::Rhythm rhythm)
+{
+    switch (rhythm) {
+    case AED::VF:       return 0.4;
+    case AED::VT:       return 1.5;
+    case AED::PEA:      return 0.6;
+    case AED::Regular:  return 1.0;
+    default:            return 0.0;
+    }
+}
+
+}
+
+EcgGenerator::EcgGenerator(int sampleRate, int leads)
+    : random(1)
+{
+    this->sampleRate = qMax(1, sampleRate);
+    leadCount = qBound(1, leads, int(MaxLeads));
+    rhythm = AED::NoRhythm;
+    amplitude = 0;
+    rate = 0;
+    noise = 0;
+    tablePos = 0;
+    wanderPos = 0;
+    position = 0;
+
+    block.resize(BlockFrames);
+    wanderBlock.resize(BlockFrames);
+    randomBlock.resize(BlockFrames);
+    rebuild();
+}
+
+void EcgGenerator::setSampleRate(int hz)
+{
+    sampleRate = qMax(1, hz);
+    rebuild();
+}
+
+int EcgGenerator::getSampleRate()
+{
+    return sampleRate;
+}
+
+void EcgGenerator::setLeadCount(int leads)
+{
+    leadCount = qBound(1, leads, int(MaxLeads));
+}
+
+int EcgGenerator::getLeadCount()
+{
+    return leadCount;
+}
+
+void EcgGenerator::setRhythm(AED::Rhythm rhythm)
+{
+    this->rhythm = rhythm;
+    rebuild();
+}
+
+AED::Rhythm EcgGenerator::getRhythm()
+{
+    return rhythm;
+}
+
+void EcgGenerator::setAmplitude(double millivolts)
+{
+    amplitude = qMax(0.0, millivolts);
+}
+
+void EcgGenerator::setRate(double bpm)
+{
+    rate = qMax(0.0, bpm);
+    rebuild();
+}
+
+void EcgGenerator::setNoise(double millivolts)
+{
+    noise = qMax(0.0, millivolts);
+}
+
+void EcgGenerator::setSeed(quint32 seed)
+{
+    random.seed(seed);
+}
+
+qint64 EcgGenerator::getPosition()
+{
+    return position;
+}
+
+void EcgGenerator::reset()
+{
+    tablePos = 0;
+    wanderPos = 0;
+    position = 0;
+}
+
+void EcgGenerator::generate(float* samples, int frames)
+{
+    float gain = float(amplitude > 0 ? amplitude : defaultAmplitude(rhythm));
+    float wanderGain = float(2.0 * noise);
+    // A uniform value in [-0.5, 0.5) has an RMS of 1 / sqrt(12)
+    float noiseGain = float(noise * qSqrt(12.0));
+    const float toUnit = 1.0f / 4294967296.0f;
+
+    float* wanderBlock = wanderGain > 0 ? this->wanderBlock.data() : nullptr;
+
+    for (int done = 0; done < frames; done += BlockFrames) {
+        int n = qMin(int(BlockFrames), frames - done);
+        float* beat = block.data();
+
+        copyPeriodic(table, tablePos, beat, n);
+        if (wanderBlock != nullptr) {
+            copyPeriodic(wander, wanderPos, wanderBlock, n);
+        }
+
+        for (int lead = 0; lead < leadCount; lead++) {
+            float* out = samples + qint64(lead) * frames + done;
+            float leadGain = gain * LEAD_GAIN[lead];
+
+            for (int i = 0; i < n; i++) {
+                out[i] = leadGain * beat[i];
+            }
+
+            if (wanderBlock != nullptr) {
+                for (int i = 0; i < n; i++) {
+                    out[i] += wanderGain * wanderBlock[i];
+                }
+            }
+
+            if (noiseGain > 0) {
+                quint32* bits = randomBlock.data();
+                random.fillRange(bits, n);
+                for (int i = 0; i < n; i++) {
+                    out[i] += noiseGain * (float(bits[i]) * toUnit - 0.5f);
+                }
+            }
+        }
+    }
+
+    position += frames;
+}
+
+void EcgGenerator::readSamples(float* samples, int frames)
+{
+    int leads = leadCount;
+    leadCount = 1;
+    generate(samples, frames);
+    leadCount = leads;
+}
+
+void EcgGenerator::copyPeriodic(const QVector<float> &source, int &pos, float* out, int frames)
+{
+    const float* data = source.constData();
+    int length = source.size();
+
+    while (frames > 0) {
+        int run = qMin(frames, length - pos);
+        std::memcpy(out, data + pos, size_t(run) * sizeof(float));
+        out += run;
+        frames -= run;
+        pos += run;
+        if (pos == length) {
+            pos = 0;
+        }
+    }
+}
+
+void EcgGenerator::rebuild()
+{
+    double bpm = rate > 0 ? rate : defaultRate(rhythm);
+
+    if (rhythm == AED::VF) {
+        renderFibrillation(bpm);
+    }
+    else if (rhythm == AED::VT || rhythm == AED::PEA || rhythm == AED::Regular) {
+        renderBeat(bpm);
+    }
+    else {
+        // Asystole and no rhythm: a flat line, only noise and wander remain
+        table.fill(0.0f, sampleRate);
+    }
+
+    int wanderLength = int(WANDER_PERIOD * sampleRate);
+    wander.resize(wanderLength);
+    for (int i = 0; i < wanderLength; i++) {
+        double t = double(i) / wanderLength;
+        wander[i] = float(qSin(2 * M_PI * t) + 0.3 * qSin(4 * M_PI * t + 1.0));
+    }
+
+    tablePos = 0;
+    wanderPos = 0;
+}
+
+void EcgGenerator::renderBeat(double bpm)
+{
+    const Wave* waves;
+    int waveCount;
+    if (rhythm == AED::VT) {
+        waves = VT_BEAT;
+        waveCount = sizeof(VT_BEAT) / sizeof(VT_BEAT[0]);
+    }
+    else if (rhythm == AED::PEA) {
+        waves = PEA_BEAT;
+        waveCount = sizeof(PEA_BEAT) / sizeof(PEA_BEAT[0]);
+    }
+    else {
+        waves = SINUS_BEAT;
+        waveCount = sizeof(SINUS_BEAT) / sizeof(SINUS_BEAT[0]);
+    }
+
+    double rr = 60.0 / bpm;
+    int length = qMax(1, int(rr * sampleRate + 0.5));
+    rr = double(length) / sampleRate;
+
+    // Intervals shorten with the square root of the RR interval (Bazett)
+    double stretch = qSqrt(rr);
+    double peak = 0.4 * rr;
+
+    table.resize(length);
+    float largest = 0;
+    for (int i = 0; i < length; i++) {
+        double t = double(i) / sampleRate;
+        double v = 0;
+        for (int w = 0; w < waveCount; w++) {
+            double centre = peak + waves[w].offset * stretch;
+            // Neighbouring beats, so a wave crossing the table edge wraps around
+            for (int k = -1; k <= 1; k++) {
+                double d = (t - centre + k * rr) / waves[w].width;
+                v += waves[w].height * qExp(-0.5 * d * d);
+            }
+        }
+        table[i] = float(v);
+        largest = qMax(largest, qAbs(table[i]));
+    }
+
+    for (int i = 0; i < length && largest > 0; i++) {
+        table[i] /= largest;
+    }
+}
+
+void EcgGenerator::renderFibrillation(double bpm)
+{
+    double quantum = 1.0 / FIBRILLATION_PERIOD;
+    double base = bpm / 60.0;
+
+    // A few incommensurate-looking oscillations under a slow envelope give the coarse, irregular look
+    const double ratios[] = { 1.0, 1.31, 0.73 };
+    const double weights[] = { 1.0, 0.6, 0.5 };
+    const double phases[] = { 0.0, 1.7, 4.1 };
+
+    int length = int(FIBRILLATION_PERIOD * sampleRate);
+    table.resize(length);
+    float largest = 0;
+    for (int i = 0; i < length; i++) {
+        double t = double(i) / sampleRate;
+        double v = 0;
+        for (int c = 0; c < 3; c++) {
+            double f = qMax(quantum, qRound(base * ratios[c] / quantum) * quantum);
+            v += weights[c] * qSin(2 * M_PI * f * t + phases[c]);
+        }
+        v *= 1.0 + 0.4 * qSin(2 * M_PI * 2 * quantum * t);
+        table[i] = float(v);
+        largest = qMax(largest, qAbs(table[i]));
+    }
+
+    for (int i = 0; i < length && largest > 0; i++) {
+        table[i] /= largest;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef ECGGENERATOR_H
+#define ECGGENERATOR_H
+
+#include <QVector>
+#include <QRandomGenerator>
+#include "AED.h"
+#include "ecgsource.h"
+
+// Synthetic ECG source for the rhythm classes the trainer can select.
+// Each rhythm is rendered once into a wave table (one beat for organised rhythms, an 8 second
+// period for VF); generate() then only copies from the table, scales it per lead and adds noise.
+// All inner loops run over contiguous float blocks so the compiler can vectorise them.
+//
+// Samples are in millivolts. Up to three limb leads (I, II, III) are produced; lead II carries the
+// nominal amplitude and III = II - I.
+class EcgGenerator : public EcgSource
+{
+public:
+    static const int MaxLeads = 3;
+
+    explicit EcgGenerator(int sampleRate = 250, int leads = 1);
+
+    void setSampleRate(int hz);             // typically 250, 500 or 1000
+    int getSampleRate() override;
+    void setLeadCount(int leads);
+    int getLeadCount();
+    void setRhythm(AED::Rhythm rhythm);
+    AED::Rhythm getRhythm();
+    void setAmplitude(double millivolts);   // peak amplitude of lead II, 0 for the rhythm default
+    void setRate(double bpm);               // beats (VF: dominant oscillations) per minute, 0 for the rhythm default
+    void setNoise(double millivolts);       // RMS of the added noise, baseline wander is twice that
+    void setSeed(quint32 seed);
+
+    // Writes `frames` samples per lead, planar: lead l starts at samples + l * frames
+    void generate(float* samples, int frames);
+
+    // Lead II only
+    void readSamples(float* samples, int frames) override;
+
+    qint64 getPosition();                   // frames generated since the last reset
+    void reset();
+
+private:
+    static const int BlockFrames = 1024;
+
+    int sampleRate;
+    int leadCount;
+    AED::Rhythm rhythm;
+    double amplitude;
+    double rate;
+    double noise;
+
+    QVector<float> table;                   // one period of the current rhythm, lead II, unit amplitude
+    QVector<float> wander;                  // one period of baseline wander, unit amplitude
+    int tablePos;
+    int wanderPos;
+    qint64 position;
+
+    QRandomGenerator random;
+    QVector<float> block;
+    QVector<float> wanderBlock;
+    QVector<quint32> randomBlock;
+
+    void rebuild();
+    void renderBeat(double bpm);
+    void renderFibrillation(double bpm);
+    void copyPeriodic(const QVector<float> &source, int &pos, float* out, int frames);
+};
+
+#endif // ECGGENERATOR_H
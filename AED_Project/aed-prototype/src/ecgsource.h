@@ -0,0 +1,17 @@
+#ifndef ECGSOURCE_H
+#define ECGSOURCE_H
+
+// Anything that can feed the signal seen through the pads: the synthetic generator or a recording.
+// The AED pulls samples from its source on the device clock.
+class EcgSource
+{
+public:
+    virtual ~EcgSource() {}
+
+    virtual int getSampleRate() = 0;
+
+    // Writes the next `frames` samples of the monitoring lead, in millivolts
+    virtual void readSamples(float* samples, int frames) = 0;
+};
+
+#endif // ECGSOURCE_H
@@ -0,0 +1,216 @@
+#include "ecgtracewidget.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <algorithm>
+
+EcgTraceWidget::EcgTraceWidget(QWidget *parent)
+    : QWidget{parent}
+{
+    sampleRate = 500;
+    sweepSeconds = 4.0;
+    range = 2.0;
+    written = 0;
+    drawn = 0;
+    sweepSample = 0;
+    hasLastPoint = false;
+
+    // Two seconds of headroom if frames are late
+    ring.resize(sampleRate * 2);
+
+    paintNsec.resize(StatsWindow);
+    frameStartNsec.resize(StatsWindow);
+    dirtyWidth.resize(StatsWindow);
+    statsIndex = 0;
+    statsCount = 0;
+
+    frameClock.start();
+    frameTimer = new QTimer(this);
+    frameTimer->setTimerType(Qt::PreciseTimer);
+    connect(frameTimer, &QTimer::timeout, this, &EcgTraceWidget::onFrame);
+    frameTimer->start(16);
+}
+
+void EcgTraceWidget::setSampleRate(int hz)
+{
+    sampleRate = qMax(1, hz);
+    ring.fill(0.0f, sampleRate * 2);
+    clear();
+}
+
+void EcgTraceWidget::setSweepSeconds(double seconds)
+{
+    sweepSeconds = qMax(0.5, seconds);
+    clear();
+}
+
+void EcgTraceWidget::setRange(double millivolts)
+{
+    range = qMax(0.1, millivolts);
+    clear();
+}
+
+void EcgTraceWidget::appendSamples(QVector<float> samples)
+{
+    int size = ring.size();
+    for (float sample : samples) {
+        ring[written % size] = sample;
+        written++;
+    }
+}
+
+void EcgTraceWidget::clear()
+{
+    drawn = written;
+    resetCanvas();
+    update();
+}
+
+int EcgTraceWidget::samplesPerSweep()
+{
+    return qMax(1, int(sweepSeconds * sampleRate));
+}
+
+void EcgTraceWidget::resetCanvas()
+{
+    canvas = QPixmap(size());
+    canvas.fill(Qt::transparent);
+    sweepSample = 0;
+    hasLastPoint = false;
+}
+
+void EcgTraceWidget::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    resetCanvas();
+}
+
+void EcgTraceWidget::onFrame()
+{
+    // Nothing new: no repaint at all
+    if (drawn == written || canvas.isNull()) {
+        return;
+    }
+
+    // Frames were skipped for longer than the ring holds: drop the oldest samples
+    if (written - drawn > ring.size()) {
+        drawn = written - ring.size();
+    }
+
+    int width = canvas.width();
+    int height = canvas.height();
+    double xScale = double(width) / samplesPerSweep();
+    double yScale = (height / 2.0) / range;
+    double yMid = height / 2.0;
+
+    QPainter painter(&canvas);
+    painter.setPen(QPen(QColor(40, 200, 40), 2));
+
+    QRegion dirty;
+    QVector<QPointF> points;
+
+    while (drawn < written) {
+        points.clear();
+        if (hasLastPoint) {
+            points.append(lastPoint);
+        }
+
+        // One polyline per pass; a pass ends at the right edge
+        while (drawn < written && sweepSample < samplesPerSweep()) {
+            float v = ring[drawn % ring.size()];
+            double y = qBound(0.0, yMid - v * yScale, double(height - 1));
+            points.append(QPointF(sweepSample * xScale, y));
+            drawn++;
+            sweepSample++;
+        }
+
+        if (!points.isEmpty()) {
+            int left = int(points.first().x());
+            int right = int(points.last().x());
+
+            // Erase the strip the pen is about to cover, continuing at the left edge where the gap
+            // runs past the right one so the next sweep starts on a clear canvas
+            QRect erase(left + 1, 0, right - left + EraseGap, height);
+            QRect wrapped(0, 0, right + EraseGap - width + 1, height);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            painter.fillRect(erase, Qt::transparent);
+            if (wrapped.width() > 0) {
+                painter.fillRect(wrapped, Qt::transparent);
+                dirty += wrapped;
+            }
+            painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+
+            painter.drawPolyline(points.constData(), points.size());
+            lastPoint = points.last();
+            hasLastPoint = true;
+            dirty += erase.adjusted(-2, 0, 2, 0);
+        }
+
+        if (sweepSample >= samplesPerSweep()) {
+            sweepSample = 0;
+            hasLastPoint = false;
+        }
+    }
+
+    painter.end();
+
+    update(dirty);
+}
+
+void EcgTraceWidget::paintEvent(QPaintEvent *event)
+{
+    qint64 start = frameClock.nsecsElapsed();
+
+    QPainter painter(this);
+    painter.drawPixmap(event->rect(), canvas, event->rect());
+    painter.end();
+
+    frameStartNsec[statsIndex] = start;
+    paintNsec[statsIndex] = frameClock.nsecsElapsed() - start;
+    dirtyWidth[statsIndex] = event->rect().width();
+    statsIndex = (statsIndex + 1) % StatsWindow;
+    statsCount = qMin(statsCount + 1, int(StatsWindow));
+}
+
+EcgTraceWidget::FrameStats EcgTraceWidget::getFrameStats()
+{
+    FrameStats stats = {};
+    stats.frames = statsCount;
+    if (statsCount == 0) {
+        return stats;
+    }
+
+    QVector<qint64> sorted;
+    qint64 total = 0;
+    qint64 widths = 0;
+    qint64 first = -1;
+    qint64 last = -1;
+    for (int i = 0; i < statsCount; i++) {
+        sorted.append(paintNsec[i]);
+        total += paintNsec[i];
+        widths += dirtyWidth[i];
+        first = (first < 0) ? frameStartNsec[i] : qMin(first, frameStartNsec[i]);
+        last = qMax(last, frameStartNsec[i]);
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    stats.meanPaintMsec = total / 1e6 / statsCount;
+    stats.p95PaintMsec = sorted[qMin(statsCount - 1, int(statsCount * 0.95))] / 1e6;
+    stats.maxPaintMsec = sorted.last() / 1e6;
+    stats.meanDirtyWidth = double(widths) / statsCount;
+    if (statsCount > 1 && last > first) {
+        stats.fps = (statsCount - 1) * 1e9 / (last - first);
+    }
+    return stats;
+}
+
+QString EcgTraceWidget::frameStatsText()
+{
+    FrameStats stats = getFrameStats();
+    return QString("ecg trace: %1 fps, paint mean %2 ms / p95 %3 ms / max %4 ms, %5 px repainted per frame (of %6)")
+        .arg(stats.fps, 0, 'f', 1)
+        .arg(stats.meanPaintMsec, 0, 'f', 3)
+        .arg(stats.p95PaintMsec, 0, 'f', 3)
+        .arg(stats.maxPaintMsec, 0, 'f', 3)
+        .arg(stats.meanDirtyWidth, 0, 'f', 1)
+        .arg(width());
+}
@@ -0,0 +1,79 @@
+#ifndef ECGTRACEWIDGET_H
+#define ECGTRACEWIDGET_H
+
+#include <QWidget>
+#include <QPixmap>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+
+// Live ECG monitor.
+// Samples are queued in a ring buffer and drawn once per frame into an off-screen canvas as a
+// sweeping trace (the pen moves left to right and erases just ahead of itself, like a bedside
+// monitor). Only the strip touched since the last frame is repainted, so the cost per frame does
+// not depend on the widget size.
+class EcgTraceWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    struct FrameStats {
+        int frames;             // frames in the measurement window
+        double fps;
+        double meanPaintMsec;
+        double p95PaintMsec;
+        double maxPaintMsec;
+        double meanDirtyWidth;  // pixels repainted per frame
+    };
+
+    explicit EcgTraceWidget(QWidget *parent = nullptr);
+
+    void setSweepSeconds(double seconds);   // time across the full width
+    void setRange(double millivolts);       // amplitude at the top edge
+
+    FrameStats getFrameStats();
+    QString frameStatsText();
+
+public slots:
+    void setSampleRate(int hz);
+    void appendSamples(QVector<float> samples);
+    void clear();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    static const int StatsWindow = 240;     // ~4 s at 60 fps
+    static const int EraseGap = 12;         // blank pixels ahead of the pen
+
+    int sampleRate;
+    double sweepSeconds;
+    double range;
+
+    QVector<float> ring;
+    qint64 written;
+    qint64 drawn;
+
+    QPixmap canvas;
+    int sweepSample;                        // position of the pen within the sweep
+    QPointF lastPoint;
+    bool hasLastPoint;
+
+    QTimer* frameTimer;
+    QElapsedTimer frameClock;
+
+    QVector<qint64> paintNsec;
+    QVector<qint64> frameStartNsec;
+    QVector<int> dirtyWidth;
+    int statsIndex;
+    int statsCount;
+
+    int samplesPerSweep();
+    void resetCanvas();
+
+private slots:
+    void onFrame();
+};
+
+#endif // ECGTRACEWIDGET_H
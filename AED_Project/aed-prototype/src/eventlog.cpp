@@ -0,0 +1,145 @@
+#include "eventlog.h"
+#include "eventrecorder.h"
+#include <QFile>
+#include <cstring>
+
+EventLog::EventLog()
+{
+    seed = 0;
+    startMsecsSinceEpoch = 0;
+    ecgStreaming = false;
+    ecgSignal = -1;
+    ecgStartSample = 0;
+}
+
+bool EventLog::load(QString path)
+{
+    events.clear();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    QByteArray data = file.readAll();
+
+    EventRecorder::FileHeader header;
+    if (data.size() < int(sizeof(header))) {
+        error = "not an event log";
+        return false;
+    }
+    std::memcpy(&header, data.constData(), sizeof(header));
+    if (std::memcmp(header.magic, "AEDLOG01", 8) != 0) {
+        error = "not an event log";
+        return false;
+    }
+    if (header.version < 1 || header.version > EventRecorder::Version
+            || header.recordHeaderBytes != sizeof(EventRecorder::RecordHeader)) {
+        error = QString("unsupported log version %1").arg(header.version);
+        return false;
+    }
+    seed = header.seed;
+    startMsecsSinceEpoch = header.startMsecsSinceEpoch;
+
+    // Version 1 logs predate the ECG header; their flags field was reserved and always 0
+    ecgStreaming = header.flags & EventRecorder::EcgStreaming;
+    ecgRecord.clear();
+    ecgSignal = -1;
+    ecgStartSample = 0;
+    qint64 pos = sizeof(header);
+    if (header.version >= 2) {
+        EventRecorder::EcgHeader ecg;
+        if (pos + qint64(sizeof(ecg)) > data.size()) {
+            error = "event log header is cut short";
+            return false;
+        }
+        std::memcpy(&ecg, data.constData() + pos, sizeof(ecg));
+        qint64 bytes = (qint64(sizeof(ecg)) + ecg.recordChars * 2 + 7) & ~7;
+        if (pos + bytes > data.size()) {
+            error = "event log header is cut short";
+            return false;
+        }
+        ecgRecord = QString(reinterpret_cast<const QChar*>(data.constData() + pos + sizeof(ecg)), ecg.recordChars);
+        ecgSignal = ecg.signal;
+        ecgStartSample = ecg.startSample;
+        pos += bytes;
+    }
+    while (pos + qint64(sizeof(EventRecorder::RecordHeader)) <= data.size()) {
+        EventRecorder::RecordHeader record;
+        std::memcpy(&record, data.constData() + pos, sizeof(record));
+        qint64 bytes = (qint64(sizeof(record)) + record.textChars * 2 + 7) & ~7;
+
+        // A log that was never closed ends in the zeroed part of its last growth step
+        if (record.type >= EventRecorder::TypeCount || pos + bytes > data.size()
+                || (record.type == EventRecorder::SessionStart && !events.isEmpty())) {
+            break;
+        }
+
+        Event event;
+        event.type = record.type;
+        event.nsec = record.nsec;
+        event.deviceMsec = record.deviceMsec;
+        event.value = record.value;
+        event.arg = record.arg;
+        event.text = QString(reinterpret_cast<const QChar*>(data.constData() + pos + sizeof(record)), record.textChars);
+        events.append(event);
+        pos += bytes;
+    }
+
+    if (events.isEmpty() || events.first().type != EventRecorder::SessionStart) {
+        error = "event log has no session";
+        return false;
+    }
+    return true;
+}
+
+QString EventLog::getError()
+{
+    return error;
+}
+
+quint32 EventLog::getSeed()
+{
+    return seed;
+}
+
+qint64 EventLog::getStartMsecsSinceEpoch()
+{
+    return startMsecsSinceEpoch;
+}
+
+bool EventLog::isEcgStreaming()
+{
+    return ecgStreaming;
+}
+
+QString EventLog::getEcgRecord()
+{
+    return ecgRecord;
+}
+
+int EventLog::getEcgSignal()
+{
+    return ecgSignal;
+}
+
+qint64 EventLog::getEcgStartSample()
+{
+    return ecgStartSample;
+}
+
+const QVector<EventLog::Event>& EventLog::getEvents()
+{
+    return events;
+}
+
+QVector<EventLog::Event> EventLog::getEvents(int type)
+{
+    QVector<Event> matching;
+    for (const Event &event : events) {
+        if (event.type == type) {
+            matching.append(event);
+        }
+    }
+    return matching;
+}
@@ -0,0 +1,50 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <QString>
+#include <QVector>
+
+// A session log written by EventRecorder, read back in full.
+// A log cut short by a crash loads up to its last complete record.
+class EventLog
+{
+public:
+    struct Event {
+        int type;               // EventRecorder::Type
+        qint64 nsec;
+        qint64 deviceMsec;
+        int value;
+        int arg;
+        QString text;
+    };
+
+    EventLog();
+
+    bool load(QString path);
+    QString getError();
+
+    quint32 getSeed();
+    qint64 getStartMsecsSinceEpoch();
+
+    // How the pads were fed: streaming on or off, and the WFDB record, signal and sample the
+    // recording started at; an empty record for the generator
+    bool isEcgStreaming();
+    QString getEcgRecord();
+    int getEcgSignal();
+    qint64 getEcgStartSample();
+
+    const QVector<Event>& getEvents();
+    QVector<Event> getEvents(int type);
+
+private:
+    QString error;
+    quint32 seed;
+    qint64 startMsecsSinceEpoch;
+    bool ecgStreaming;
+    QString ecgRecord;
+    int ecgSignal;
+    qint64 ecgStartSample;
+    QVector<Event> events;
+};
+
+#endif // EVENTLOG_H
@@ -0,0 +1,382 @@
+#include "eventrecorder.h"
+#include "AED.h"
+#include "wfdbrecord.h"
+#include <QDateTime>
+#include <QFile>
+#include <QThread>
+#include <cstring>
+
+static_assert(sizeof(EventRecorder::FileHeader) == 32, "FileHeader is 32 bytes on disk");
+static_assert(sizeof(EventRecorder::EcgHeader) == 16, "EcgHeader is 16 bytes on disk");
+static_assert(sizeof(EventRecorder::RecordHeader) == 32, "RecordHeader is 32 bytes on disk");
+
+namespace {
+
+const char* TYPE_NAMES[EventRecorder::TypeCount] = {
+    "SessionStart",
+    "InformUser",
+    "VoiceText",
+    "Audio",
+    "Light",
+    "ShockButton",
+    "BatteryLevel",
+    "RhythmOptions",
+    "Shock",
+    "CprStart",
+    "CprEnd",
+    "StateChanged",
+    "PowerState",
+    "ElectrodeOverlay",
+    "RhythmAnalyzed",
+    "Input",
+};
+
+// The file grows in steps this large, so remapping is rare
+const qint64 FILE_GROWTH = 1024 * 1024;
+
+}
+
+// Appends the buffers the recorder hands over to the memory-mapped log
+class EventRecorder::Writer : public QThread
+{
+public:
+    explicit Writer(EventRecorder* recorder)
+        : QThread(recorder)
+    {
+        this->recorder = recorder;
+        map = nullptr;
+        mapped = 0;
+        used = 0;
+        stopping = false;
+    }
+
+    bool open(QString path, QString &error)
+    {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+            error = file.errorString();
+            return false;
+        }
+        return reserve(sizeof(FileHeader), error);
+    }
+
+    bool reserve(qint64 bytes, QString &error)
+    {
+        if (used + bytes <= mapped) {
+            return true;
+        }
+
+        qint64 size = ((used + bytes) / FILE_GROWTH + 1) * FILE_GROWTH;
+        if (map != nullptr) {
+            file.unmap(map);
+        }
+        map = nullptr;
+        if (!file.resize(size) || (map = file.map(0, size)) == nullptr) {
+            error = file.errorString();
+            mapped = 0;
+            return false;
+        }
+        mapped = size;
+        return true;
+    }
+
+    void append(const char* data, qint64 bytes)
+    {
+        QString error;
+        if (!reserve(bytes, error)) {
+            qWarning("recorder: %s", qPrintable(error));
+            return;
+        }
+        std::memcpy(map + used, data, bytes);
+        used += bytes;
+    }
+
+    void finish()
+    {
+        if (map != nullptr) {
+            file.unmap(map);
+            map = nullptr;
+        }
+        if (file.isOpen()) {
+            file.resize(used);
+            file.close();
+        }
+    }
+
+    qint64 getUsed()
+    {
+        return used;
+    }
+
+    bool stopping;      // guarded by the recorder's mutex
+
+protected:
+    void run() override
+    {
+        for (;;) {
+            recorder->mutex.lock();
+            while (recorder->fullBuffers.isEmpty() && !stopping) {
+                recorder->ready.wait(&recorder->mutex);
+            }
+            if (recorder->fullBuffers.isEmpty()) {
+                recorder->mutex.unlock();
+                return;
+            }
+            int buffer = recorder->fullBuffers.takeFirst();
+            int bytes = recorder->fullBufferBytes.takeFirst();
+            recorder->mutex.unlock();
+
+            append(recorder->buffers[buffer].constData(), bytes);
+
+            recorder->mutex.lock();
+            recorder->freeBuffers.append(buffer);
+            recorder->mutex.unlock();
+        }
+    }
+
+private:
+    EventRecorder* recorder;
+    QFile file;
+    uchar* map;
+    qint64 mapped;
+    qint64 used;
+};
+
+EventRecorder::EventRecorder(AED *aed)
+    : QObject{aed}
+{
+    this->aed = aed;
+    writer = nullptr;
+    current = -1;
+    fill = 0;
+    events = 0;
+    dropped = 0;
+    totalNsec = 0;
+    maxNsec = 0;
+
+    // A crash loses at most this much of the session
+    flushTimer = new QTimer(this);
+    flushTimer->setInterval(FlushMsec);
+    connect(flushTimer, &QTimer::timeout, this, &EventRecorder::flush);
+
+    // Direct connections: events are recorded on the thread that emits them
+    connect(aed, &AED::informUser, this, [this](QString text) { record(InformUser, 0, 0, text); }, Qt::DirectConnection);
+    connect(aed, &AED::voiceText, this, [this](QString text) { record(VoiceText, 0, 0, text); }, Qt::DirectConnection);
+    connect(aed, &AED::audio, this, [this](QString file) { record(Audio, 0, 0, file); }, Qt::DirectConnection);
+    connect(aed, &AED::updateLight, this, [this](bool state, int light) { record(Light, state, light); }, Qt::DirectConnection);
+    connect(aed, &AED::shockButton, this, [this](bool enable) { record(ShockButton, enable); }, Qt::DirectConnection);
+    connect(aed, &AED::updateBatteryLevel, this, [this](int level) { record(BatteryLevel, level); }, Qt::DirectConnection);
+    connect(aed, &AED::toggleRhythmOptions, this, [this](bool enable) { record(RhythmOptions, enable); }, Qt::DirectConnection);
+    connect(aed, &AED::updateShockCount, this, [this](int count) {
+        if (count > 0) {
+            record(Shock, count, AED::ShockJoules);
+        }
+    }, Qt::DirectConnection);
+    connect(aed, &AED::cprStateChanged, this, [this](bool active) { record(active ? CprStart : CprEnd); }, Qt::DirectConnection);
+    connect(aed, &AED::stateChanged, this, [this](int state) { record(StateChanged, state, 0, AED::stateName(AED::State(state))); }, Qt::DirectConnection);
+    connect(aed, &AED::powerStateChanged, this, [this](bool on) { record(PowerState, on); }, Qt::DirectConnection);
+    connect(aed, &AED::updateElectrodeOverlay, this, [this](bool connected) { record(ElectrodeOverlay, connected); }, Qt::DirectConnection);
+    connect(aed, &AED::rhythmAnalyzed, this, [this](bool shockable, double confidence) {
+        record(RhythmAnalyzed, shockable, qRound(confidence * 1000));
+    }, Qt::DirectConnection);
+    connect(aed, &AED::inputApplied, this, [this](int input, int value) { record(Input, input, value); }, Qt::DirectConnection);
+}
+
+EventRecorder::~EventRecorder()
+{
+    close();
+}
+
+bool EventRecorder::open(QString path)
+{
+    close();
+
+    writer = new Writer(this);
+    if (!writer->open(path, error)) {
+        delete writer;
+        writer = nullptr;
+        return false;
+    }
+
+    FileHeader header = {};
+    std::memcpy(header.magic, "AEDLOG01", 8);
+    header.version = Version;
+    header.recordHeaderBytes = sizeof(RecordHeader);
+    header.startMsecsSinceEpoch = QDateTime::currentMSecsSinceEpoch();
+    header.seed = aed->getSeed();
+    header.flags = aed->isEcgStreaming() ? EcgStreaming : 0;
+    writer->append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // The seed alone only reproduces the generator; a recording is replayed from the same sample
+    EcgHeader ecgHeader = {};
+    ecgHeader.signal = -1;
+    QString ecgRecord;
+    WfdbPlayback* playback = dynamic_cast<WfdbPlayback*>(aed->getEcgSource());
+    if (playback != nullptr) {
+        ecgRecord = playback->getRecord()->getPath();
+        ecgHeader.startSample = playback->getPosition();
+        ecgHeader.signal = playback->getSignal();
+    }
+    ecgHeader.recordChars = ecgRecord.size();
+    QByteArray ecg(sizeof(ecgHeader) + ((ecgRecord.size() * 2 + 7) & ~7), 0);
+    std::memcpy(ecg.data(), &ecgHeader, sizeof(ecgHeader));
+    std::memcpy(ecg.data() + sizeof(ecgHeader), ecgRecord.constData(), ecgRecord.size() * 2);
+    writer->append(ecg.constData(), ecg.size());
+
+    // Every buffer is allocated here; record() only copies into them
+    this->path = path;
+    buffers.resize(BufferCount);
+    freeBuffers.clear();
+    freeBuffers.reserve(BufferCount);
+    fullBuffers.reserve(BufferCount);
+    fullBufferBytes.reserve(BufferCount);
+    for (int i = 0; i < BufferCount; i++) {
+        buffers[i].resize(BufferBytes);
+        freeBuffers.append(i);
+    }
+    current = freeBuffers.takeFirst();
+    fill = 0;
+
+    session.start();
+    writer->start();
+    flushTimer->start();
+    record(SessionStart);
+    return true;
+}
+
+QString EventRecorder::getError()
+{
+    return error;
+}
+
+void EventRecorder::record(Type type, int value, int arg, const QString &text)
+{
+    if (current < 0) {
+        return;
+    }
+    qint64 start = session.nsecsElapsed();
+
+    int chars = qMin(int(text.size()), int(MaxTextChars));
+    int bytes = (int(sizeof(RecordHeader)) + chars * 2 + 7) & ~7;
+    if (fill + bytes > BufferBytes && !swapBuffer()) {
+        dropped++;
+        return;
+    }
+
+    char* out = buffers[current].data() + fill;
+    RecordHeader header;
+    header.nsec = start;
+    header.deviceMsec = aed->getClock()->now();
+    header.type = type;
+    header.textChars = chars;
+    header.reserved = 0;
+    header.value = value;
+    header.arg = arg;
+    std::memcpy(out, &header, sizeof(header));
+    std::memcpy(out + sizeof(header), text.constData(), chars * 2);
+    std::memset(out + sizeof(header) + chars * 2, 0, bytes - sizeof(header) - chars * 2);
+    fill += bytes;
+    events++;
+
+    qint64 nsec = session.nsecsElapsed() - start;
+    totalNsec += nsec;
+    maxNsec = qMax(maxNsec, nsec);
+}
+
+bool EventRecorder::swapBuffer()
+{
+    QMutexLocker locker(&mutex);
+    if (freeBuffers.isEmpty()) {
+        return false;
+    }
+
+    if (fill > 0) {
+        fullBuffers.append(current);
+        fullBufferBytes.append(fill);
+        ready.wakeOne();
+    }
+    else {
+        freeBuffers.append(current);
+    }
+    current = freeBuffers.takeFirst();
+    fill = 0;
+    return true;
+}
+
+void EventRecorder::flush()
+{
+    if (current >= 0 && fill > 0) {
+        swapBuffer();
+    }
+}
+
+void EventRecorder::close()
+{
+    if (writer == nullptr) {
+        return;
+    }
+
+    flushTimer->stop();
+    flush();
+
+    mutex.lock();
+    writer->stopping = true;
+    ready.wakeOne();
+    mutex.unlock();
+    writer->wait();
+
+    // Whatever could not be handed over (every buffer busy) still gets written
+    if (fill > 0) {
+        writer->append(buffers[current].constData(), fill);
+    }
+    qInfo("recorder: %s: %s", qPrintable(path), qPrintable(statsText(getStats())));
+    writer->finish();
+
+    delete writer;
+    writer = nullptr;
+    current = -1;
+    fill = 0;
+    fullBuffers.clear();
+    fullBufferBytes.clear();
+}
+
+EventRecorder::Stats EventRecorder::getStats()
+{
+    Stats stats;
+    stats.events = events;
+    stats.dropped = dropped;
+    stats.bytes = writer != nullptr ? writer->getUsed() : 0;
+    stats.meanNsec = events > 0 ? double(totalNsec) / events : 0;
+    stats.maxNsec = maxNsec;
+    return stats;
+}
+
+QString EventRecorder::statsText(const Stats &stats)
+{
+    return QString("%1 events, %2 dropped, %3 KiB written, %4 ns mean / %5 ns max per event")
+        .arg(stats.events)
+        .arg(stats.dropped)
+        .arg(stats.bytes / 1024)
+        .arg(stats.meanNsec, 0, 'f', 0)
+        .arg(stats.maxNsec);
+}
+
+QString EventRecorder::sessionPath(QString path, int index, int count)
+{
+    if (count == 1) {
+        return path;
+    }
+    int dot = path.lastIndexOf('.');
+    if (dot <= path.lastIndexOf('/')) {
+        dot = path.size();
+    }
+    return path.left(dot) + QString("-%1").arg(index + 1) + path.mid(dot);
+}
+
+QString EventRecorder::typeName(int type)
+{
+    if (type < 0 || type >= TypeCount) {
+        return QString("Type%1").arg(type);
+    }
+    return TYPE_NAMES[type];
+}
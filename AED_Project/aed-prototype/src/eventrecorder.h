@@ -0,0 +1,141 @@
+#ifndef EVENTRECORDER_H
+#define EVENTRECORDER_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QTimer>
+
+class AED;
+
+// Event memory of a rescue session, for debriefing.
+// Created as a child of an AED, it records every input and output signal with a monotonic timestamp and the
+// device time into an append-only binary log (format below). Events are copied into one of a few
+// buffers allocated by open(), so recording never allocates or touches the file; a full buffer is
+// handed to a writer thread that appends it to a memory-mapped file. If the writer falls behind by
+// every buffer, events are dropped and counted rather than waited for.
+//
+// File layout, native byte order: a FileHeader, an EcgHeader followed by the path of the WFDB record
+// the pads were fed from, then records, each a RecordHeader followed by `textChars` UTF-16 code
+// units. Every text is padded to a multiple of 8 bytes. Version 1 logs have no EcgHeader.
+class EventRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Type {
+        SessionStart,
+        InformUser,
+        VoiceText,
+        Audio,
+        Light,                  // value: on, arg: light
+        ShockButton,
+        BatteryLevel,
+        RhythmOptions,
+        Shock,                  // value: shock count, arg: joules
+        CprStart,
+        CprEnd,
+        StateChanged,
+        PowerState,
+        ElectrodeOverlay,
+        RhythmAnalyzed,         // value: shockable, arg: confidence in thousandths
+        Input,                  // value: AED::Input, arg: its value
+        TypeCount
+    };
+
+    struct FileHeader {
+        char magic[8];          // "AEDLOG01"
+        quint32 version;
+        quint32 recordHeaderBytes;
+        qint64 startMsecsSinceEpoch;
+        quint32 seed;           // AED::getSeed() when recording started
+        quint32 flags;          // HeaderFlag
+    };
+
+    enum HeaderFlag {
+        EcgStreaming = 0x1      // analysis classified the streamed history, see AED::setEcgStreaming()
+    };
+
+    // The ECG source when recording started, for a replay to feed the pads the same signal
+    struct EcgHeader {
+        qint64 startSample;     // playback position in the record
+        qint32 signal;          // -1 for the synthetic generator
+        quint32 recordChars;    // UTF-16 code units of the record path that follow
+    };
+
+    struct RecordHeader {
+        quint64 nsec;           // since the session started
+        qint64 deviceMsec;      // device clock
+        quint16 type;
+        quint16 textChars;
+        quint32 reserved;
+        qint32 value;
+        qint32 arg;
+    };
+
+    struct Stats {
+        qint64 events;
+        qint64 dropped;
+        qint64 bytes;           // written to the file so far
+        double meanNsec;        // recording cost per event
+        qint64 maxNsec;
+    };
+
+    static const int MaxTextChars = 256;
+    static const quint32 Version = 2;
+
+    explicit EventRecorder(AED *aed);
+    ~EventRecorder();           // flushes and truncates the file to what was written
+
+    bool open(QString path);
+    QString getError();
+
+    // Appends one event; safe to call from the device thread only
+    void record(Type type, int value = 0, int arg = 0, const QString &text = QString());
+
+    void flush();               // hands the partly filled buffer to the writer
+    void close();
+
+    Stats getStats();
+    static QString statsText(const Stats &stats);
+    static QString typeName(int type);
+
+    // One log per device when several run: session.aedlog, or session-1.aedlog, session-2.aedlog, ...
+    static QString sessionPath(QString path, int index, int count);
+
+private:
+    class Writer;
+
+    static const int BufferBytes = 64 * 1024;
+    static const int BufferCount = 4;
+    static const int FlushMsec = 1000;
+
+    AED* aed;
+    Writer* writer;
+    QString path;
+    QString error;
+    QElapsedTimer session;
+    QTimer* flushTimer;
+
+    // Buffers cycle between the recorder (current), the writer's queue and the free list
+    QVector<QByteArray> buffers;
+    int current;
+    int fill;
+    QMutex mutex;
+    QWaitCondition ready;
+    QList<int> fullBuffers;     // waiting for the writer, in order
+    QList<int> fullBufferBytes;
+    QList<int> freeBuffers;
+
+    qint64 events;
+    qint64 dropped;
+    qint64 totalNsec;
+    qint64 maxNsec;
+
+    bool swapBuffer();
+};
+
+#endif // EVENTRECORDER_H
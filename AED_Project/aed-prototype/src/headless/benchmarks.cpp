@@ -0,0 +1,110 @@
+#include "benchmarks.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include "AED.h"
+#include "batterymodel.h"
+#include "ecggenerator.h"
+#include "eventrecorder.h"
+#include "rhythmclassifier.h"
+
+void Benchmarks::benchmarkEcg(int sampleRate)
+{
+    QTextStream out(stdout);
+    const AED::Rhythm rhythms[] = { AED::VF, AED::VT, AED::PEA, AED::Asystole, AED::Regular };
+    const int seconds = 3600;
+
+    EcgGenerator generator(sampleRate, EcgGenerator::MaxLeads);
+    generator.setNoise(0.02);
+    QVector<float> samples(sampleRate * EcgGenerator::MaxLeads);
+
+    for (AED::Rhythm rhythm : rhythms) {
+        generator.setRhythm(rhythm);
+        QElapsedTimer timer;
+        timer.start();
+        for (int s = 0; s < seconds; s++) {
+            generator.generate(samples.data(), sampleRate);
+        }
+        out << QString("ecg: %1 %2 Hz x %3 leads, 1 h in %4 ms")
+               .arg(AED::rhythmName(rhythm), -8).arg(sampleRate).arg(EcgGenerator::MaxLeads)
+               .arg(timer.nsecsElapsed() / 1e6, 0, 'f', 1) << Qt::endl;
+    }
+
+    // Every 4 second window of a minute of signal, lead II only
+    RhythmClassifier classifier;
+    QVector<float> window(sampleRate * 4);
+    generator.setLeadCount(1);
+    for (AED::Rhythm rhythm : rhythms) {
+        generator.setRhythm(rhythm);
+        int shockable = 0;
+        qint64 nsec = 0;
+        const int windows = 15;
+        for (int w = 0; w < windows; w++) {
+            generator.generate(window.data(), window.size());
+            RhythmClassifier::Result result = classifier.classify(window.constData(), window.size(), sampleRate);
+            shockable += result.shockable ? 1 : 0;
+            nsec += result.nsec;
+        }
+        out << QString("classify: %1 %2/%3 windows shockable, %4 us per window")
+               .arg(AED::rhythmName(rhythm), -8).arg(shockable).arg(windows)
+               .arg(nsec / 1000.0 / windows, 0, 'f', 1) << Qt::endl;
+    }
+}
+
+void Benchmarks::reportBatteryLifetime(double temperature, double ageDays)
+{
+    QTextStream out(stdout);
+    BatteryModel battery;
+    battery.setTemperature(temperature);
+    battery.setAgeDays(ageDays);
+
+    BatteryModel::Prediction fresh = battery.predict(AED::ShockJoules);
+    out << QString("battery: new pack at %1 C: %2 shocks at %3 J, %4 min running, %5 days standby")
+           .arg(temperature, 0, 'f', 1).arg(fresh.shocks).arg(AED::ShockJoules)
+           .arg(fresh.runMinutes, 0, 'f', 0).arg(fresh.standbyDays, 0, 'f', 0) << Qt::endl;
+
+    QElapsedTimer timer;
+    timer.start();
+    double days = battery.simulateStandby(24.0, AED::LowBatteryPercent);
+    qint64 nsec = timer.nsecsElapsed();
+
+    BatteryModel::Prediction left = battery.predict(AED::ShockJoules);
+    out << QString("battery: standby with daily self-tests reaches %1% after %2 days (%3 years), %4 shocks left; "
+                   "simulated in %5 ms")
+           .arg(battery.getLevel()).arg(days, 0, 'f', 0).arg(days / 365.0, 0, 'f', 1).arg(left.shocks)
+           .arg(nsec / 1e6, 0, 'f', 3) << Qt::endl;
+}
+
+void Benchmarks::benchmarkRecorder()
+{
+    QTextStream out(stdout);
+    QString path = QDir::temp().filePath("aed-recorder-benchmark.aedlog");
+    const int events = 1000000;
+
+    AED aed;
+    EventRecorder recorder(&aed);
+    if (!recorder.open(path)) {
+        qCritical("recorder: %s", qPrintable(recorder.getError()));
+        return;
+    }
+
+    const QString text = "DO NOT TOUCH PATIENT.\n        ANALYZING";
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < events; i++) {
+        if (i % 4 == 0) {
+            recorder.record(EventRecorder::InformUser, 0, 0, text);
+        }
+        else {
+            recorder.record(EventRecorder::Light, i % 2, 1 + i % 6);
+        }
+    }
+    qint64 nsec = timer.nsecsElapsed();
+
+    out << QString("recorder: %1 events in %2 ms, %3 ns per event including the loop")
+           .arg(events).arg(nsec / 1e6, 0, 'f', 1).arg(double(nsec) / events, 0, 'f', 1) << Qt::endl;
+    out << QString("recorder: %1").arg(EventRecorder::statsText(recorder.getStats())) << Qt::endl;
+    recorder.close();
+    QFile::remove(path);
+}
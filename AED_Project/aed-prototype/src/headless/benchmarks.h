@@ -0,0 +1,18 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+// The measurements aed-headless runs on their own and exits, results on stdout
+class Benchmarks
+{
+public:
+    // Times one hour of three-lead signal for every rhythm class, then the shock advisory on it
+    static void benchmarkEcg(int sampleRate);
+
+    // Fast-forwards a new pack through standby with daily self-tests until it asks to be replaced
+    static void reportBatteryLifetime(double temperature, double ageDays);
+
+    // Records a million events, the mix of a busy rescue, and reports what recording costs per event
+    static void benchmarkRecorder();
+};
+
+#endif // BENCHMARKS_H
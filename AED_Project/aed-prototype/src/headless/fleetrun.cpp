@@ -0,0 +1,236 @@
+#include "fleetrun.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QScopeGuard>
+#include <QTextStream>
+#include "devicepool.h"
+#include "wfdbrecord.h"
+#include "eventrecorder.h"
+#include "metricscollector.h"
+#include "loopwatchdog.h"
+#include "instructorserver.h"
+#include "telemetryexport.h"
+#include "headlessdriver.h"
+#include "headlessmode.h"
+#include <memory>
+
+int FleetRun::run(const Options &options)
+{
+    // Checked before anything is created, so a bad option leaves nothing behind
+    if (!HeadlessMode::isClockMode(options.clockMode)) {
+        qCritical("unknown clock mode: %s", qPrintable(options.clockMode));
+        return 2;
+    }
+
+    // Recorded ECG, shared read-only by every device
+    WfdbRecord record;
+    int wfdbSignal = -1;
+    QList<WfdbPlayback*> playbacks;
+    if (!options.wfdbRecord.isEmpty()) {
+        if (!record.open(options.wfdbRecord)) {
+            qCritical("wfdb: %s", qPrintable(record.getError()));
+            return 2;
+        }
+        bool isIndex;
+        wfdbSignal = options.wfdbSignal.toInt(&isIndex);
+        if (!isIndex) {
+            wfdbSignal = record.findSignal(options.wfdbSignal);
+        }
+        if (wfdbSignal < 0 || wfdbSignal >= record.getSignalCount()) {
+            qCritical("wfdb: no signal %s", qPrintable(options.wfdbSignal));
+            return 2;
+        }
+        if (!options.wfdbRhythm.isEmpty() && record.findRhythm(options.wfdbRhythm) < 0) {
+            qCritical("wfdb: no %s annotation (record has: %s)", qPrintable(options.wfdbRhythm),
+                      qPrintable(record.getRhythmLabels().join(' ')));
+            return 2;
+        }
+        qInfo("wfdb: %s at %.0f Hz, %lld samples, %lld annotations",
+              qPrintable(record.getSignalName(wfdbSignal)), record.getSampleRate(),
+              record.getSampleCount(), qint64(record.getAnnotations().size()));
+    }
+
+    qint64 residentBefore = DevicePool::residentBytes();
+    double cpuBefore = DevicePool::cpuSeconds();
+
+    QList<HeadlessDriver*> drivers;
+    QList<MetricsCollector*> collectors;
+
+    // The drivers run until the pool has stopped and the playbacks feed the devices until they are
+    // deleted, so both go last, on every way out
+    auto cleanup = qScopeGuard([&drivers, &playbacks]() {
+        qDeleteAll(drivers);
+        qDeleteAll(playbacks);
+    });
+    QList<LoopWatchdog*> watchdogs;
+    ProtocolMetrics metrics;
+    int running = options.deviceCount;
+    bool serving = !options.instructorName.isEmpty();    // until a console has come and gone
+    int exitCode;
+    qint64 residentAfter;
+    double cpuAfter;
+    QElapsedTimer wall;
+
+    // Declared before the pool: the devices write into it until they are deleted
+    TelemetryExport telemetry;
+    if (!options.telemetryKey.isEmpty()) {
+        if (!telemetry.create(options.telemetryKey, options.deviceCount)) {
+            qCritical("telemetry: cannot create %s: %s", qPrintable(options.telemetryKey),
+                      qPrintable(telemetry.getError()));
+            return 2;
+        }
+        qInfo("telemetry: %d device(s) at %s", options.deviceCount, qPrintable(telemetry.getNativeKey()));
+    }
+
+    {
+        DevicePool pool(options.threadCount);
+        // Goes before the pool does: the relays it queues commands to are children of the devices
+        std::unique_ptr<InstructorServer> instructor;
+        if (!options.instructorName.isEmpty()) {
+            instructor.reset(new InstructorServer);
+            if (!instructor->listen(options.instructorName)) {
+                qCritical("instructor: cannot listen on %s: %s", qPrintable(options.instructorName),
+                          qPrintable(instructor->getError()));
+                return 2;
+            }
+        }
+
+        for (int i = 0; i < options.deviceCount; i++) {
+            AED* aed = pool.createDevice();
+
+            HeadlessMode::setClockMode(aed, options.clockMode, options.speed);
+            aed->setSeed(options.seed);
+
+            // Before the recorder opens, so the log header names the record, the start sample and
+            // whether analysis ran on the streamed history
+            if (wfdbSignal >= 0) {
+                WfdbPlayback* playback = new WfdbPlayback(&record, wfdbSignal);
+                if (!options.wfdbRhythm.isEmpty()) {
+                    playback->seekToRhythm(options.wfdbRhythm);
+                }
+                aed->setEcgSource(playback);
+                playbacks.append(playback);
+            }
+            aed->setEcgStreaming(options.telemetryEcg);
+
+            if (!options.recordPath.isEmpty()) {
+                EventRecorder* recorder = new EventRecorder(aed);
+                QString path = EventRecorder::sessionPath(options.recordPath, i, options.deviceCount);
+                if (!recorder->open(path)) {
+                    qCritical("recorder: cannot open %s: %s", qPrintable(path), qPrintable(recorder->getError()));
+                    return 2;
+                }
+            }
+            aed->getBattery()->setTemperature(options.batteryTemperature);
+            aed->getBattery()->setAgeDays(options.batteryAgeDays);
+            aed->onChangeBatteryLevel(options.batteryLevel);
+            aed->onSelfTestChanged(options.selfTestPassed);
+
+            if (!options.metricsPath.isEmpty()) {
+                collectors.append(new MetricsCollector(aed));
+            }
+
+            HeadlessDriver* driver = new HeadlessDriver(aed);
+            driver->setRhythms(options.rhythms);
+            driver->setChildPads(options.childPads);
+            driver->setPadsOnStartup(options.padsOnStartup);
+            driver->setCprDepth(options.cprDepth);
+            driver->setVerbose(options.verbose);
+            pool.attach(driver, aed);
+            drivers.append(driver);
+            if (instructor != nullptr) {
+                instructor->addDevice(aed);
+            }
+            if (!options.telemetryKey.isEmpty()) {
+                telemetry.attach(aed, i);
+            }
+
+            QObject::connect(driver, &HeadlessDriver::finished, QCoreApplication::instance(), [&running, &serving]() {
+                if (--running == 0 && !serving) {
+                    QCoreApplication::quit();
+                }
+            }, Qt::QueuedConnection);
+        }
+
+        residentAfter = DevicePool::residentBytes();
+
+        wall.start();
+        pool.start();
+        if (options.watchdogMsec > 0) {
+            // One per worker, running on it alongside its devices
+            for (QThread* worker : pool.getWorkers()) {
+                LoopWatchdog* watchdog = new LoopWatchdog(worker->objectName());
+                watchdog->setThreshold(options.watchdogMsec);
+                watchdog->moveToThread(worker);
+                QMetaObject::invokeMethod(watchdog, &LoopWatchdog::start, Qt::QueuedConnection);
+                watchdogs.append(watchdog);
+            }
+        }
+        if (instructor != nullptr) {
+            QObject::connect(instructor.get(), &InstructorServer::consolesChanged, QCoreApplication::instance(), [&running, &serving](int connected) {
+                serving = connected > 0;
+                if (running == 0 && !serving) {
+                    QCoreApplication::quit();
+                }
+            }, Qt::QueuedConnection);
+            instructor->start();
+        }
+        for (HeadlessDriver* driver : drivers) {
+            QMetaObject::invokeMethod(driver, &HeadlessDriver::start, Qt::QueuedConnection);
+        }
+
+        exitCode = QCoreApplication::exec();
+        cpuAfter = DevicePool::cpuSeconds();
+
+        if (instructor != nullptr) {
+            instructor->stop();
+            Histogram latency = instructor->getLatency();
+            QTextStream(stdout) << QString("instructor: %1 commands, latency p50 %2 us / p99 %3 us / max %4 us")
+                                   .arg(latency.getCount()).arg(latency.valueAtPercentile(50))
+                                   .arg(latency.valueAtPercentile(99)).arg(latency.getMax()) << Qt::endl;
+            instructor.reset();
+        }
+
+        // Rescues end with the device still on; their sessions are counted up to here. The watchdogs'
+        // heartbeats are stopped on the workers they run on first.
+        for (LoopWatchdog* watchdog : watchdogs) {
+            QMetaObject::invokeMethod(watchdog, &LoopWatchdog::stop, Qt::BlockingQueuedConnection);
+        }
+        pool.stop();
+        if (!watchdogs.isEmpty()) {
+            Histogram timerLateness;
+            for (AED* aed : pool.getDevices()) {
+                timerLateness.merge(aed->getClock()->getLateness());
+            }
+            QTextStream out(stdout);
+            for (LoopWatchdog* watchdog : watchdogs) {
+                out << watchdog->dump();
+            }
+            out << QString("watchdog: device timers late by p50 %1 ms / p99 %2 ms / max %3 ms over %4 firings")
+                   .arg(timerLateness.valueAtPercentile(50)).arg(timerLateness.valueAtPercentile(99))
+                   .arg(timerLateness.getMax()).arg(timerLateness.getCount()) << Qt::endl;
+            qDeleteAll(watchdogs);
+        }
+        for (MetricsCollector* collector : collectors) {
+            collector->endSession();
+            metrics.merge(collector->getMetrics());
+        }
+    }
+
+    if (options.deviceCount > 1) {
+        QTextStream out(stdout);
+        out << QString("devices: %1 on %2 thread(s), wall %3 ms").arg(options.deviceCount).arg(options.threadCount).arg(wall.elapsed()) << Qt::endl;
+        out << QString("memory: %1 KiB per device (%2 KiB total)")
+               .arg((residentAfter - residentBefore) / 1024.0 / options.deviceCount, 0, 'f', 1)
+               .arg((residentAfter - residentBefore) / 1024) << Qt::endl;
+        out << QString("cpu: %1 ms per device (%2 ms total)")
+               .arg((cpuAfter - cpuBefore) * 1000.0 / options.deviceCount, 0, 'f', 3)
+               .arg((cpuAfter - cpuBefore) * 1000.0, 0, 'f', 1) << Qt::endl;
+    }
+
+    if (!options.metricsPath.isEmpty() && !HeadlessMode::saveMetrics(metrics, options.metricsPath)) {
+        exitCode = 2;
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,45 @@
+#ifndef FLEETRUN_H
+#define FLEETRUN_H
+
+#include <QList>
+#include <QString>
+#include "AED.h"
+
+// Runs the same scripted rescue on many independent devices (see HeadlessDriver and DevicePool) and
+// reports what each device costs. Optionally records every session, feeds the pads from a WFDB
+// record, collects metrics, watches the workers' event loops, serves instructor consoles (the run
+// then lasts until the last console disconnects) and publishes telemetry.
+class FleetRun
+{
+public:
+    struct Options {
+        QList<AED::Rhythm> rhythms;     // presented at each analysis
+        int deviceCount;
+        int threadCount;
+        QString clockMode;              // see HeadlessMode::setClockMode()
+        double speed;
+        quint32 seed;
+        int batteryLevel;
+        double batteryTemperature;
+        double batteryAgeDays;
+        bool selfTestPassed;
+        bool childPads;
+        bool padsOnStartup;
+        int cprDepth;
+        bool verbose;                   // the driver's trace, for a single device
+        QString wfdbRecord;             // empty for the synthetic ECG
+        QString wfdbSignal;             // name or index
+        QString wfdbRhythm;             // annotation to start at, empty for the start
+        QString recordPath;             // each of these empty for off
+        QString metricsPath;
+        QString instructorName;
+        QString telemetryKey;
+        bool telemetryEcg;              // stream the ECG into it, which changes what analysis sees
+        int watchdogMsec;               // stall threshold, 0 for no watchdogs
+    };
+
+    // The result of the event loop, 2 for bad options
+    static int run(const Options &options);
+};
+
+#endif // FLEETRUN_H
@@ -0,0 +1,197 @@
+#include "headlessdriver.h"
+
+HeadlessDriver::HeadlessDriver(AED* aed, QObject *parent)
+    : QObject{parent}
+    , aed(aed)
+    , out(stdout)
+{
+    childPads = false;
+    padsOnStartup = false;
+    cprDepth = 50; // within the 40-60 "maintain depth" band
+    verbose = true;
+    done = false;
+
+    // Queued so the driver never re-enters the AED while it is still inside a protocol step
+    connect(aed, &AED::powerStateChanged, this, &HeadlessDriver::onPowerStateChanged, Qt::QueuedConnection);
+    connect(aed, &AED::toggleElectrodeStates, this, &HeadlessDriver::onElectrodeStates, Qt::QueuedConnection);
+    connect(aed, &AED::toggleRhythmOptions, this, &HeadlessDriver::onRhythmOptions, Qt::QueuedConnection);
+    connect(aed, &AED::shockButton, this, &HeadlessDriver::onShockButton, Qt::QueuedConnection);
+    connect(aed, &AED::cprButton, this, &HeadlessDriver::onCprButton, Qt::QueuedConnection);
+    connect(aed, &AED::rescueEnded, this, &HeadlessDriver::onRescueEnded, Qt::QueuedConnection);
+    connect(aed, &AED::stateChanged, this, &HeadlessDriver::onStateChanged, Qt::QueuedConnection);
+
+    connect(aed, &AED::informUser, this, &HeadlessDriver::onInformUser);
+    connect(aed, &AED::voiceText, this, &HeadlessDriver::onVoiceText);
+    connect(aed, &AED::audio, this, &HeadlessDriver::onAudio);
+    connect(aed, &AED::rhythmAnalyzed, this, &HeadlessDriver::onRhythmAnalyzed);
+}
+
+void HeadlessDriver::setRhythms(QList<AED::Rhythm> rhythms)
+{
+    this->rhythms = rhythms;
+}
+
+void HeadlessDriver::setChildPads(bool child)
+{
+    childPads = child;
+}
+
+void HeadlessDriver::setPadsOnStartup(bool attached)
+{
+    padsOnStartup = attached;
+}
+
+void HeadlessDriver::setCprDepth(int depth)
+{
+    cprDepth = depth;
+}
+
+void HeadlessDriver::setVerbose(bool verbose)
+{
+    this->verbose = verbose;
+}
+
+void HeadlessDriver::start()
+{
+    wallClock.start();
+
+    if (padsOnStartup) {
+        aed->onPadsChanged(!childPads, childPads);
+    }
+
+    // Hold the power button; the AED turns on once it has been held for 5 seconds
+    log("input", "power button pressed");
+    aed->onPowerButtonPressed();
+}
+
+AED::Rhythm HeadlessDriver::rhythmFromName(QString name)
+{
+    name = name.trimmed().toUpper();
+
+    if (name == "VF") {
+        return AED::VF;
+    }
+    else if (name == "VT") {
+        return AED::VT;
+    }
+    else if (name == "PEA" || name == "SINUS") {
+        return AED::PEA;
+    }
+    else if (name == "ASYSTOLE") {
+        return AED::Asystole;
+    }
+    else if (name == "REGULAR" || name == "NORMAL") {
+        return AED::Regular;
+    }
+    return AED::NoRhythm;
+}
+
+void HeadlessDriver::log(QString source, QString text)
+{
+    if (!verbose) {
+        return;
+    }
+
+    // Multi-line display text is flattened so every event stays on one line
+    text = text.simplified();
+    out << QString("[%1] %2: %3").arg(aed->getClock()->now() / 1000.0, 9, 'f', 3).arg(source, -7).arg(text) << Qt::endl;
+}
+
+void HeadlessDriver::onPowerStateChanged(bool on)
+{
+    if (on) {
+        log("input", "power button released");
+        aed->onPowerButtonReleased();
+    }
+}
+
+void HeadlessDriver::onElectrodeStates(bool enable)
+{
+    if (enable && !aed->isPadsAttached()) {
+        log("input", childPads ? "child pads placed" : "adult pads placed");
+        aed->onPadsChanged(!childPads, childPads);
+    }
+}
+
+void HeadlessDriver::onRhythmOptions(bool enable)
+{
+    if (!enable || done) {
+        return;
+    }
+
+    if (rhythms.isEmpty()) {
+        onRescueEnded();
+        return;
+    }
+
+    AED::Rhythm rhythm = rhythms.takeFirst();
+    log("input", "rhythm " + AED::rhythmName(rhythm));
+    aed->onRhythmSelected(rhythm);
+}
+
+void HeadlessDriver::onShockButton(bool enable)
+{
+    if (enable && !done) {
+        log("input", "shock pressed");
+        aed->onShockPressed();
+    }
+}
+
+void HeadlessDriver::onCprButton(bool enable)
+{
+    if (!enable || done) {
+        return;
+    }
+
+    log("input", QString("CPR started, depth %1").arg(cprDepth));
+    aed->onCprDepthChanged(cprDepth);
+    aed->onCprPressed();
+}
+
+void HeadlessDriver::onStateChanged(int state)
+{
+    log("state", AED::stateName(static_cast<AED::State>(state)));
+
+    // Stop CPR once the device has finished coaching
+    if (state == AED::CprDone && !done) {
+        log("input", "CPR stopped");
+        aed->onCprPressed();
+    }
+}
+
+void HeadlessDriver::onRescueEnded()
+{
+    if (done) {
+        return;
+    }
+
+    done = true;
+
+    // Stop jumping ahead once this session is over; other devices may share the thread
+    aed->getClock()->setAutoAdvance(false);
+
+    // The result line is printed even in quiet mode
+    out << QString("result: rescue ended after %1 s (%2 ms wall), %3 shock(s), battery %4%")
+        .arg(aed->getElapsedSeconds()).arg(wallClock.elapsed()).arg(aed->getShockCount()).arg(aed->getBatteryLevel()) << Qt::endl;
+    emit finished();
+}
+
+void HeadlessDriver::onInformUser(QString text)
+{
+    log("display", text);
+}
+
+void HeadlessDriver::onVoiceText(QString text)
+{
+    log("voice", text);
+}
+
+void HeadlessDriver::onAudio(QString audioFile)
+{
+    log("audio", audioFile);
+}
+
+void HeadlessDriver::onRhythmAnalyzed(bool shockable, double confidence)
+{
+    log("analyze", QString("%1, confidence %2").arg(shockable ? "shockable" : "not shockable").arg(confidence, 0, 'f', 2));
+}
@@ -0,0 +1,61 @@
+#ifndef HEADLESSDRIVER_H
+#define HEADLESSDRIVER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QList>
+#include <QTextStream>
+#include "AED.h"
+
+// Plays the role of the trainee for one AED: it answers every prompt the device raises
+// (place pads, pick the next rhythm, press shock, perform CPR) from a scripted rhythm list.
+// Inputs are delivered through queued connections, one protocol step at a time.
+class HeadlessDriver : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HeadlessDriver(AED* aed, QObject *parent = nullptr);
+
+    void setRhythms(QList<AED::Rhythm> rhythms);
+    void setChildPads(bool child);
+    void setPadsOnStartup(bool attached);
+    void setCprDepth(int depth);
+    void setVerbose(bool verbose);
+
+    static AED::Rhythm rhythmFromName(QString name);
+
+public slots:
+    void start();
+
+private:
+    AED* aed;
+    QList<AED::Rhythm> rhythms;
+    bool childPads;
+    bool padsOnStartup;
+    int cprDepth;
+    bool verbose;
+    bool done;
+    QElapsedTimer wallClock;
+    QTextStream out;
+
+    void log(QString source, QString text);
+
+private slots:
+    void onPowerStateChanged(bool on);
+    void onElectrodeStates(bool enable);
+    void onRhythmOptions(bool enable);
+    void onShockButton(bool enable);
+    void onCprButton(bool enable);
+    void onStateChanged(int state);
+    void onRescueEnded();
+    void onInformUser(QString text);
+    void onVoiceText(QString text);
+    void onAudio(QString audioFile);
+    void onRhythmAnalyzed(bool shockable, double confidence);
+
+signals:
+    void finished();
+};
+
+#endif // HEADLESSDRIVER_H
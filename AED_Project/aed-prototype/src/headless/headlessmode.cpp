@@ -0,0 +1,43 @@
+#include "headlessmode.h"
+#include <QTextStream>
+
+bool HeadlessMode::isClockMode(QString mode)
+{
+    return mode == "real" || mode == "scaled" || mode == "instant";
+}
+
+bool HeadlessMode::setClockMode(AED* aed, QString mode, double speed)
+{
+    if (mode == "real") {
+        aed->getClock()->setMode(Clock::RealTime);
+    }
+    else if (mode == "scaled") {
+        aed->getClock()->setMode(Clock::Scaled, speed);
+    }
+    else if (mode == "instant") {
+        aed->getClock()->setMode(Clock::Instant);
+        aed->getClock()->setAutoAdvance(true);
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+bool HeadlessMode::saveMetrics(const ProtocolMetrics &metrics, QString path)
+{
+    QString error;
+    if (!metrics.save(path, &error)) {
+        qCritical("metrics: cannot write %s: %s", qPrintable(path), qPrintable(error));
+        return false;
+    }
+
+    const Histogram &firstShock = metrics.getInterval(ProtocolMetrics::PowerOnToFirstShock);
+    QTextStream out(stdout);
+    out << QString("metrics: %1 sessions, first shock after %2 s (p50) / %3 s (p90), hands-off %4%, written to %5")
+           .arg(metrics.getCounter(ProtocolMetrics::Sessions))
+           .arg(firstShock.valueAtPercentile(50) / 1000.0, 0, 'f', 1)
+           .arg(firstShock.valueAtPercentile(90) / 1000.0, 0, 'f', 1)
+           .arg(metrics.getHandsOffFraction() * 100.0, 0, 'f', 1).arg(path) << Qt::endl;
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef HEADLESSMODE_H
+#define HEADLESSMODE_H
+
+#include <QString>
+#include "AED.h"
+#include "protocolmetrics.h"
+
+// What the modes of aed-headless (scripted devices, scenarios, replay) share
+class HeadlessMode
+{
+public:
+    // Clock modes by name: real, scaled or instant. Check a name before creating any devices.
+    static bool isClockMode(QString mode);
+    static bool setClockMode(AED* aed, QString mode, double speed);
+
+    // Merged metrics of every device, written for the dashboards, with a summary on stdout
+    static bool saveMetrics(const ProtocolMetrics &metrics, QString path);
+};
+
+#endif // HEADLESSMODE_H
@@ -0,0 +1,139 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QLoggingCategory>
+#include <QThread>
+#include "AED.h"
+#include "headlessdriver.h"
+#include "benchmarks.h"
+#include "fleetrun.h"
+#include "replaycheck.h"
+#include "scenariobatch.h"
+#include "telemetrywatch.h"
+
+// Runs scripted rescues against the protocol engine without any GUI, e.g.
+//   aed-headless --battery 80 VF VT PEA Asystole
+//   aed-headless --devices 1000 --quiet VF PEA Regular
+//   aed-headless --replay session.aedlog
+//   aed-headless --scenario scenarios/ --quiet
+// By default the clock runs in Instant mode, so a full rescue finishes in milliseconds.
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("aed-headless");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs the AED protocol headless from scripted inputs.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("rhythms", "Rhythms presented at each analysis: VF, VT, PEA, Asystole, Regular.", "[rhythms...]");
+
+    QCommandLineOption batteryOption("battery", "Initial battery level (0-100).", "level", "100");
+    QCommandLineOption batteryTemperatureOption("battery-temperature", "Battery temperature in degrees Celsius.", "celsius", "25");
+    QCommandLineOption batteryAgeOption("battery-age", "Age of the battery pack in days.", "days", "0");
+    QCommandLineOption batteryLifetimeOption("battery-lifetime", "Fast-forward a new pack through standby with daily self-tests and exit.");
+    QCommandLineOption recordOption("record", "Record each device's events to this file (device number appended).", "file");
+    QCommandLineOption replayOption("replay", "Replay the inputs of a recorded session and compare the steps taken.", "file");
+    QCommandLineOption scenarioOption("scenario", "Run scenario files, or every *.aedscenario in a directory, and report pass/fail.", "path");
+    QCommandLineOption metricsOption("metrics", "Write protocol timing metrics of all devices to this file (.json for JSON, else Prometheus text).", "file");
+    QCommandLineOption watchdogOption("watchdog", "Report worker event-loop stalls longer than this many milliseconds.", "msec");
+    QCommandLineOption instructorOption("instructor", "Let instructor consoles control and watch the devices over this local socket; runs until the last console disconnects.", "name");
+    QCommandLineOption telemetryOption("telemetry", "Publish every device's live state in a shared-memory segment under this key.", "key");
+    QCommandLineOption telemetryEcgOption("telemetry-ecg", "Also stream each device's ECG into the segment; analysis then classifies the streamed history, as in the GUI.");
+    QCommandLineOption telemetryWatchOption("telemetry-watch", "Sample the telemetry segment of another run under this key, print it and exit.", "key");
+    QCommandLineOption telemetrySecondsOption("telemetry-seconds", "How long --telemetry-watch samples.", "seconds", "10");
+    QCommandLineOption seedOption("seed", "Seed of the patient signal's noise.", "seed", "1");
+    QCommandLineOption recordBenchmarkOption("record-benchmark", "Time the event recorder and exit.");
+    QCommandLineOption selfTestFailOption("selftest-fail", "Make the power-on self test fail.");
+    QCommandLineOption childOption("child", "Place child pads instead of adult pads.");
+    QCommandLineOption padsOption("pads-on-startup", "Pads are already attached when the device is powered on.");
+    QCommandLineOption depthOption("cpr-depth", "CPR compression depth reported during CPR.", "depth", "50");
+    QCommandLineOption quietOption("quiet", "Only print the final result.");
+    QCommandLineOption clockOption("clock", "Clock mode: real, scaled or instant.", "mode", "instant");
+    QCommandLineOption speedOption("speed", "Speed-up factor for the scaled clock.", "factor", "10");
+    QCommandLineOption devicesOption("devices", "Number of independent devices running the script.", "count", "1");
+    QCommandLineOption threadsOption("threads", "Worker threads hosting the devices (default: one per core).", "count");
+    QCommandLineOption wfdbOption("wfdb", "Feed the pads from a WFDB record (path without extension).", "record");
+    QCommandLineOption wfdbSignalOption("wfdb-signal", "Signal of the record to play, by name or index.", "signal", "0");
+    QCommandLineOption wfdbRhythmOption("wfdb-rhythm", "Start playback at the first annotation of this rhythm, e.g. (VFL.", "label");
+    QCommandLineOption ecgBenchmarkOption("ecg-benchmark", "Time the ECG generator and shock advisory at this sample rate and exit.", "hz");
+    parser.addOptions({batteryOption, batteryTemperatureOption, batteryAgeOption, batteryLifetimeOption, selfTestFailOption, childOption, padsOption, depthOption, quietOption,
+                       clockOption, speedOption, devicesOption, threadsOption, wfdbOption, wfdbSignalOption,
+                       wfdbRhythmOption, ecgBenchmarkOption, recordOption, recordBenchmarkOption, replayOption, seedOption, scenarioOption, metricsOption,
+                       watchdogOption, instructorOption, telemetryOption, telemetryEcgOption, telemetryWatchOption, telemetrySecondsOption});
+    parser.process(a);
+
+    if (parser.isSet(recordBenchmarkOption)) {
+        Benchmarks::benchmarkRecorder();
+        return 0;
+    }
+    if (parser.isSet(batteryLifetimeOption)) {
+        Benchmarks::reportBatteryLifetime(parser.value(batteryTemperatureOption).toDouble(), parser.value(batteryAgeOption).toDouble());
+        return 0;
+    }
+    if (parser.isSet(ecgBenchmarkOption)) {
+        Benchmarks::benchmarkEcg(qMax(1, parser.value(ecgBenchmarkOption).toInt()));
+        return 0;
+    }
+    if (parser.isSet(telemetryWatchOption)) {
+        return TelemetryWatch::run(parser.value(telemetryWatchOption), qMax(1, parser.value(telemetrySecondsOption).toInt()));
+    }
+    if (parser.isSet(replayOption)) {
+        if (parser.isSet(quietOption)) {
+            QLoggingCategory::setFilterRules("default.info=false");
+        }
+        return ReplayCheck::run(parser.value(replayOption), parser.value(clockOption), parser.value(speedOption).toDouble(),
+                                parser.value(batteryTemperatureOption).toDouble(), parser.value(batteryAgeOption).toDouble(),
+                                parser.value(metricsOption));
+    }
+
+    if (parser.isSet(scenarioOption)) {
+        QLoggingCategory::setFilterRules("default.info=false");
+        int threads = parser.isSet(threadsOption) ? qMax(1, parser.value(threadsOption).toInt()) : QThread::idealThreadCount();
+        return ScenarioBatch::run(parser.values(scenarioOption), threads, parser.value(clockOption), !parser.isSet(quietOption),
+                                  parser.value(metricsOption));
+    }
+
+    QList<AED::Rhythm> rhythms;
+    for (const QString &name : parser.positionalArguments()) {
+        AED::Rhythm rhythm = HeadlessDriver::rhythmFromName(name);
+        if (rhythm == AED::NoRhythm) {
+            qCritical("unknown rhythm: %s", qPrintable(name));
+            return 2;
+        }
+        rhythms.append(rhythm);
+    }
+
+    FleetRun::Options options;
+    options.rhythms = rhythms;
+    options.deviceCount = qMax(1, parser.value(devicesOption).toInt());
+    options.threadCount = qMin(options.deviceCount, QThread::idealThreadCount());
+    if (parser.isSet(threadsOption)) {
+        options.threadCount = qMax(1, parser.value(threadsOption).toInt());
+    }
+    options.clockMode = parser.value(clockOption);
+    options.speed = parser.value(speedOption).toDouble();
+    options.seed = parser.value(seedOption).toUInt();
+    options.batteryLevel = parser.value(batteryOption).toInt();
+    options.batteryTemperature = parser.value(batteryTemperatureOption).toDouble();
+    options.batteryAgeDays = parser.value(batteryAgeOption).toDouble();
+    options.selfTestPassed = !parser.isSet(selfTestFailOption);
+    options.childPads = parser.isSet(childOption);
+    options.padsOnStartup = parser.isSet(padsOption);
+    options.cprDepth = parser.value(depthOption).toInt();
+    options.wfdbRecord = parser.value(wfdbOption);
+    options.wfdbSignal = parser.value(wfdbSignalOption);
+    options.wfdbRhythm = parser.value(wfdbRhythmOption);
+    options.recordPath = parser.value(recordOption);
+    options.metricsPath = parser.value(metricsOption);
+    options.watchdogMsec = parser.isSet(watchdogOption) ? qMax(1, parser.value(watchdogOption).toInt()) : 0;
+    options.instructorName = parser.value(instructorOption);
+    options.telemetryKey = parser.value(telemetryOption);
+    options.telemetryEcg = parser.isSet(telemetryOption) && parser.isSet(telemetryEcgOption);
+
+    // Per-device trace output only makes sense for a single device
+    options.verbose = options.deviceCount == 1 && !parser.isSet(quietOption);
+    if (!options.verbose) {
+        QLoggingCategory::setFilterRules("default.info=false");
+    }
+
+    return FleetRun::run(options);
+}
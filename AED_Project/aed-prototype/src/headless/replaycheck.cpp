@@ -0,0 +1,44 @@
+#include "replaycheck.h"
+#include <QCoreApplication>
+#include <QTextStream>
+#include "AED.h"
+#include "sessionreplay.h"
+#include "metricscollector.h"
+#include "headlessmode.h"
+
+int ReplayCheck::run(QString path, QString clockMode, double speed, double temperature, double ageDays,
+                     QString metricsPath)
+{
+    AED aed;
+    if (!HeadlessMode::setClockMode(&aed, clockMode, speed)) {
+        qCritical("unknown clock mode: %s", qPrintable(clockMode));
+        return 2;
+    }
+    aed.getBattery()->setTemperature(temperature);
+    aed.getBattery()->setAgeDays(ageDays);
+
+    SessionReplay* replay = new SessionReplay(&aed);
+    if (!replay->load(path)) {
+        qCritical("replay: %s: %s", qPrintable(path), qPrintable(replay->getError()));
+        return 2;
+    }
+    aed.setSeed(replay->getSeed());
+    if (!replay->restoreEcg()) {
+        qCritical("replay: %s: %s", qPrintable(path), qPrintable(replay->getError()));
+        return 2;
+    }
+    MetricsCollector* collector = new MetricsCollector(&aed);
+
+    QObject::connect(replay, &SessionReplay::finished, QCoreApplication::instance(), &QCoreApplication::quit, Qt::QueuedConnection);
+    QMetaObject::invokeMethod(replay, &SessionReplay::start, Qt::QueuedConnection);
+    QCoreApplication::exec();
+
+    SessionReplay::Report report = replay->getReport();
+    QTextStream out(stdout);
+    out << QString("replay: %1").arg(SessionReplay::reportText(report)) << Qt::endl;
+    if (!metricsPath.isEmpty()) {
+        collector->endSession();
+        HeadlessMode::saveMetrics(collector->getMetrics(), metricsPath);
+    }
+    return report.firstDifference < 0 ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+#ifndef REPLAYCHECK_H
+#define REPLAYCHECK_H
+
+#include <QString>
+
+// Replays the inputs of a recorded session into a new device and compares its steps with the
+// recording (see SessionReplay)
+class ReplayCheck
+{
+public:
+    // 0 when the device took the recorded steps, 1 when it diverged, 2 when it could not run
+    static int run(QString path, QString clockMode, double speed, double temperature, double ageDays,
+                   QString metricsPath);
+};
+
+#endif // REPLAYCHECK_H
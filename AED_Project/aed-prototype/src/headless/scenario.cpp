@@ -0,0 +1,330 @@
+#include "scenario.h"
+#include "AED.h"
+#include "headlessdriver.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+
+namespace {
+
+// Actions and the argument each one takes
+enum Argument {
+    NoArgument,
+    PadsArgument,
+    RhythmArgument,
+    NumberArgument
+};
+
+struct ActionInfo {
+    const char* keyword;
+    Scenario::Kind kind;
+    Argument argument;
+};
+
+const ActionInfo ACTIONS[] = {
+    { "power",          Scenario::Power,        NoArgument },
+    { "pads",           Scenario::Pads,         PadsArgument },
+    { "remove-pads",    Scenario::RemovePads,   NoArgument },
+    { "battery-out",    Scenario::BatteryOut,   NoArgument },
+    { "battery-in",     Scenario::BatteryIn,    NoArgument },
+    { "rhythm",         Scenario::Rhythm,       RhythmArgument },
+    { "shock",          Scenario::Shock,        NoArgument },
+    { "cpr",            Scenario::Cpr,          NoArgument },
+    { "cpr-depth",      Scenario::CprDepth,     NumberArgument },
+    { "wait",           Scenario::Wait,         NoArgument },
+};
+
+// "1500", "1500ms" or "1.5s"
+bool parseMsec(QString text, int &msec)
+{
+    bool ok;
+    double scale = 1.0;
+    if (text.endsWith("ms")) {
+        text.chop(2);
+    }
+    else if (text.endsWith("s")) {
+        text.chop(1);
+        scale = 1000.0;
+    }
+    double value = text.toDouble(&ok);
+    if (!ok || value < 0) {
+        return false;
+    }
+    msec = qRound(value * scale);
+    return true;
+}
+
+int findState(const QString &name)
+{
+    for (int state = 0; state < AED::StateCount; state++) {
+        if (AED::stateName(AED::State(state)).compare(name, Qt::CaseInsensitive) == 0) {
+            return state;
+        }
+    }
+    return -1;
+}
+
+}
+
+Scenario::Scenario()
+{
+    batteryLevel = 100;
+    batteryTemperature = 25.0;
+    batteryAgeDays = 0.0;
+    selfTestPassed = true;
+    seed = 1;
+}
+
+bool Scenario::load(QString path)
+{
+    this->path = path;
+    name = QFileInfo(path).completeBaseName();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        error = QString("%1: %2").arg(path, file.errorString());
+        return false;
+    }
+    return parse(QString::fromUtf8(file.readAll()));
+}
+
+bool Scenario::parse(const QString &text)
+{
+    steps.clear();
+
+    const QStringList lines = text.split('\n');
+    for (int i = 0; i < lines.size(); i++) {
+        int line = i + 1;
+        QString content = lines[i];
+        int comment = content.indexOf('#');
+        if (comment >= 0) {
+            content = content.left(comment);
+        }
+        QStringList words = content.simplified().split(' ', Qt::SkipEmptyParts);
+        if (words.isEmpty()) {
+            continue;
+        }
+
+        // Timing options come last, in any order
+        Step step;
+        step.line = line;
+        step.value = 0;
+        step.afterMsec = 0;
+        step.withinMsec = DefaultWithinMsec;
+        while (words.size() >= 3 && (words[words.size() - 2] == "after" || words[words.size() - 2] == "within")) {
+            int msec;
+            if (!parseMsec(words.last(), msec)) {
+                return fail(line, QString("bad time '%1'").arg(words.last()));
+            }
+            if (words[words.size() - 2] == "after") {
+                step.afterMsec = msec;
+            }
+            else {
+                step.withinMsec = msec;
+            }
+            words.removeLast();
+            words.removeLast();
+        }
+
+        QString keyword = words.takeFirst().toLower();
+        QString argument = words.join(' ');
+        bool ok = true;
+
+        // Setup
+        if (keyword == "name") {
+            name = argument;
+            continue;
+        }
+        if (keyword == "battery") {
+            batteryLevel = argument.toInt(&ok);
+            if (!ok || batteryLevel < 0 || batteryLevel > 100) {
+                return fail(line, "battery level must be 0-100");
+            }
+            continue;
+        }
+        if (keyword == "battery-temperature" || keyword == "battery-age") {
+            double value = argument.toDouble(&ok);
+            if (!ok) {
+                return fail(line, QString("%1 needs a number").arg(keyword));
+            }
+            (keyword == "battery-age" ? batteryAgeDays : batteryTemperature) = value;
+            continue;
+        }
+        if (keyword == "selftest") {
+            if (argument != "pass" && argument != "fail") {
+                return fail(line, "selftest must be pass or fail");
+            }
+            selfTestPassed = argument == "pass";
+            continue;
+        }
+        if (keyword == "seed") {
+            seed = argument.toUInt(&ok);
+            if (!ok) {
+                return fail(line, "seed must be a number");
+            }
+            continue;
+        }
+
+        // Expectations
+        if (keyword == "expect") {
+            QString what = words.isEmpty() ? QString() : words.takeFirst().toLower();
+            argument = words.join(' ');
+            if (what == "state") {
+                step.kind = ExpectState;
+                step.value = findState(argument);
+                if (step.value < 0) {
+                    return fail(line, QString("unknown state '%1'").arg(argument));
+                }
+            }
+            else if (what == "prompt") {
+                step.kind = ExpectPrompt;
+                step.text = argument;
+                if (step.text.startsWith('"') && step.text.endsWith('"') && step.text.size() >= 2) {
+                    step.text = step.text.mid(1, step.text.size() - 2);
+                }
+                if (step.text.isEmpty()) {
+                    return fail(line, "expect prompt needs the text");
+                }
+            }
+            else if (what == "shocks") {
+                step.kind = ExpectShocks;
+                step.value = argument.toInt(&ok);
+                if (!ok) {
+                    return fail(line, "expect shocks needs a count");
+                }
+            }
+            else if (what == "shockable" || what == "not-shockable") {
+                step.kind = ExpectAnalysis;
+                step.value = what == "shockable";
+            }
+            else {
+                return fail(line, QString("unknown expectation '%1'").arg(what));
+            }
+            steps.append(step);
+            continue;
+        }
+
+        // Trainee actions
+        const ActionInfo* action = nullptr;
+        for (const ActionInfo &info : ACTIONS) {
+            if (keyword == info.keyword) {
+                action = &info;
+                break;
+            }
+        }
+        if (action == nullptr) {
+            return fail(line, QString("unknown step '%1'").arg(keyword));
+        }
+
+        step.kind = action->kind;
+        switch (action->argument) {
+        case NoArgument:
+            ok = argument.isEmpty();
+            break;
+        case PadsArgument:
+            ok = argument.isEmpty() || argument == "adult" || argument == "child";
+            step.value = argument == "child";
+            break;
+        case RhythmArgument:
+            step.value = HeadlessDriver::rhythmFromName(argument);
+            ok = step.value != AED::NoRhythm;
+            break;
+        case NumberArgument:
+            step.value = argument.toInt(&ok);
+            break;
+        }
+        if (!ok) {
+            return fail(line, QString("bad argument '%1' for %2").arg(argument, keyword));
+        }
+        steps.append(step);
+    }
+
+    if (steps.isEmpty()) {
+        return fail(lines.size(), "no steps");
+    }
+    return true;
+}
+
+bool Scenario::fail(int line, QString message)
+{
+    error = QString("%1:%2: %3").arg(path).arg(line).arg(message);
+    return false;
+}
+
+QString Scenario::getError()
+{
+    return error;
+}
+
+QString Scenario::getPath()
+{
+    return path;
+}
+
+QString Scenario::getName()
+{
+    return name;
+}
+
+int Scenario::getBatteryLevel()
+{
+    return batteryLevel;
+}
+
+double Scenario::getBatteryTemperature()
+{
+    return batteryTemperature;
+}
+
+double Scenario::getBatteryAgeDays()
+{
+    return batteryAgeDays;
+}
+
+bool Scenario::getSelfTestPassed()
+{
+    return selfTestPassed;
+}
+
+quint32 Scenario::getSeed()
+{
+    return seed;
+}
+
+const QVector<Scenario::Step>& Scenario::getSteps()
+{
+    return steps;
+}
+
+bool Scenario::isExpectation(const Step &step)
+{
+    return step.kind >= ExpectState;
+}
+
+QString Scenario::stepLabel(const Step &step)
+{
+    switch (step.kind) {
+    case Pads:
+        return step.value ? "pads child" : "pads adult";
+    case Rhythm:
+        return "rhythm " + AED::rhythmName(AED::Rhythm(step.value));
+    case CprDepth:
+        return QString("cpr-depth %1").arg(step.value);
+    case ExpectState:
+        return "expect state " + AED::stateName(AED::State(step.value));
+    case ExpectPrompt:
+        return "expect prompt " + step.text;
+    case ExpectShocks:
+        return QString("expect shocks %1").arg(step.value);
+    case ExpectAnalysis:
+        return step.value ? "expect shockable" : "expect not-shockable";
+    default:
+        break;
+    }
+    for (const ActionInfo &info : ACTIONS) {
+        if (info.kind == step.kind) {
+            return info.keyword;
+        }
+    }
+    return QString();
+}
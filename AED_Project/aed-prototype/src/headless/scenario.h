@@ -0,0 +1,96 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <QString>
+#include <QVector>
+
+// A training scenario: the device's setup, what the trainee does and what the device must say, e.g.
+//
+//   # VF, shock, CPR, then VT, shock, sinus
+//   battery 80
+//   power
+//   pads adult after 3s
+//   rhythm VF
+//   expect prompt SHOCK ADVISED within 8s
+//   shock after 1500
+//   cpr after 2s
+//   expect state CprDone within 20s
+//   cpr
+//   rhythm VT
+//   ...
+//
+// One step per line, '#' starts a comment. Trainee actions wait until the device asks for them
+// (pads, rhythm, shock and CPR only when the device enables them) and are then performed `after`
+// that long; expectations must be met `within` that long of the previous step. Times are device
+// time in milliseconds, or seconds with an 's' suffix.
+//
+// Setup:        name <text>, battery <level>, battery-temperature <celsius>, battery-age <days>,
+//               selftest pass|fail, seed <n>
+// Actions:      power, pads adult|child, remove-pads, battery-out, battery-in, rhythm <name>, shock,
+//               cpr, cpr-depth <mm>, wait
+// Expectations: expect state <State>, expect prompt <text>, expect shocks <count>,
+//               expect shockable, expect not-shockable
+class Scenario
+{
+public:
+    enum Kind {
+        Power,
+        Pads,                   // value: child
+        RemovePads,
+        BatteryOut,
+        BatteryIn,
+        Rhythm,                 // value: AED::Rhythm
+        Shock,
+        Cpr,
+        CprDepth,               // value: depth
+        Wait,
+        ExpectState,            // value: AED::State
+        ExpectPrompt,           // text, matched case-insensitively against the display and the voice
+        ExpectShocks,           // value: shock count
+        ExpectAnalysis          // value: shockable
+    };
+
+    struct Step {
+        Kind kind;
+        int line;
+        int value;
+        QString text;
+        int afterMsec;
+        int withinMsec;
+    };
+
+    static const int DefaultWithinMsec = 60000;
+
+    Scenario();
+
+    bool load(QString path);
+    bool parse(const QString &text);
+    QString getError();         // file:line: message
+
+    QString getPath();
+    QString getName();
+    int getBatteryLevel();
+    double getBatteryTemperature();
+    double getBatteryAgeDays();
+    bool getSelfTestPassed();
+    quint32 getSeed();
+    const QVector<Step>& getSteps();
+
+    static bool isExpectation(const Step &step);
+    static QString stepLabel(const Step &step);     // e.g. "rhythm VF", "expect state ShockReady"
+
+private:
+    QString path;
+    QString name;
+    QString error;
+    int batteryLevel;
+    double batteryTemperature;
+    double batteryAgeDays;
+    bool selfTestPassed;
+    quint32 seed;
+    QVector<Step> steps;
+
+    bool fail(int line, QString message);
+};
+
+#endif // SCENARIO_H
@@ -0,0 +1,146 @@
+#include "scenariobatch.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QMap>
+#include <QTextStream>
+#include "devicepool.h"
+#include "metricscollector.h"
+#include "headlessmode.h"
+#include "scenario.h"
+#include "scenariorunner.h"
+#include <algorithm>
+
+QStringList ScenarioBatch::findScenarios(const QStringList &paths)
+{
+    QStringList files;
+    for (const QString &path : paths) {
+        if (!QFileInfo(path).isDir()) {
+            files.append(path);
+            continue;
+        }
+        QStringList found;
+        QDirIterator it(path, QStringList() << "*.aedscenario", QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            found.append(it.next());
+        }
+        found.sort();
+        files += found;
+    }
+    return files;
+}
+
+int ScenarioBatch::run(const QStringList &paths, int threadCount, QString clockMode, bool verbose, QString metricsPath)
+{
+    QTextStream out(stdout);
+    const int wavePerThread = 64;
+
+    // Checked before anything is loaded, so no wave has to be abandoned for it
+    if (!HeadlessMode::isClockMode(clockMode)) {
+        qCritical("unknown clock mode: %s", qPrintable(clockMode));
+        return 2;
+    }
+
+    QStringList files = findScenarios(paths);
+    QList<Scenario*> scenarios;
+    int failed = 0;
+    for (const QString &file : files) {
+        Scenario* scenario = new Scenario;
+        if (scenario->load(file)) {
+            scenarios.append(scenario);
+        }
+        else {
+            out << QString("FAIL %1").arg(scenario->getError()) << Qt::endl;
+            failed++;
+            delete scenario;
+        }
+    }
+
+    QMap<QString, QVector<qint64>> latencies;
+    ProtocolMetrics metrics;
+    qint64 deviceMsec = 0;
+    int passed = 0;
+    QElapsedTimer wall;
+    wall.start();
+
+    for (int first = 0; first < scenarios.size(); first += threadCount * wavePerThread) {
+        QList<Scenario*> wave = scenarios.mid(first, threadCount * wavePerThread);
+        QList<ScenarioRunner*> runners;
+        QList<MetricsCollector*> collectors;
+        QEventLoop loop;
+        int running = wave.size();
+
+        DevicePool pool(threadCount);
+        for (Scenario* scenario : wave) {
+            AED* aed = pool.createDevice();
+            HeadlessMode::setClockMode(aed, clockMode, 1.0);
+            aed->setSeed(scenario->getSeed());
+            aed->getBattery()->setTemperature(scenario->getBatteryTemperature());
+            aed->getBattery()->setAgeDays(scenario->getBatteryAgeDays());
+            aed->onChangeBatteryLevel(scenario->getBatteryLevel());
+            aed->onSelfTestChanged(scenario->getSelfTestPassed());
+
+            // A child of the device, so it moves to the device's worker with it
+            ScenarioRunner* runner = new ScenarioRunner(aed, scenario, aed);
+            runners.append(runner);
+            collectors.append(new MetricsCollector(aed));
+            QObject::connect(runner, &ScenarioRunner::finished, &loop, [&running, &loop]() {
+                if (--running == 0) {
+                    loop.quit();
+                }
+            }, Qt::QueuedConnection);
+        }
+
+        pool.start();
+        for (ScenarioRunner* runner : runners) {
+            QMetaObject::invokeMethod(runner, &ScenarioRunner::start, Qt::QueuedConnection);
+        }
+        loop.exec();
+        pool.stop();
+
+        for (MetricsCollector* collector : collectors) {
+            metrics.merge(collector->getMetrics());
+        }
+        for (int i = 0; i < wave.size(); i++) {
+            ScenarioRunner::Result result = runners[i]->getResult();
+            const QVector<Scenario::Step> &steps = wave[i]->getSteps();
+            for (int s = 0; s < result.stepMsec.size(); s++) {
+                latencies[Scenario::stepLabel(steps[s])].append(result.stepMsec[s]);
+            }
+            deviceMsec += result.deviceMsec;
+
+            if (result.passed) {
+                passed++;
+                if (verbose) {
+                    out << QString("PASS %1 (%2 steps, %3 s device, %4 ms wall)").arg(wave[i]->getName())
+                           .arg(steps.size()).arg(result.deviceMsec / 1000.0, 0, 'f', 1)
+                           .arg(result.wallNsec / 1e6, 0, 'f', 2) << Qt::endl;
+                }
+            }
+            else {
+                failed++;
+                out << QString("FAIL %1").arg(result.failure) << Qt::endl;
+            }
+        }
+    }
+    qint64 wallMsec = wall.elapsed();
+    qDeleteAll(scenarios);
+
+    out << QString("scenarios: %1 passed, %2 failed, %3 h of device time in %4 ms on %5 thread(s)")
+           .arg(passed).arg(failed).arg(deviceMsec / 3600000.0, 0, 'f', 2).arg(wallMsec).arg(threadCount) << Qt::endl;
+    out << QString("%1 %2 %3 %4 %5").arg("step latency (device ms)", -40).arg("count", 7).arg("p50", 8)
+           .arg("p95", 8).arg("max", 8) << Qt::endl;
+    for (auto it = latencies.begin(); it != latencies.end(); ++it) {
+        QVector<qint64> &values = it.value();
+        std::sort(values.begin(), values.end());
+        out << QString("%1 %2 %3 %4 %5").arg(it.key().left(40), -40).arg(values.size(), 7)
+               .arg(values[values.size() / 2], 8).arg(values[(values.size() * 95) / 100], 8)
+               .arg(values.last(), 8) << Qt::endl;
+    }
+    if (!metricsPath.isEmpty()) {
+        HeadlessMode::saveMetrics(metrics, metricsPath);
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+#ifndef SCENARIOBATCH_H
+#define SCENARIOBATCH_H
+
+#include <QString>
+#include <QStringList>
+
+// Runs a corpus of scenario files, each on its own device (see ScenarioRunner), spread over the
+// worker threads in waves so memory stays bounded however large the corpus is. Reports pass/fail
+// and the device time each step took.
+class ScenarioBatch
+{
+public:
+    // Scenario files named on the command line, directories searched for *.aedscenario
+    static QStringList findScenarios(const QStringList &paths);
+
+    // 0 when every scenario passed, 1 when one failed, 2 for bad options
+    static int run(const QStringList &paths, int threadCount, QString clockMode, bool verbose, QString metricsPath);
+};
+
+#endif // SCENARIOBATCH_H
@@ -0,0 +1,260 @@
+#include "scenariorunner.h"
+
+ScenarioRunner::ScenarioRunner(AED* aed, Scenario* scenario, QObject *parent)
+    : QObject{parent}
+{
+    this->aed = aed;
+    this->scenario = scenario;
+    cursor = 0;
+    current = 0;
+    stepStartMsec = 0;
+    readyMsec = -1;
+    advancePending = false;
+    done = false;
+    padsRequested = false;
+    rhythmRequested = false;
+    shockEnabled = false;
+    cprEnabled = false;
+    powerHeld = false;
+    result = {};
+
+    timer = new ClockTimer(aed->getClock(), this);
+    timer->setSingleShot(true);
+    connect(timer, &ClockTimer::timeout, this, &ScenarioRunner::advance);
+
+    // Outputs are noted as they happen, the reaction comes later from advance()
+    connect(aed, &AED::stateChanged, this, [this](int state) { addOutput(StateOutput, state); });
+    connect(aed, &AED::informUser, this, [this](QString text) { addOutput(PromptOutput, 0, text); });
+    connect(aed, &AED::voiceText, this, [this](QString text) { addOutput(PromptOutput, 0, text); });
+    connect(aed, &AED::updateShockCount, this, [this](int count) { addOutput(ShockOutput, count); });
+    connect(aed, &AED::rhythmAnalyzed, this, [this](bool shockable) { addOutput(AnalysisOutput, shockable); });
+    connect(aed, &AED::toggleElectrodeStates, this, [this](bool enable) {
+        padsRequested = enable;
+        requestAdvance();
+    });
+    connect(aed, &AED::toggleRhythmOptions, this, [this](bool enable) {
+        rhythmRequested = enable;
+        requestAdvance();
+    });
+    connect(aed, &AED::shockButton, this, [this](bool enable) {
+        shockEnabled = enable;
+        requestAdvance();
+    });
+    connect(aed, &AED::cprButton, this, [this](bool enable) {
+        cprEnabled = enable;
+        requestAdvance();
+    });
+    connect(aed, &AED::powerStateChanged, this, &ScenarioRunner::onPowerStateChanged, Qt::QueuedConnection);
+}
+
+ScenarioRunner::Result ScenarioRunner::getResult()
+{
+    return result;
+}
+
+void ScenarioRunner::start()
+{
+    wall.start();
+    stepStartMsec = aed->getClock()->now();
+    advance();
+}
+
+void ScenarioRunner::addOutput(OutputKind kind, int value, const QString &text)
+{
+    if (done) {
+        return;
+    }
+    Output output;
+    output.kind = kind;
+    output.deviceMsec = aed->getClock()->now();
+    output.value = value;
+    output.text = text;
+    history.append(output);
+    requestAdvance();
+}
+
+void ScenarioRunner::requestAdvance()
+{
+    if (!advancePending && !done) {
+        advancePending = true;
+        QMetaObject::invokeMethod(this, "advance", Qt::QueuedConnection);
+    }
+}
+
+void ScenarioRunner::advance()
+{
+    advancePending = false;
+    const QVector<Scenario::Step> &steps = scenario->getSteps();
+
+    while (!done && current < steps.size()) {
+        const Scenario::Step &step = steps[current];
+        qint64 now = aed->getClock()->now();
+
+        if (Scenario::isExpectation(step)) {
+            int match = findOutput(step);
+            if (match < 0) {
+                qint64 deadline = stepStartMsec + step.withinMsec;
+                if (now >= deadline) {
+                    finish(false, QString("%1:%2: %3 not seen within %4 ms").arg(scenario->getPath()).arg(step.line)
+                           .arg(Scenario::stepLabel(step)).arg(step.withinMsec));
+                    return;
+                }
+                timer->start(int(deadline - now));
+                return;
+            }
+            cursor = match + 1;
+            completeStep(history[match].deviceMsec);
+            continue;
+        }
+
+        if (readyMsec < 0) {
+            if (!isReady(step)) {
+                qint64 deadline = stepStartMsec + step.withinMsec;
+                if (now >= deadline) {
+                    finish(false, QString("%1:%2: device did not ask for %3 within %4 ms").arg(scenario->getPath())
+                           .arg(step.line).arg(Scenario::stepLabel(step)).arg(step.withinMsec));
+                    return;
+                }
+                timer->start(int(deadline - now));
+                return;
+            }
+            readyMsec = now;
+        }
+
+        // The trainee takes this long to react
+        if (now < readyMsec + step.afterMsec) {
+            timer->start(int(readyMsec + step.afterMsec - now));
+            return;
+        }
+
+        qint64 asked = readyMsec;
+        readyMsec = -1;
+        cursor = history.size();
+        perform(step);
+        completeStep(asked);
+    }
+
+    if (!done) {
+        finish(true);
+    }
+}
+
+bool ScenarioRunner::isReady(const Scenario::Step &step)
+{
+    switch (step.kind) {
+    case Scenario::Pads:
+        // Pads can always be put on before the device is switched on, or when it reports them off
+        return padsRequested || !aed->getPowerState() || aed->getState() == AED::PadsDisconnected;
+    case Scenario::Rhythm:
+        return rhythmRequested;
+    case Scenario::Shock:
+        return shockEnabled;
+    case Scenario::Cpr:
+        return cprEnabled;
+    default:
+        return true;
+    }
+}
+
+void ScenarioRunner::perform(const Scenario::Step &step)
+{
+    switch (step.kind) {
+    case Scenario::Power:
+        // Released again once the power state changes
+        powerHeld = true;
+        aed->onPowerButtonPressed();
+        break;
+    case Scenario::Pads:
+        padsRequested = false;
+        aed->onPadsChanged(!step.value, step.value);
+        break;
+    case Scenario::RemovePads:
+        aed->onPadsChanged(false, false);
+        break;
+    case Scenario::BatteryOut:
+        aed->onBatteryConnected(false);
+        break;
+    case Scenario::BatteryIn:
+        aed->onBatteryConnected(true);
+        break;
+    case Scenario::Rhythm:
+        rhythmRequested = false;
+        aed->onRhythmSelected(step.value);
+        break;
+    case Scenario::Shock:
+        shockEnabled = false;
+        aed->onShockPressed();
+        break;
+    case Scenario::Cpr:
+        aed->onCprPressed();
+        break;
+    case Scenario::CprDepth:
+        aed->onCprDepthChanged(step.value);
+        break;
+    default:
+        break;
+    }
+}
+
+int ScenarioRunner::findOutput(const Scenario::Step &step)
+{
+    for (int i = cursor; i < history.size(); i++) {
+        const Output &output = history[i];
+        switch (step.kind) {
+        case Scenario::ExpectState:
+            if (output.kind == StateOutput && output.value == step.value) {
+                return i;
+            }
+            break;
+        case Scenario::ExpectPrompt:
+            if (output.kind == PromptOutput && output.text.simplified().contains(step.text, Qt::CaseInsensitive)) {
+                return i;
+            }
+            break;
+        case Scenario::ExpectShocks:
+            if (output.kind == ShockOutput && output.value == step.value) {
+                return i;
+            }
+            break;
+        case Scenario::ExpectAnalysis:
+            if (output.kind == AnalysisOutput && output.value == step.value) {
+                return i;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return -1;
+}
+
+void ScenarioRunner::completeStep(qint64 msec)
+{
+    result.stepMsec.append(qMax(qint64(0), msec - stepStartMsec));
+    stepStartMsec = aed->getClock()->now();
+    current++;
+}
+
+void ScenarioRunner::onPowerStateChanged(bool on)
+{
+    Q_UNUSED(on);
+    if (powerHeld) {
+        powerHeld = false;
+        aed->onPowerButtonReleased();
+    }
+}
+
+void ScenarioRunner::finish(bool passed, QString failure)
+{
+    done = true;
+    timer->stop();
+    result.passed = passed;
+    result.failure = failure;
+    result.deviceMsec = aed->getClock()->now();
+    result.wallNsec = wall.nsecsElapsed();
+
+    // Nothing else to check; stop the device so its thread is free for the next scenario
+    aed->shutDownDevice();
+    aed->getClock()->setAutoAdvance(false);
+    emit finished();
+}
@@ -0,0 +1,89 @@
+#ifndef SCENARIORUNNER_H
+#define SCENARIORUNNER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QVector>
+#include "AED.h"
+#include "scenario.h"
+
+// Plays one Scenario against one AED, as the trainee, and checks the device's outputs.
+// Every output is appended to a history as it is emitted; steps only run from queued calls, so the
+// runner never re-enters the AED while it is inside a protocol step. An expectation searches the
+// history from where the previous expectation matched or the previous action was performed.
+// The latency of a step is the device time from the end of the previous step until the device asked
+// for the action or produced the expected output.
+class ScenarioRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Result {
+        bool passed;
+        QString failure;            // file:line: what did not happen
+        QVector<qint64> stepMsec;   // latency of every completed step
+        qint64 deviceMsec;
+        qint64 wallNsec;
+    };
+
+    // Neither is owned; the scenario must outlive the runner
+    ScenarioRunner(AED* aed, Scenario* scenario, QObject *parent = nullptr);
+
+    Result getResult();
+
+public slots:
+    void start();
+
+signals:
+    void finished();
+
+private:
+    enum OutputKind {
+        StateOutput,
+        PromptOutput,
+        ShockOutput,
+        AnalysisOutput
+    };
+
+    struct Output {
+        OutputKind kind;
+        qint64 deviceMsec;
+        int value;
+        QString text;
+    };
+
+    AED* aed;
+    Scenario* scenario;
+    ClockTimer* timer;
+    QVector<Output> history;
+    int cursor;                 // first output an expectation may match
+    int current;                // step being played
+    qint64 stepStartMsec;       // when the previous step ended
+    qint64 readyMsec;           // when the device asked for the current action, -1 until then
+    bool advancePending;
+    bool done;
+
+    // What the device currently asks the trainee for
+    bool padsRequested;
+    bool rhythmRequested;
+    bool shockEnabled;
+    bool cprEnabled;
+    bool powerHeld;
+
+    QElapsedTimer wall;
+    Result result;
+
+    void addOutput(OutputKind kind, int value, const QString &text = QString());
+    void requestAdvance();
+    bool isReady(const Scenario::Step &step);
+    void perform(const Scenario::Step &step);
+    int findOutput(const Scenario::Step &step);
+    void completeStep(qint64 msec);
+    void finish(bool passed, QString failure = QString());
+
+private slots:
+    void advance();
+    void onPowerStateChanged(bool on);
+};
+
+#endif // SCENARIORUNNER_H
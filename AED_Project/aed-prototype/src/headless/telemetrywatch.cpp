@@ -0,0 +1,59 @@
+#include "telemetrywatch.h"
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include "AED.h"
+#include "telemetryexport.h"
+
+int TelemetryWatch::run(QString key, int seconds, int pollUsec)
+{
+    TelemetryExport telemetry;
+    if (!telemetry.open(key)) {
+        qCritical("telemetry: cannot open %s: %s", qPrintable(key), qPrintable(telemetry.getError()));
+        return 2;
+    }
+
+    int devices = telemetry.getDeviceCount();
+    QVector<TelemetryExport::State> states(devices);
+    QVector<quint64> ecgFrom(devices, 0);
+    QVector<float> samples;
+    QTextStream out(stdout);
+    QElapsedTimer elapsed;
+    elapsed.start();
+    qint64 nextReport = 1000;
+    qint64 polls = 0;
+    qint64 busy = 0;
+    qint64 sampleCount = 0;
+    qint64 readNsec = 0;
+    while (elapsed.elapsed() < qint64(seconds) * 1000) {
+        qint64 start = elapsed.nsecsElapsed();
+        for (int i = 0; i < devices; i++) {
+            if (!telemetry.read(i, states[i])) {
+                busy++;
+            }
+            samples.clear();
+            sampleCount += telemetry.readEcg(i, ecgFrom[i], samples);
+        }
+        readNsec += elapsed.nsecsElapsed() - start;
+        polls++;
+
+        if (elapsed.elapsed() >= nextReport) {
+            for (int i = 0; i < devices; i++) {
+                const TelemetryExport::State &state = states[i];
+                out << QString("device %1: %2, power %3, pads %4, battery %5%, %6 shock(s), %7 s, lights %8, \"%9\"")
+                       .arg(i).arg(AED::stateName(AED::State(state.state))).arg(state.powerState)
+                       .arg(state.padsConnected).arg(state.batteryLevel).arg(state.shockCount)
+                       .arg(state.elapsedSeconds).arg(state.lights, 6, 2, QChar('0'))
+                       .arg(TelemetryExport::text(state.voiceText).simplified()) << Qt::endl;
+            }
+            nextReport += 1000;
+        }
+        QThread::usleep(pollUsec);
+    }
+
+    out << QString("telemetry: %1 polls of %2 device(s) in %3 s, %4 busy reads, %5 ECG samples, %6 ns per device read")
+           .arg(polls).arg(devices).arg(seconds).arg(busy).arg(sampleCount)
+           .arg(polls * devices > 0 ? double(readNsec) / (polls * devices) : 0.0, 0, 'f', 0) << Qt::endl;
+    return 0;
+}
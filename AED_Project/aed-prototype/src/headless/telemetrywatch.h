@@ -0,0 +1,16 @@
+#ifndef TELEMETRYWATCH_H
+#define TELEMETRYWATCH_H
+
+#include <QString>
+
+// Samples the telemetry segment of another run the way a dashboard would (see TelemetryExport):
+// for a fixed time it polls every device's state and new ECG samples, prints each device once a
+// second, then reports what the reads cost. A read is a plain copy out of the mapped segment; only
+// the pacing between polls sleeps.
+class TelemetryWatch
+{
+public:
+    static int run(QString key, int seconds, int pollUsec = 1000);
+};
+
+#endif // TELEMETRYWATCH_H
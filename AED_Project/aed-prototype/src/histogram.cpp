@@ -0,0 +1,142 @@
+#include "histogram.h"
+#include <QtAlgorithms>
+#include <QtMath>
+
+Histogram::Histogram()
+{
+    count = 0;
+    sum = 0;
+    min = 0;
+    max = 0;
+}
+
+int Histogram::indexOf(qint64 value)
+{
+    if (value < SubBucketCount) {
+        return int(value);
+    }
+
+    // Above the first bucket, each power of two is split into SubBucketHalf equal parts
+    int msb = 63 - qCountLeadingZeroBits(quint64(value));
+    int shift = msb - (SubBucketBits - 1);
+    return SubBucketCount + (shift - 1) * SubBucketHalf + int((value >> shift) - SubBucketHalf);
+}
+
+qint64 Histogram::lowestValue(int index)
+{
+    if (index < SubBucketCount) {
+        return index;
+    }
+    int offset = index - SubBucketCount;
+    int shift = offset / SubBucketHalf + 1;
+    return qint64(offset % SubBucketHalf + SubBucketHalf) << shift;
+}
+
+qint64 Histogram::highestValue(int index)
+{
+    if (index < SubBucketCount) {
+        return index;
+    }
+    int shift = (index - SubBucketCount) / SubBucketHalf + 1;
+    return lowestValue(index) + (qint64(1) << shift) - 1;
+}
+
+void Histogram::record(qint64 value)
+{
+    value = qBound(qint64(0), value, (qint64(1) << MaxValueBits) - 1);
+    if (counts.isEmpty()) {
+        counts.resize(BucketCount);
+    }
+
+    counts[indexOf(value)]++;
+    min = count == 0 ? value : qMin(min, value);
+    max = count == 0 ? value : qMax(max, value);
+    count++;
+    sum += value;
+}
+
+void Histogram::merge(const Histogram &other)
+{
+    if (other.count == 0) {
+        return;
+    }
+    if (counts.isEmpty()) {
+        counts.resize(BucketCount);
+    }
+
+    for (int i = 0; i < BucketCount; i++) {
+        counts[i] += other.counts[i];
+    }
+    min = count == 0 ? other.min : qMin(min, other.min);
+    max = count == 0 ? other.max : qMax(max, other.max);
+    count += other.count;
+    sum += other.sum;
+}
+
+void Histogram::reset()
+{
+    counts.clear();
+    count = 0;
+    sum = 0;
+    min = 0;
+    max = 0;
+}
+
+qint64 Histogram::getCount() const
+{
+    return count;
+}
+
+qint64 Histogram::getSum() const
+{
+    return sum;
+}
+
+qint64 Histogram::getMin() const
+{
+    return min;
+}
+
+qint64 Histogram::getMax() const
+{
+    return max;
+}
+
+double Histogram::getMean() const
+{
+    return count > 0 ? double(sum) / count : 0.0;
+}
+
+qint64 Histogram::valueAtPercentile(double percentile) const
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    qint64 target = qMax(qint64(1), qint64(qCeil(qBound(0.0, percentile, 100.0) / 100.0 * count)));
+    qint64 seen = 0;
+    for (int i = 0; i < BucketCount; i++) {
+        seen += counts[i];
+        if (seen >= target) {
+            return qMin(highestValue(i), max);
+        }
+    }
+    return max;
+}
+
+qint64 Histogram::countAtOrBelow(qint64 value) const
+{
+    if (count == 0 || value < 0) {
+        return 0;
+    }
+    if (value >= max) {
+        return count;
+    }
+
+    int last = indexOf(value);
+    qint64 seen = 0;
+    for (int i = 0; i <= last; i++) {
+        seen += counts[i];
+    }
+    return seen;
+}
@@ -0,0 +1,50 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <QVector>
+
+// Latency histogram in the style of HdrHistogram: buckets are linear within each power of two, so
+// every recorded value is kept to within 1% (128 buckets per power of two, so 1/128) from 0 up to
+// 2^32 with a fixed set of counters (13 KiB). Recording is an index computation and an increment.
+// The counters are only allocated by the first record(), so a histogram nothing ever goes into
+// costs nothing.
+class Histogram
+{
+public:
+    Histogram();
+
+    void record(qint64 value);          // negative values count as 0, larger than 2^32 - 1 as that
+    void merge(const Histogram &other);
+    void reset();
+
+    qint64 getCount() const;
+    qint64 getSum() const;
+    qint64 getMin() const;
+    qint64 getMax() const;
+    double getMean() const;
+
+    // Highest value of the bucket the percentile falls into, i.e. within 1% above the exact value
+    qint64 valueAtPercentile(double percentile) const;
+
+    // Values recorded in buckets up to and including the one `value` falls into
+    qint64 countAtOrBelow(qint64 value) const;
+
+private:
+    static const int SubBucketBits = 8;
+    static const int SubBucketCount = 1 << SubBucketBits;
+    static const int SubBucketHalf = SubBucketCount / 2;
+    static const int MaxValueBits = 32;
+    static const int BucketCount = SubBucketCount + (MaxValueBits - SubBucketBits) * SubBucketHalf;
+
+    QVector<quint32> counts;
+    qint64 count;
+    qint64 sum;
+    qint64 min;
+    qint64 max;
+
+    static int indexOf(qint64 value);
+    static qint64 lowestValue(int index);
+    static qint64 highestValue(int index);
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,310 @@
+#include "instructorserver.h"
+#include "AED.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <limits>
+
+static_assert(sizeof(InstructorServer::Frame) == 8, "frames are 8 bytes on the wire");
+
+InstructorRelay::InstructorRelay(AED* aed, int session, QElapsedTimer clock)
+    : QObject{aed}
+{
+    this->aed = aed;
+    this->session = session;
+    this->clock = clock;
+}
+
+void InstructorRelay::apply(quint32 client, int input, int value, qint64 sentNsec)
+{
+    aed->applyInput(input, value);
+    emit applied(session, client, input, (clock.nsecsElapsed() - sentNsec) / 1000);
+}
+
+InstructorServer::InstructorServer(QObject *parent)
+    : QObject{parent}
+{
+    thread = nullptr;
+    nextClientId = 1;
+    clock.start();
+
+    server = new QLocalServer(this);
+    server->setMaxPendingConnections(256);
+    connect(server, &QLocalServer::newConnection, this, &InstructorServer::onNewConnection);
+}
+
+InstructorServer::~InstructorServer()
+{
+    stop();
+}
+
+int InstructorServer::addDevice(AED* aed, bool frontEnd)
+{
+    int index = sessions.size();
+
+    Session session;
+    session.relay = new InstructorRelay(aed, index, clock);
+    session.frontEnd = frontEnd;
+    session.status[FieldState] = aed->getState();
+    session.status[FieldPower] = aed->getPowerState();
+    session.status[FieldBattery] = aed->getBatteryLevel();
+    session.status[FieldShocks] = aed->getShockCount();
+    session.status[FieldPads] = aed->isPadsAttached();
+    session.status[FieldRhythm] = AED::NoRhythm;
+    session.status[FieldCpr] = false;
+    session.status[FieldElapsed] = aed->getElapsedSeconds();
+    sessions.append(session);
+
+    // Changes arrive on the server's thread in the order the device made them
+    connect(session.relay, &InstructorRelay::applied, this, &InstructorServer::onApplied, Qt::QueuedConnection);
+    connect(aed, &AED::stateChanged, this, [this, index](int state) { setStatus(index, FieldState, state); }, Qt::QueuedConnection);
+    connect(aed, &AED::powerStateChanged, this, [this, index](bool on) { setStatus(index, FieldPower, on); }, Qt::QueuedConnection);
+    connect(aed, &AED::updateBatteryLevel, this, [this, index](int level) { setStatus(index, FieldBattery, level); }, Qt::QueuedConnection);
+    connect(aed, &AED::updateShockCount, this, [this, index](int shocks) { setStatus(index, FieldShocks, shocks); }, Qt::QueuedConnection);
+    connect(aed, &AED::updateElectrodeOverlay, this, [this, index](bool attached) { setStatus(index, FieldPads, attached); }, Qt::QueuedConnection);
+    connect(aed, &AED::rhythmDetected, this, [this, index](int rhythm) { setStatus(index, FieldRhythm, rhythm); }, Qt::QueuedConnection);
+    connect(aed, &AED::cprStateChanged, this, [this, index](bool active) { setStatus(index, FieldCpr, active); }, Qt::QueuedConnection);
+    connect(aed, &AED::updateElapsedTime, this, [this, index](int seconds) { setStatus(index, FieldElapsed, seconds); }, Qt::QueuedConnection);
+    return index;
+}
+
+int InstructorServer::getSessionCount()
+{
+    return sessions.size();
+}
+
+bool InstructorServer::listen(QString name)
+{
+    // A server that crashed leaves its socket file behind, but one that answers is still running
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(ProbeMsec)) {
+        probe.disconnectFromServer();
+        error = "another instructor server is listening on " + name;
+        return false;
+    }
+    QLocalServer::removeServer(name);
+    if (!server->listen(name)) {
+        error = server->errorString();
+        return false;
+    }
+    return true;
+}
+
+QString InstructorServer::getError()
+{
+    return error;
+}
+
+void InstructorServer::start()
+{
+    thread = new QThread;
+    thread->setObjectName("aed-instructor");
+    moveToThread(thread);
+    thread->start();
+}
+
+void InstructorServer::stop()
+{
+    if (thread == nullptr) {
+        return;
+    }
+
+    // Closes the connections on the server's thread, then comes back to the caller's
+    QThread* caller = QThread::currentThread();
+    QMetaObject::invokeMethod(this, [this, caller]() {
+        server->close();
+        for (const Client &client : clients) {
+            client.socket->disconnect(this);
+            delete client.socket;
+        }
+        clients.clear();
+        moveToThread(caller);
+    }, Qt::BlockingQueuedConnection);
+
+    thread->quit();
+    thread->wait();
+    delete thread;
+    thread = nullptr;
+}
+
+Histogram InstructorServer::getLatency()
+{
+    return latency;
+}
+
+void InstructorServer::onNewConnection()
+{
+    while (QLocalSocket* socket = server->nextPendingConnection()) {
+        Client client;
+        client.id = nextClientId++;
+        client.socket = socket;
+        client.subscribed = QVector<bool>(sessions.size(), false);
+        clients.append(client);
+
+        connect(socket, &QLocalSocket::readyRead, this, &InstructorServer::onReadyRead);
+        connect(socket, &QLocalSocket::disconnected, this, &InstructorServer::onDisconnected);
+        emit consolesChanged(clients.size());
+    }
+}
+
+void InstructorServer::onReadyRead()
+{
+    QLocalSocket* socket = qobject_cast<QLocalSocket*>(sender());
+    int index = findClient(socket);
+    if (index < 0) {
+        return;
+    }
+
+    // Whole frames only; a partial one stays in the socket's buffer until the rest arrives
+    qint64 now = clock.nsecsElapsed();
+    Frame frame;
+    while (socket->bytesAvailable() >= qint64(sizeof(Frame))) {
+        socket->read(reinterpret_cast<char*>(&frame), sizeof(Frame));
+        handle(clients[index], frame, now);
+    }
+    dropSlowClients();
+}
+
+void InstructorServer::onDisconnected()
+{
+    QLocalSocket* socket = qobject_cast<QLocalSocket*>(sender());
+    int index = findClient(socket);
+    if (index >= 0) {
+        clients.removeAt(index);
+        emit consolesChanged(clients.size());
+    }
+    socket->deleteLater();
+}
+
+void InstructorServer::onApplied(int session, quint32 client, int input, qint64 latencyUsec)
+{
+    latency.record(latencyUsec);
+
+    // The console may have gone in the meantime
+    for (const Client &c : clients) {
+        if (c.id == client) {
+            send(c.socket, Applied, input, session, qint32(qMin(latencyUsec, qint64(std::numeric_limits<qint32>::max()))));
+            break;
+        }
+    }
+    dropSlowClients();
+}
+
+void InstructorServer::handle(Client &client, const Frame &frame, qint64 receivedNsec)
+{
+    bool all = frame.session == AllSessions;
+    if (!all && frame.session >= sessions.size() && (frame.type == Input || frame.type == Subscribe)) {
+        send(client.socket, Error, UnknownSession, frame.session, frame.type);
+        return;
+    }
+    int first = all ? 0 : frame.session;
+    int last = all ? sessions.size() - 1 : frame.session;
+
+    switch (frame.type) {
+    case List:
+        send(client.socket, Count, 0, 0, sessions.size());
+        break;
+    case Input:
+        if (frame.code > AED::InputBatteryLevel) {
+            send(client.socket, Error, UnknownInput, frame.session, frame.type);
+            break;
+        }
+        for (int i = first; i <= last; i++) {
+            if (sessions[i].frontEnd && isLevelInput(frame.code)) {
+                send(client.socket, Error, InputOwned, i, frame.type);
+                continue;
+            }
+            InstructorRelay* relay = sessions[i].relay;
+            quint32 id = client.id;
+            int input = frame.code;
+            int value = frame.value;
+            QMetaObject::invokeMethod(relay, [relay, id, input, value, receivedNsec]() {
+                relay->apply(id, input, value, receivedNsec);
+            }, Qt::QueuedConnection);
+        }
+        break;
+    case Subscribe:
+        for (int i = first; i <= last; i++) {
+            client.subscribed[i] = frame.value != 0;
+            if (client.subscribed[i]) {
+                for (int field = 0; field < FieldCount; field++) {
+                    send(client.socket, Status, field, i, sessions[i].status[field]);
+                }
+            }
+        }
+        break;
+    case Ping:
+        send(client.socket, Pong, frame.code, frame.session, frame.value);
+        break;
+    default:
+        send(client.socket, Error, UnknownType, frame.session, frame.type);
+        break;
+    }
+}
+
+void InstructorServer::setStatus(int session, Field field, qint32 value)
+{
+    if (sessions[session].status[field] == value) {
+        return;
+    }
+    sessions[session].status[field] = value;
+
+    for (const Client &client : clients) {
+        if (client.subscribed[session]) {
+            send(client.socket, Status, field, session, value);
+        }
+    }
+    dropSlowClients();
+}
+
+void InstructorServer::send(QLocalSocket* socket, quint8 type, quint8 code, quint16 session, qint32 value)
+{
+    // Buffered by the socket and written when it can take it; a console that stops reading is cut off
+    // at MaxQueuedBytes instead of growing the buffer, once the caller is done with the client list
+    if (slowSockets.contains(socket)) {
+        return;
+    }
+    if (socket->bytesToWrite() >= MaxQueuedBytes) {
+        slowSockets.append(socket);
+        return;
+    }
+    Frame frame;
+    frame.type = type;
+    frame.code = code;
+    frame.session = session;
+    frame.value = value;
+    socket->write(reinterpret_cast<const char*>(&frame), sizeof(Frame));
+}
+
+void InstructorServer::dropSlowClients()
+{
+    for (QLocalSocket* socket : slowSockets) {
+        int index = findClient(socket);
+        if (index >= 0) {
+            qWarning("instructor: console %u fell %lld bytes behind, disconnecting", clients[index].id,
+                     socket->bytesToWrite());
+            clients.removeAt(index);
+            emit consolesChanged(clients.size());
+        }
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+    slowSockets.clear();
+}
+
+int InstructorServer::findClient(QLocalSocket* socket)
+{
+    for (int i = 0; i < clients.size(); i++) {
+        if (clients[i].socket == socket) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool InstructorServer::isLevelInput(int input)
+{
+    return input == AED::InputBattery || input == AED::InputSelfTest || input == AED::InputPads
+        || input == AED::InputCprDepth;
+}
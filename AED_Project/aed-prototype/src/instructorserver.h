@@ -0,0 +1,168 @@
+#ifndef INSTRUCTORSERVER_H
+#define INSTRUCTORSERVER_H
+
+#include <QObject>
+#include <QList>
+#include <QVector>
+#include <QThread>
+#include <QElapsedTimer>
+#include "histogram.h"
+
+class AED;
+class QLocalServer;
+class QLocalSocket;
+
+// Applies the server's commands on a device's thread. A child of the device, so a command still
+// queued when the device goes away is dropped with it.
+class InstructorRelay : public QObject
+{
+    Q_OBJECT
+
+public:
+    InstructorRelay(AED* aed, int session, QElapsedTimer clock);
+
+    // Device thread; sentNsec is on the server's clock
+    void apply(quint32 client, int input, int value, qint64 sentNsec);
+
+signals:
+    void applied(int session, quint32 client, int input, qint64 latencyUsec);
+
+private:
+    AED* aed;
+    int session;
+    QElapsedTimer clock;
+};
+
+// Lets an instructor console control and watch many trainee devices over a local socket.
+// The server has a thread of its own, whose event loop waits on the listening socket and every
+// client connection at once, so a hundred connected consoles cost no more threads than one. Frames
+// are read as soon as they arrive and a command is queued straight to the device's thread; nothing
+// on the way takes a lock or waits for a reply. Devices report back with queued signals, and the
+// server fans the changes out to the clients that subscribed to the session. A console that leaves
+// more than MaxQueuedBytes unread is disconnected rather than buffered for without bound.
+//
+// Protocol: fixed 8-byte Frames in native byte order, in both directions. A session is the index
+// of a device in the order addDevice() was called; AllSessions addresses every device.
+//   List                            -> Count, value: number of sessions
+//   Input      code: AED::Input     -> Applied for each device once the input took effect, value:
+//              value: its value        microseconds from the frame being read to the device applying it;
+//                                      Error InputOwned for a level input to a device with a front end
+//   Subscribe  value: 1 on, 0 off   -> with 1, a Status frame per field with the current value, then one
+//                                      Status frame per change until unsubscribed
+//   Ping       value: any           -> Pong with the same value
+//   anything wrong                  -> Error, code: ErrorCode, value: the frame's type
+class InstructorServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Frame {
+        quint8 type;
+        quint8 code;            // AED::Input, Field or Error
+        quint16 session;
+        qint32 value;
+    };
+
+    enum Type {
+        // Console to server
+        List = 1,
+        Input = 2,
+        Subscribe = 3,
+        Ping = 4,
+
+        // Server to console
+        Count = 0x81,
+        Applied = 0x82,
+        Status = 0x83,
+        Pong = 0x84,
+        Error = 0x85
+    };
+
+    // What Status frames report
+    enum Field {
+        FieldState,             // AED::State
+        FieldPower,             // on
+        FieldBattery,           // percent
+        FieldShocks,
+        FieldPads,              // attached
+        FieldRhythm,            // AED::Rhythm detected by the last analysis
+        FieldCpr,               // coaching
+        FieldElapsed,           // seconds since power-on
+        FieldCount
+    };
+
+    enum ErrorCode {
+        UnknownType = 1,
+        UnknownSession,
+        UnknownInput,
+        InputOwned              // the device's front end holds that level input
+    };
+
+    static const quint16 AllSessions = 0xffff;
+    static const int ProbeMsec = 200;      // how long listen() waits for a server already on the name
+    static const qint64 MaxQueuedBytes = 64 * 1024;    // unsent frames a console may fall behind by
+
+    explicit InstructorServer(QObject *parent = nullptr);
+    ~InstructorServer();
+
+    // Registers a device as the next session; call before start(), while the device is still being
+    // configured. Returns the session number.
+    // A front end (a trainee window) publishes the level inputs (pads, battery, self-test, CPR depth)
+    // through the device's DeviceInputs and shows them in its widgets, so a console setting them as
+    // well would leave the two disagreeing; on such a device consoles only get the momentary inputs.
+    int addDevice(AED* aed, bool frontEnd = false);
+    int getSessionCount();
+
+    // Listens on a local socket name, e.g. "aed-instructor", or a path. Fails if a live server has
+    // the name already.
+    bool listen(QString name);
+    QString getError();
+
+    // Moves the server onto its own thread; stop() ends it and closes every connection
+    void start();
+    void stop();
+
+    // Command to device latency so far; read after stop()
+    Histogram getLatency();
+
+signals:
+    void consolesChanged(int connected);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+    void onApplied(int session, quint32 client, int input, qint64 latencyUsec);
+
+private:
+    struct Session {
+        InstructorRelay* relay;
+        bool frontEnd;
+        qint32 status[FieldCount];
+    };
+
+    struct Client {
+        quint32 id;
+        QLocalSocket* socket;
+        QVector<bool> subscribed;       // per session
+    };
+
+    QLocalServer* server;
+    QThread* thread;
+    QString error;
+    QList<Session> sessions;
+    QList<Client> clients;
+    QList<QLocalSocket*> slowSockets;   // over MaxQueuedBytes, dropped by dropSlowClients()
+    quint32 nextClientId;
+    QElapsedTimer clock;                // the relays hold copies, so latency spans both threads
+    Histogram latency;                  // microseconds
+
+    void handle(Client &client, const Frame &frame, qint64 receivedNsec);
+    void setStatus(int session, Field field, qint32 value);
+    void send(QLocalSocket* socket, quint8 type, quint8 code, quint16 session, qint32 value);
+    void dropSlowClients();
+    int findClient(QLocalSocket* socket);
+    static bool isLevelInput(int input);
+};
+
+#endif // INSTRUCTORSERVER_H
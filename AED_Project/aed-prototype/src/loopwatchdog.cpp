@@ -0,0 +1,199 @@
+#include "loopwatchdog.h"
+#include <QThread>
+#include <QWaitCondition>
+
+thread_local LoopWatchdog* LoopWatchdog::current = nullptr;
+
+// Wakes up twice per threshold to look at the heartbeat of the watched thread
+class LoopWatchdog::Monitor : public QThread
+{
+public:
+    explicit Monitor(LoopWatchdog* watchdog)
+    {
+        this->watchdog = watchdog;
+        stopping = false;
+    }
+
+    void stop()
+    {
+        mutex.lock();
+        stopping = true;
+        wake.wakeOne();
+        mutex.unlock();
+        wait();
+    }
+
+protected:
+    void run() override
+    {
+        QMutexLocker locker(&mutex);
+        while (!stopping) {
+            wake.wait(&mutex, qMax(1, watchdog->thresholdMsec / 2));
+            if (!stopping) {
+                watchdog->checkStall(watchdog->clock.nsecsElapsed());
+            }
+        }
+    }
+
+private:
+    LoopWatchdog* watchdog;
+    QMutex mutex;
+    QWaitCondition wake;
+    bool stopping;
+};
+
+LoopWatchdog::Scope::Scope(const char* activity)
+{
+    watchdog = current;
+    previous = nullptr;
+    if (watchdog != nullptr) {
+        previous = watchdog->activity.fetchAndStoreRelaxed(activity);
+    }
+}
+
+LoopWatchdog::Scope::~Scope()
+{
+    if (watchdog != nullptr) {
+        watchdog->activity.storeRelaxed(previous);
+    }
+}
+
+LoopWatchdog::LoopWatchdog(QString name, QObject *parent)
+    : QObject{parent}
+{
+    this->name = name;
+    intervalMsec = DefaultIntervalMsec;
+    thresholdMsec = DefaultThresholdMsec;
+    stats.beats = 0;
+    stats.stalls = 0;
+    stats.maxLoopDepth = 0;
+    ring.resize(RingSize);
+    ringNext = 0;
+    ringCount = 0;
+    monitor = nullptr;
+
+    heartbeat = new QTimer(this);
+    heartbeat->setTimerType(Qt::PreciseTimer);
+    connect(heartbeat, &QTimer::timeout, this, &LoopWatchdog::onBeat);
+}
+
+LoopWatchdog::~LoopWatchdog()
+{
+    if (monitor != nullptr) {
+        monitor->stop();
+        delete monitor;
+    }
+    if (current == this) {
+        current = nullptr;
+    }
+}
+
+void LoopWatchdog::setThreshold(int msec)
+{
+    thresholdMsec = qMax(1, msec);
+}
+
+void LoopWatchdog::setInterval(int msec)
+{
+    intervalMsec = qMax(1, msec);
+}
+
+void LoopWatchdog::start()
+{
+    current = this;
+    clock.start();
+    lastBeatNsec.storeRelease(0);
+    heartbeat->start(intervalMsec);
+
+    if (monitor == nullptr) {
+        monitor = new Monitor(this);
+        monitor->start();
+    }
+}
+
+void LoopWatchdog::stop()
+{
+    heartbeat->stop();
+    if (monitor != nullptr) {
+        monitor->stop();
+        delete monitor;
+        monitor = nullptr;
+    }
+}
+
+void LoopWatchdog::onBeat()
+{
+    qint64 now = clock.nsecsElapsed();
+    qint64 last = lastBeatNsec.loadAcquire();
+    int depth = QThread::currentThread()->loopLevel();
+    qint64 lateUsec = (now - last) / 1000 - qint64(intervalMsec) * 1000;
+
+    QMutexLocker locker(&mutex);
+    stats.beats++;
+    stats.latenessUsec.record(lateUsec);
+    stats.maxLoopDepth = qMax(stats.maxLoopDepth, depth);
+
+    if (now - last > qint64(thresholdMsec) * 1000000) {
+        // The monitor saw the stall while it lasted, unless it was shorter than its wake-up period
+        const char* culprit = stallBeatNsec.loadAcquire() == last ? stallActivity.loadRelaxed() : activity.loadRelaxed();
+
+        Stall stall;
+        stall.startMsec = last / 1000000;
+        stall.durationMsec = (now - last) / 1000000;
+        stall.loopDepth = loopDepth.loadRelaxed();
+        stall.activity = culprit;
+        ring[ringNext] = stall;
+        ringNext = (ringNext + 1) % RingSize;
+        ringCount = qMin(ringCount + 1, int(RingSize));
+        stats.stalls++;
+
+        qWarning("watchdog: %s stalled for %lld ms in %s (loop depth %d)", qPrintable(name), stall.durationMsec,
+                 culprit != nullptr ? culprit : "the event loop", stall.loopDepth);
+    }
+
+    loopDepth.storeRelaxed(depth);
+    lastBeatNsec.storeRelease(now);
+}
+
+void LoopWatchdog::checkStall(qint64 now)
+{
+    qint64 last = lastBeatNsec.loadAcquire();
+    if (now - last > qint64(thresholdMsec) * 1000000 && stallBeatNsec.loadAcquire() != last) {
+        stallActivity.storeRelaxed(activity.loadRelaxed());
+        stallBeatNsec.storeRelease(last);
+    }
+}
+
+LoopWatchdog::Stats LoopWatchdog::getStats()
+{
+    QMutexLocker locker(&mutex);
+    return stats;
+}
+
+QVector<LoopWatchdog::Stall> LoopWatchdog::getStalls()
+{
+    QMutexLocker locker(&mutex);
+    QVector<Stall> stalls;
+    stalls.reserve(ringCount);
+    for (int i = 0; i < ringCount; i++) {
+        stalls.append(ring[(ringNext - ringCount + i + RingSize) % RingSize]);
+    }
+    return stalls;
+}
+
+QString LoopWatchdog::dump()
+{
+    Stats snapshot = getStats();
+    QString text = QString("watchdog: %1: %2 beats, lateness p50 %3 us / p99 %4 us / max %5 us, max loop depth %6, "
+                           "%7 stall(s) over %8 ms\n")
+        .arg(name).arg(snapshot.beats)
+        .arg(snapshot.latenessUsec.valueAtPercentile(50)).arg(snapshot.latenessUsec.valueAtPercentile(99))
+        .arg(snapshot.latenessUsec.getMax()).arg(snapshot.maxLoopDepth).arg(snapshot.stalls).arg(thresholdMsec);
+
+    for (const Stall &stall : getStalls()) {
+        text += QString("watchdog: %1:   at %2 ms: %3 ms in %4, loop depth %5\n")
+            .arg(name).arg(stall.startMsec).arg(stall.durationMsec)
+            .arg(stall.activity != nullptr ? stall.activity : "the event loop").arg(stall.loopDepth);
+    }
+    return text;
+}
@@ -0,0 +1,102 @@
+#ifndef LOOPWATCHDOG_H
+#define LOOPWATCHDOG_H
+
+#include <QObject>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QTimer>
+#include <QVector>
+#include "histogram.h"
+
+// Responsiveness of one thread's event loop.
+// A precise heartbeat timer on the watched thread measures how late each of its firings is, which is
+// how late any timer on that thread can be, and notes how deeply event loops are nested when it gets
+// to run. A monitor thread notices when the heartbeat has been silent for longer than the threshold
+// and captures what the watched thread was doing at that moment: code marks its work with a Scope,
+// e.g. each protocol step's entry action. When the heartbeat resumes, the stall goes into a ring
+// buffer of the most recent ones, which dump() returns at any time from any thread.
+class LoopWatchdog : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stall {
+        qint64 startMsec;       // since the watchdog started
+        qint64 durationMsec;
+        int loopDepth;          // nested event loops when the heartbeat last ran before the stall
+        const char* activity;   // innermost Scope at the time, nullptr for none
+    };
+
+    struct Stats {
+        qint64 beats;
+        qint64 stalls;
+        int maxLoopDepth;
+        Histogram latenessUsec;     // of the heartbeat
+    };
+
+    // Marks what the current thread is doing for as long as it exists. The text must be static.
+    class Scope
+    {
+    public:
+        explicit Scope(const char* activity);
+        ~Scope();
+
+    private:
+        LoopWatchdog* watchdog;
+        const char* previous;
+    };
+
+    static const int DefaultIntervalMsec = 10;
+    static const int DefaultThresholdMsec = 100;
+    static const int RingSize = 256;
+
+    explicit LoopWatchdog(QString name, QObject *parent = nullptr);
+    ~LoopWatchdog();
+
+    void setThreshold(int msec);
+    void setInterval(int msec);
+
+    Stats getStats();
+    QVector<Stall> getStalls();     // oldest first
+    QString dump();
+
+public slots:
+    // Watches the thread the watchdog lives on; call on that thread
+    void start();
+    void stop();
+
+private slots:
+    void onBeat();
+
+private:
+    class Monitor;
+
+    static thread_local LoopWatchdog* current;     // watchdog of the calling thread, if any
+
+    QString name;
+    int intervalMsec;
+    int thresholdMsec;
+    QTimer* heartbeat;
+    Monitor* monitor;
+    QElapsedTimer clock;
+
+    // Shared with the monitor thread
+    QAtomicInteger<qint64> lastBeatNsec;
+    QAtomicPointer<const char> activity;
+    QAtomicPointer<const char> stallActivity;       // captured by the monitor during a stall
+    QAtomicInteger<qint64> stallBeatNsec;           // the heartbeat the capture belongs to
+    QAtomicInteger<int> loopDepth;
+
+    // Guarded by the mutex, written on the watched thread
+    QMutex mutex;
+    Stats stats;
+    QVector<Stall> ring;
+    int ringNext;
+    int ringCount;
+
+    void checkStall(qint64 now);    // monitor thread
+};
+
+#endif // LOOPWATCHDOG_H
@@ -1,11 +1,277 @@
 #include "mainwindow.h"
+#include "wfdbrecord.h"
+#include "promptcache.h"
+#include "promptplayer.h"
+#include "assetatlas.h"
+#include "devicepanel.h"
+#include "loopwatchdog.h"
+#include "instructorserver.h"
+#include "telemetryexport.h"
+#include "devicepool.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QGraphicsView>
+#include <QPushButton>
+#include <QTextStream>
+#include <QPointer>
+#include <QFileInfo>
+#include <QResource>
+#include <QTimer>
+#include <functional>
+#include <memory>
+
+// Cost of changing the device face the old way, with a style sheet that Qt re-parses and re-polishes
+// on every call, against a DevicePanel state change. Each change is painted before the next one.
+static void benchmarkPanel(AssetAtlas* assets)
+{
+    QTextStream out(stdout);
+    const int changes = 200;
+    const QString powerStyles[] = {
+        "QPushButton {image: url(:/buttons/powerbuttonON.png);border-radius: 20px;}QPushButton:hover {image: url(:/buttons/powerButton.png);border-radius: 20px;}",
+        "QPushButton {image: url(:/buttons/powerButton.png);border-radius: 20px;}QPushButton:hover {image: url(:/buttons/powerbuttonON.png);border-radius: 20px;}"
+    };
+    const QString caseStyles[] = {
+        "border-image: url(:/overlay/aed.png);background-color: rgba(255, 255, 255, 0);",
+        "border-image: url(:/overlay/aedNoElectrode.png);background-color: rgba(255, 255, 255, 0);"
+    };
+
+    // The old face: a styled graphics view under a styled push button
+    QWidget styled;
+    styled.setAttribute(Qt::WA_DontShowOnScreen);
+    styled.resize(566, 663);
+    QGraphicsView* caseView = new QGraphicsView(&styled);
+    caseView->setGeometry(0, 0, 566, 663);
+    caseView->setStyleSheet(caseStyles[1]);
+    QPushButton* powerButton = new QPushButton(&styled);
+    powerButton->setFlat(true);
+    powerButton->setGeometry(465, 558, 61, 46);
+    powerButton->setStyleSheet(powerStyles[1]);
+    styled.show();
+
+    DevicePanel panel;
+    panel.setAttribute(Qt::WA_DontShowOnScreen);
+    panel.resize(566, 663);
+    panel.setAssets(assets);
+    panel.show();
+    QCoreApplication::processEvents();
+
+    auto measure = [&](QString name, std::function<void(int)> change) {
+        QElapsedTimer timer;
+        qint64 changeNsec = 0;
+        qint64 totalNsec = 0;
+        for (int i = 0; i < changes; i++) {
+            timer.start();
+            change(i);
+            changeNsec += timer.nsecsElapsed();
+            QCoreApplication::processEvents();      // paints whatever the change invalidated
+            totalNsec += timer.nsecsElapsed();
+        }
+        out << QString("panel: %1 %2 us to change, %3 us including the repaint")
+               .arg(name, -28)
+               .arg(changeNsec / 1000.0 / changes, 0, 'f', 1)
+               .arg(totalNsec / 1000.0 / changes, 0, 'f', 1) << Qt::endl;
+    };
+
+    measure("power button, style sheet", [&](int i) { powerButton->setStyleSheet(powerStyles[i % 2]); });
+    measure("power button, panel", [&](int i) { panel.setPowered(i % 2 == 0); });
+    measure("case overlay, style sheet", [&](int i) { caseView->setStyleSheet(caseStyles[i % 2]); });
+    measure("case overlay, panel", [&](int i) { panel.setPadsConnected(i % 2 == 0); });
+    measure("step light, panel", [&](int i) { panel.setLight(i % 2 == 0, 1 + (i / 2) % DevicePanel::LightCount); });
+}
 
 int main(int argc, char *argv[])
 {
+    QElapsedTimer startup;
+    startup.start();
     QApplication a(argc, argv);
-    MainWindow w;
-    w.show();
-    return a.exec();
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption speedOption("speed", "Run the device clock this many times faster than real time.", "factor", "1");
+    QCommandLineOption traineesOption("trainees", "Number of independent devices (one window each).", "count", "1");
+    QCommandLineOption frameStatsOption("frame-stats", "Log ECG trace frame times every 5 seconds.");
+    QCommandLineOption assetStatsOption("asset-stats", "Log image decodes and pixmap allocations per protocol step.");
+    QCommandLineOption recordOption("record", "Record each session's events to this file (trainee number appended).", "file");
+    QCommandLineOption replayOption("replay", "Replay a recorded session in the first window instead of taking inputs.", "file");
+    QCommandLineOption metricsOption("metrics", "Write each session's timing metrics to this file (.json for JSON, else Prometheus text).", "file");
+    QCommandLineOption watchdogOption("watchdog", "Log GUI and device event-loop stalls longer than this many milliseconds (Ctrl+Shift+W dumps them).", "msec");
+    QCommandLineOption instructorOption("instructor", "Let an instructor console control and watch every trainee over this local socket.", "name");
+    QCommandLineOption telemetryOption("telemetry", "Publish every trainee's live state and ECG in a shared-memory segment under this key.", "key");
+#ifdef AED_EXTERNAL_RESOURCES
+    QCommandLineOption resourcesOption("resources", "Resource pack to map.", "file",
+                                       QCoreApplication::applicationDirPath() + "/aed.rcc");
+#else
+    QCommandLineOption resourcesOption("resources", "Map this resource pack over the resources built into the program.", "file");
+#endif
+    QCommandLineOption panelBenchmarkOption("panel-benchmark", "Compare style-sheet and painted device face updates, then exit.");
+    parser.addOption(speedOption);
+    parser.addOption(traineesOption);
+    QCommandLineOption wfdbOption("wfdb", "Feed the pads from a WFDB record (path without extension).", "record");
+    QCommandLineOption wfdbRhythmOption("wfdb-rhythm", "Start playback at the first annotation of this rhythm, e.g. (VFL.", "label");
+    parser.addOption(frameStatsOption);
+    parser.addOption(assetStatsOption);
+    parser.addOption(panelBenchmarkOption);
+    parser.addOption(recordOption);
+    parser.addOption(replayOption);
+    parser.addOption(metricsOption);
+    parser.addOption(watchdogOption);
+    parser.addOption(instructorOption);
+    parser.addOption(telemetryOption);
+    parser.addOption(resourcesOption);
+    parser.addOption(wfdbOption);
+    parser.addOption(wfdbRhythmOption);
+    parser.process(a);
+
+    WfdbRecord record;
+    if (parser.isSet(wfdbOption) && !record.open(parser.value(wfdbOption))) {
+        qCritical("wfdb: %s", qPrintable(record.getError()));
+        return 2;
+    }
+    QList<WfdbPlayback*> playbacks;
+
+    // A pack is mapped, not read: pages of it only become resident once an image or prompt in them is
+    // decoded, and compressed audio is only inflated then
+    QString pack = parser.value(resourcesOption);
+    bool mapped = !pack.isEmpty();
+    if (mapped) {
+        QElapsedTimer mapTimer;
+        mapTimer.start();
+        if (!QResource::registerResource(pack)) {
+            qCritical("resources: cannot map %s", qPrintable(pack));
+            return 2;
+        }
+        qInfo("resources: %s mapped in %.1f ms, %lld KiB", qPrintable(pack), mapTimer.nsecsElapsed() / 1e6,
+              QFileInfo(pack).size() / 1024);
+    }
+
+    // Voice prompts are decoded at the rate the audio output runs at: all of them up front from the
+    // embedded resources, each on its first use from a pack
+    PromptCache prompts;
+    prompts.setSampleRate(PromptPlayer::outputFormat(prompts.getSampleRate()).sampleRate());
+    if (!mapped) {
+        int decoded = prompts.preload(":/audio");
+        qInfo("audio: %d prompts decoded in %.1f ms, %lld KiB of PCM at %d Hz", decoded,
+              prompts.getDecodeNsec() / 1e6, prompts.getBytes() / 1024, prompts.getSampleRate());
+    }
+
+    double speed = parser.value(speedOption).toDouble();
+    int trainees = qMax(1, parser.value(traineesOption).toInt());
+
+    // Every image is decoded once, the windows only ever get shared handles; from a pack only the
+    // ones a window asks for
+    AssetAtlas assets;
+    assets.setDevicePixelRatio(a.devicePixelRatio());
+    if (!mapped) {
+        QElapsedTimer assetTimer;
+        assetTimer.start();
+        int images = assets.preload(":/");
+        qInfo("assets: %d images decoded in %.1f ms, %lld KiB of pixmaps", images,
+              assetTimer.nsecsElapsed() / 1e6, assets.getCounters().bytes / 1024);
+    }
+
+    if (parser.isSet(panelBenchmarkOption)) {
+        benchmarkPanel(&assets);
+        return 0;
+    }
+
+    // The GUI thread is shared by every window
+    LoopWatchdog* guiWatchdog = nullptr;
+    if (parser.isSet(watchdogOption)) {
+        guiWatchdog = new LoopWatchdog("gui");
+        guiWatchdog->setThreshold(parser.value(watchdogOption).toInt());
+        guiWatchdog->start();
+    }
+
+    // Outlives the windows, whose devices write into it
+    TelemetryExport telemetry;
+    if (parser.isSet(telemetryOption)) {
+        if (!telemetry.create(parser.value(telemetryOption), trainees)) {
+            qCritical("telemetry: cannot create %s: %s", qPrintable(parser.value(telemetryOption)),
+                      qPrintable(telemetry.getError()));
+            return 2;
+        }
+        qInfo("telemetry: %d trainee(s) at %s", trainees, qPrintable(telemetry.getNativeKey()));
+    }
+
+    // Listens before any device starts, so a name already taken stops nothing but the server
+    std::unique_ptr<InstructorServer> instructor;
+    if (parser.isSet(instructorOption)) {
+        instructor.reset(new InstructorServer);
+        if (!instructor->listen(parser.value(instructorOption))) {
+            qCritical("instructor: cannot listen on %s: %s", qPrintable(parser.value(instructorOption)),
+                      qPrintable(instructor->getError()));
+            return 2;
+        }
+    }
+
+    QList<QPointer<MainWindow>> windows;
+    for (int i = 0; i < trainees; i++) {
+        MainWindow* w = new MainWindow(&prompts, &assets);
+        windows.append(w);
+        w->setAttribute(Qt::WA_DeleteOnClose);
+        if (trainees > 1) {
+            w->setWindowTitle(QString("AED - trainee %1").arg(i + 1));
+        }
+        if (speed > 0 && speed != 1.0) {
+            w->getAED()->getClock()->setMode(Clock::Scaled, speed);
+        }
+        if (parser.isSet(wfdbOption)) {
+            // First signal of the record, usually MLII
+            WfdbPlayback* playback = new WfdbPlayback(&record);
+            if (parser.isSet(wfdbRhythmOption)) {
+                playback->seekToRhythm(parser.value(wfdbRhythmOption));
+            }
+            w->getAED()->setEcgSource(playback);
+            playbacks.append(playback);
+        }
+        w->setFrameStatsLogging(parser.isSet(frameStatsOption));
+        w->setAssetStatsLogging(parser.isSet(assetStatsOption));
+        if (parser.isSet(recordOption)) {
+            w->startRecording(EventRecorder::sessionPath(parser.value(recordOption), i, trainees));
+        }
+        if (parser.isSet(metricsOption)) {
+            w->startMetrics(EventRecorder::sessionPath(parser.value(metricsOption), i, trainees));
+        }
+        if (guiWatchdog != nullptr) {
+            w->startWatchdog(parser.value(watchdogOption).toInt(), guiWatchdog);
+        }
+        if (instructor != nullptr) {
+            instructor->addDevice(w->getAED(), true);
+        }
+        if (parser.isSet(telemetryOption)) {
+            telemetry.attach(w->getAED(), i);
+        }
+        if (i == 0 && parser.isSet(replayOption) && !w->startReplay(parser.value(replayOption))) {
+            return 2;
+        }
+        w->startDevice();
+        w->show();
+    }
+
+    if (instructor != nullptr) {
+        instructor->start();
+    }
+
+    // Reported once the first frames are up, for comparing embedded and mapped resources
+    QTimer::singleShot(0, &a, [&]() {
+        qInfo("startup: windows up after %.1f ms, %lld KiB resident, resources %s; %d images and %d prompts decoded",
+              startup.nsecsElapsed() / 1e6, DevicePool::residentBytes() / 1024,
+              mapped ? "mapped" : "embedded", assets.getCounters().decodes, prompts.getPromptCount());
+    });
+
+    int exitCode = a.exec();
+
+    // Stops sending commands before the devices go away
+    instructor.reset();
+
+    // Device threads may still be reading the recordings until their windows are gone
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+    for (MainWindow* w : windows) {
+        delete w;
+    }
+    delete guiWatchdog;
+    qDeleteAll(playbacks);
+    return exitCode;
 }
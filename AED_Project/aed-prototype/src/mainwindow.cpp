@@ -1,307 +1,417 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include <QStatusBar>
+#include <QShortcut>
 
-MainWindow::MainWindow(QWidget *parent)
+MainWindow::MainWindow(PromptCache* prompts, AssetAtlas* assets, QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
 {
     ui->setupUi(this);
 
-    aed = AED::instance();
-    ui->cprDepth->setEnabled(false);
-
-    ui->shockButton->setEnabled(false); //default
-
-    buttonHoldTimer = new QTimer(this);
-    buttonHoldTimer->setInterval(5000);  // 5000 milliseconds = 5 seconds
+    // Every window simulates its own device, on a thread of its own (see startDevice())
+    aed = new AED;
+    link = new DeviceLink(aed);
+    deviceThread = new QThread(this);
+    deviceThread->setObjectName("aed-device");
+    connect(deviceThread, &QThread::finished, aed, &QObject::deleteLater);
 
-    elapsedTimer = new QTimer(this);
-    elapsedSeconds = 0;
+    // The device face paints itself from the atlas; the CPR bar is a plain pixmap at the label's size
+    this->assets = assets;
+    ui->aed->setAssets(assets);
+    assets->prescale(":/shocks/bar.png", ui->barGraph->size());
+    ui->barGraph->setScaledContents(false);
 
-    batteryDrainTimer = new QTimer(this);
+    assetStatsLogging = false;
+    stepCounters = assets->getCounters();
+    currentStep = aed->getState();
 
-    elapsedTimer->start(1000);
-    updateElapsedTimer();
+    player = new PromptPlayer(prompts, this);
+    player->setVolume(1.0);
+    connect(player, &PromptPlayer::promptStarted, this, &MainWindow::onPromptStarted);
 
-    CPRpressed = true;
+    ui->cprDepth->setEnabled(false);
 
     ui->CPR->setEnabled(false);
 
     ui->rhythmGroupBox->setDisabled(true);
     ui->newRhythmButton->setEnabled(false);
 
+    // Live trace of the signal seen through the pads
+    ui->heartSignal->setSampleRate(aed->getEcgSampleRate());
+    aed->setEcgStreaming(true);
+
+    replaying = false;
+    metrics = nullptr;
+    deviceWatchdog = nullptr;
+    guiWatchdog = nullptr;
+    // Sessions differ unless a replay asks for the recorded seed
+    aed->setSeed(QRandomGenerator::global()->generate());
+
+    frameStatsTimer = new QTimer(this);
+    connect(frameStatsTimer, &QTimer::timeout, this, &MainWindow::onLogFrameStats);
+
+    // Push the initial widget state into the device
+    publishInputs();
+
     // --- UI Signal and Slots ---
-    connect(ui->powerButton, SIGNAL(pressed()), this, SLOT(onPowerButtonPressed()));
-    connect(ui->powerButton, SIGNAL(released()), this, SLOT(onPowerButtonReleased()));
+    // Level inputs go through the device's input snapshot, momentary ones are queued to its thread
+    connect(ui->aed, SIGNAL(powerPressed()), aed, SLOT(onPowerButtonPressed()));
+    connect(ui->aed, SIGNAL(powerReleased()), aed, SLOT(onPowerButtonReleased()));
     connect(ui->adultPads, SIGNAL(clicked(bool)), this, SLOT(handleElectrode()));
     connect(ui->childPads, SIGNAL(clicked(bool)), this, SLOT(handleElectrode()));
-    connect(ui->shockButton, SIGNAL(released()), this, SLOT(deliverShock()));
+    connect(ui->aed, SIGNAL(shockClicked()), aed, SLOT(onShockPressed()));
     connect(ui->changeBatteryLevelButton, SIGNAL(released()), this, SLOT(onChangeBatteryLevel()));
-    connect(ui->battery, SIGNAL(toggled(bool)), this, SLOT(onBatteryClicked(bool)));
-    connect(ui->CPR, SIGNAL(clicked()), this, SLOT(handleCpr()));
+    connect(ui->battery, SIGNAL(toggled(bool)), this, SLOT(onInputWidgetChanged()));
+    connect(ui->selfTestCheckbox, SIGNAL(toggled(bool)), this, SLOT(onInputWidgetChanged()));
+    connect(ui->CPR, SIGNAL(clicked()), aed, SLOT(onCprPressed()));
+    connect(ui->cprDepth, SIGNAL(valueChanged(int)), this, SLOT(onInputWidgetChanged()));
     connect(ui->newRhythmButton, SIGNAL(clicked()), this, SLOT(onNewRhythm()));
 
-    // --- QTimers ---
-    connect(buttonHoldTimer, &QTimer::timeout, this, &MainWindow::checkButtonHoldDuration);
-    connect(elapsedTimer, &QTimer::timeout, this, &MainWindow::updateElapsedTimer);
-    connect(batteryDrainTimer, &QTimer::timeout, aed, &AED::onBatteryTimeDrain);
-
-    // -- AED Signal and Slots ---
-    connect(aed, SIGNAL(setPowerButtonStyleSheet(QString)), this, SLOT(onSetPowerButtonStyleSheet(QString)));
-    connect(aed, SIGNAL(informUser(QString)), this, SLOT(onInformUser(QString)));
-    connect(aed, SIGNAL(voiceText(QString)), this, SLOT(onVoiceText(QString)));
-    connect(aed, SIGNAL(batteryStatus()), this, SLOT(onBatteryStatus()));
-    connect(aed, SIGNAL(updateStatusIndicator(QString)), this, SLOT(onUpdateStatusIndicator(QString)));
-    connect(aed, SIGNAL(toggleElectrodeStates(bool)), this, SLOT(onToggleElectrodeStates(bool)));
-    connect(aed, SIGNAL(updateLight(bool,int)), this, SLOT(onUpdateLight(bool,int)));
-    connect(aed, SIGNAL(shockable()), this, SLOT(shockableStatus()));
-    connect(aed, SIGNAL(shockButton(bool)), this, SLOT(updateShockButton(bool)));
-    connect(aed, SIGNAL(updateBatteryLevel(int)), this, SLOT(onUpdateBatteryLevel(int)));
+    // --- Inputs forwarded to the AED ---
     connect(this, SIGNAL(changeBatteryLevel(int)), aed, SLOT(onChangeBatteryLevel(int)));
-    connect(aed, SIGNAL(getSelfTest()), this, SLOT(onGetSelfTest()));
-    connect(aed, SIGNAL(isElectrodeConnected()), this, SLOT(electrodeConnected()));
-    connect(aed, SIGNAL(isBatteryConnected()), this, SLOT(batteryConnected()));
-    connect(aed, SIGNAL(resetUI()), this, SLOT(onResetUI()));
-    connect(aed, SIGNAL(toggleRhythmOptions()), this, SLOT(onToggleRhythmOptions()));
+    connect(this, SIGNAL(rhythmSelected(int)), aed, SLOT(onRhythmSelected(int)));
 
+    // -- AED updates, drained on this thread (see onDrainUpdates()) ---
+    connect(link, &DeviceLink::updatesPending, this, &MainWindow::onDrainUpdates, Qt::QueuedConnection);
 }
 
 MainWindow::~MainWindow()
 {
+    // The device is deleted on its own thread as it finishes
+    if (deviceThread->isRunning()) {
+        if (deviceWatchdog != nullptr) {
+            qInfo("%s", qPrintable(watchdogReport()));
+        }
+        if (metrics != nullptr) {
+            // The session still running counts up to now
+            QMetaObject::invokeMethod(metrics, [this]() {
+                metrics->endSession();
+                metrics->exportMetrics();
+            }, Qt::BlockingQueuedConnection);
+        }
+        deviceThread->quit();
+        deviceThread->wait();
+    }
+    else {
+        delete aed;
+    }
     delete ui;
 }
 
-void MainWindow::delay(int seconds)
+AED* MainWindow::getAED()
 {
-    QEventLoop loop;
-    QTimer t;
-    t.connect(&t, &QTimer::timeout, &loop, &QEventLoop::quit);
-    t.start(seconds*1000);
-    loop.exec();
+    return aed;
 }
 
-void MainWindow::onPowerButtonPressed()
+void MainWindow::startDevice()
 {
-    // Start the timer when the button is pressed
-    buttonHoldTimer->start();
+    // Timers can only be started on their own thread, so the device moves once fully configured
+    aed->moveToThread(deviceThread);
+    deviceThread->start();
 }
 
-void MainWindow::onPowerButtonReleased()
+bool MainWindow::startRecording(QString path)
 {
-    // Stop the timer when the button is released
-    buttonHoldTimer->stop();
-
+    // Lives with the device, so it records on the device thread
+    EventRecorder* recorder = new EventRecorder(aed);
+    if (!recorder->open(path)) {
+        qWarning("recorder: cannot open %s: %s", qPrintable(path), qPrintable(recorder->getError()));
+        delete recorder;
+        return false;
+    }
+    return true;
 }
 
-void MainWindow::checkButtonHoldDuration()
+bool MainWindow::startReplay(QString path)
 {
-    // This slot is called when the timer times out (after 5 seconds)
-    if(aed->getPowerState()){
-        aed->setPowerState(false);
-        aed->shutDownDevice();
+    SessionReplay* replay = new SessionReplay(aed);
+    if (!replay->load(path)) {
+        qWarning("replay: cannot load %s: %s", qPrintable(path), qPrintable(replay->getError()));
+        delete replay;
+        return false;
     }
-    // Check if the button is still pressed after 5 seconds
-    else if(ui->powerButton->isDown())
-    {
-        // Every minute (60,000 milliseconds) drain 1%
-        batteryDrainTimer->start(60000);
-        aed->setPowerState(true);
-        aed->run();
+    aed->setSeed(replay->getSeed());
+
+    // A session recorded without streaming replays without it too, at the cost of the live trace
+    if (!replay->restoreEcg()) {
+        qWarning("replay: cannot restore the ECG of %s: %s", qPrintable(path), qPrintable(replay->getError()));
+        delete replay;
+        return false;
     }
 
+    // The controls stay visible but only the recording drives the device
+    replaying = true;
+    disconnect(ui->aed, nullptr, aed, nullptr);
+    disconnect(ui->CPR, nullptr, aed, nullptr);
+    disconnect(this, nullptr, aed, nullptr);
+
+    connect(replay, &SessionReplay::finished, this, [this, replay]() {
+        QString text = SessionReplay::reportText(replay->getReport());
+        qInfo("replay: %s", qPrintable(text));
+        statusBar()->showMessage("Replay finished: " + text);
+    }, Qt::QueuedConnection);
+
+    // Runs once the device thread starts
+    QMetaObject::invokeMethod(replay, "start", Qt::QueuedConnection);
+    return true;
+}
+
+void MainWindow::startMetrics(QString path)
+{
+    // Lives with the device, so it timestamps on the device thread
+    metrics = new MetricsCollector(aed);
+    metrics->setExportPath(path);
 }
 
-void MainWindow::updateElapsedTimer()
+void MainWindow::startWatchdog(int thresholdMsec, LoopWatchdog* guiWatchdog)
 {
-    if(aed->getPowerState()){
-        elapsedSeconds++;
+    this->guiWatchdog = guiWatchdog;
 
-        // Calculate minutes and seconds
-        int minutes = elapsedSeconds / 60;
-        int seconds = elapsedSeconds % 60;
+    // Lives with the device; the queued start runs once the device thread does
+    deviceWatchdog = new LoopWatchdog(deviceThread->objectName(), aed);
+    deviceWatchdog->setThreshold(thresholdMsec);
+    QMetaObject::invokeMethod(deviceWatchdog, &LoopWatchdog::start, Qt::QueuedConnection);
 
-        // Update the QLabel text with the formatted time
-        ui->elapsedtime->setText(QString("%1:%2").arg(minutes, 2, 10, QChar('0')).arg(seconds, 2, 10, QChar('0')));}
+    QShortcut* shortcut = new QShortcut(QKeySequence("Ctrl+Shift+W"), this);
+    connect(shortcut, SIGNAL(activated()), this, SLOT(onDumpWatchdogs()));
 }
 
-void MainWindow::onToggleElectrodeStates(bool state)
+QString MainWindow::watchdogReport()
 {
-    ui->adultPads->setEnabled(state);
-    ui->childPads->setEnabled(state);
+    QString text;
+    if (guiWatchdog != nullptr) {
+        text += guiWatchdog->dump();
+    }
+    text += deviceWatchdog->dump();
+
+    // The clock belongs to the device thread
+    Histogram lateness;
+    if (deviceThread->isRunning()) {
+        QMetaObject::invokeMethod(aed, [this, &lateness]() {
+            lateness = aed->getClock()->getLateness();
+        }, Qt::BlockingQueuedConnection);
+    }
+    text += QString("watchdog: device timers late by p50 %1 ms / p99 %2 ms / max %3 ms over %4 firings")
+        .arg(lateness.valueAtPercentile(50)).arg(lateness.valueAtPercentile(99))
+        .arg(lateness.getMax()).arg(lateness.getCount());
+    return text;
 }
 
-void MainWindow::handleElectrode()
+void MainWindow::onDumpWatchdogs()
+{
+    qInfo("%s", qPrintable(watchdogReport()));
+    statusBar()->showMessage("Watchdog report written to the log", 5000);
+}
+
+void MainWindow::publishInputs()
 {
-    if(aed->getPowerState()){
-        QCheckBox* checkBoxSender = qobject_cast<QCheckBox*>(sender());
-        QString electrode;
-
-        electrode = checkBoxSender->objectName();
-
-        if(checkBoxSender->isChecked()) {
-
-            if (electrode.contains("child", Qt::CaseInsensitive)) {
-                qInfo("Placing child electrode...\n");
-                ui->userdisplay->setText("Placing child electrode...");
-                ui->adultPads->setEnabled(false);
-            } else {
-                qInfo("Placing adult electrode...\n");
-                ui->userdisplay->setText("Placing adult electrode...");
-                ui->childPads->setEnabled(false);
-            }
-
-            delay(2);
-            ui->aed->setStyleSheet("border-image: url(:/overlay/aed.png);background-color: rgba(255, 255, 255, 0);");
-            qInfo("electrode connected.\n");
-            ui->userdisplay->setText("electrode connected.");
-
-            // If electrode connected but AED is off. Stop program
-            // Note: This code will be skipped when powered on. It will jump to analyzing step
-            if (!aed->getPowerState()) {
-                aed->setElectrodeConnected(true);
-                return;
-            }
-
-            delay(2);
-            onUpdateLight(false, 3);
-            onUpdateLight(true, 4);
-
-
-
-            if(aed->disconnected() && aed->getPowerState()){
-
-                ui->userdisplay->setText("checking if shockable rhythm is \npresent ...");
-                qInfo("checking if shockable rhythm is present ...\n");
-                aed->setElectrodeConnected(true);
-
-                onVoiceText("DO NOT TOUCH PATIENT.\n        ANALYZING");
-                aed->playAudio("qrc:/audio/DoNotTouchPatient.aiff");
-                ui->userdisplay->setText("DO NOT TOUCH PATIENT.\n        ANALYZING");
-                delay(2);
-                // Enable rhythm group box to select next rhythm
-                // Will trigger a slot that will call checkRhythm()
-                if (aed->disconnected() && aed->getPowerState()){
-                    ui->rhythmGroupBox->setDisabled(false);
-                    ui->newRhythmButton->setEnabled(true);
-                }
-            }
+    if (replaying) {
+        return;
     }
-        else{
-        onSetAEDStleSheet("border-image: url(:/overlay/aedNoElectrode.png);background-color: rgba(255, 255, 255, 0);");
-        }
+
+    DeviceInputs::Snapshot snapshot;
+    snapshot.adultPads = ui->adultPads->isChecked();
+    snapshot.childPads = ui->childPads->isChecked();
+    snapshot.batteryConnected = ui->battery->isChecked();
+    snapshot.selfTestPassed = ui->selfTestCheckbox->isChecked();
+    snapshot.cprDepth = ui->cprDepth->value();
+
+    if (aed->getInputs()->publish(snapshot)) {
+        QMetaObject::invokeMethod(aed, "onInputsChanged", Qt::QueuedConnection);
     }
 }
 
-void MainWindow::onSetPowerButtonStyleSheet(QString styleSheet)
+void MainWindow::onInputWidgetChanged()
 {
-    ui->powerButton->setStyleSheet(styleSheet);
+    publishInputs();
 }
 
-void MainWindow::onSetAEDStleSheet(QString stylesheet){
-    ui->aed->setStyleSheet(stylesheet);
+void MainWindow::onDrainUpdates()
+{
+    LoopWatchdog::Scope scope("MainWindow::onDrainUpdates");
+    UpdateQueue* queue = link->getQueue();
+    queue->disarmWakeup();
+
+    UpdateQueue::Update update;
+    while (queue->pop(update)) {
+        switch (update.kind) {
+        case UpdateQueue::InformUser:
+            onInformUser(update.text);
+            break;
+        case UpdateQueue::VoiceText:
+            onVoiceText(update.text);
+            break;
+        case UpdateQueue::Audio:
+            onPlayAudio(update.text);
+            break;
+        case UpdateQueue::ElectrodeOverlay:
+            ui->aed->setPadsConnected(update.value);
+            break;
+        case UpdateQueue::CprBar:
+            onDisplayCprBar(update.value);
+            break;
+        case UpdateQueue::StatusIndicator:
+            onUpdateStatusIndicator(update.value);
+            break;
+        case UpdateQueue::ElectrodeStates:
+            onToggleElectrodeStates(update.value);
+            break;
+        case UpdateQueue::Light:
+            ui->aed->setLight(update.value, update.arg);
+            break;
+        case UpdateQueue::ShockButton:
+            ui->aed->setShockEnabled(update.value);
+            break;
+        case UpdateQueue::BatteryLevel:
+            onUpdateBatteryLevel(update.value);
+            break;
+        case UpdateQueue::BatteryPrediction:
+            onUpdateBatteryPrediction(update.value, update.arg);
+            break;
+        case UpdateQueue::ShockCount:
+            onUpdateShockCount(update.value);
+            break;
+        case UpdateQueue::ElapsedTime:
+            onUpdateElapsedTime(update.value);
+            break;
+        case UpdateQueue::RhythmDetected:
+            onRhythmDetected(update.value);
+            break;
+        case UpdateQueue::CprButton:
+            onCprButton(update.value);
+            break;
+        case UpdateQueue::CprState:
+            onCprStateChanged(update.value);
+            break;
+        case UpdateQueue::ResetUI:
+            onResetUI();
+            break;
+        case UpdateQueue::PowerState:
+            ui->aed->setPowered(update.value);
+            break;
+        case UpdateQueue::StateChanged:
+            onStateChanged(update.value);
+            break;
+        case UpdateQueue::RhythmOptions:
+            onToggleRhythmOptions(update.value);
+            break;
+        case UpdateQueue::EcgSamples:
+            ui->heartSignal->appendSamples(update.samples);
+            break;
+        case UpdateQueue::EcgSampleRate:
+            ui->heartSignal->setSampleRate(update.value);
+            break;
+        }
+    }
 }
 
-void MainWindow::onInformUser(QString message)
+void MainWindow::setFrameStatsLogging(bool enabled)
 {
-    ui->userdisplay->setText(message);
+    if (enabled) {
+        frameStatsTimer->start(5000);
+    }
+    else {
+        frameStatsTimer->stop();
+    }
 }
 
-void MainWindow::onVoiceText(QString prompt){
-    ui->voiceprompt->setText(prompt);
+void MainWindow::setAssetStatsLogging(bool enabled)
+{
+    assetStatsLogging = enabled;
+    stepCounters = assets->getCounters();
 }
 
-bool MainWindow::onBatteryStatus()
+void MainWindow::onStateChanged(int state)
 {
-    return ui->battery->isChecked();
+    if (assetStatsLogging) {
+        AssetAtlas::Counters now = assets->getCounters();
+        qInfo("%s: assets in %s: %s", qPrintable(windowTitle()), qPrintable(AED::stateName(AED::State(currentStep))),
+              qPrintable(AssetAtlas::countersText(AssetAtlas::difference(now, stepCounters))));
+        stepCounters = now;
+    }
+    currentStep = state;
 }
 
-bool MainWindow::shockableStatus(){
-    // return ui->shockable->isChecked();
-    // TODO: Remove?
-    return true;
+void MainWindow::onLogFrameStats()
+{
+    qInfo("%s: %s", qPrintable(windowTitle()), qPrintable(ui->heartSignal->frameStatsText()));
+    qInfo("%s: %s", qPrintable(windowTitle()), qPrintable(UpdateQueue::statsText(link->getQueue()->getStats())));
 }
 
-void MainWindow::onUpdateStatusIndicator(QString image)
+void MainWindow::onPromptStarted(QString name, double latencyMsec)
 {
-    QPixmap existingPixmap(image);
-    ui->statusIndicator->setPixmap(existingPixmap);
+    statusBar()->showMessage(QString("%1: %2 ms to first audio frame | %3 | %4")
+                             .arg(name)
+                             .arg(latencyMsec, 0, 'f', 2)
+                             .arg(player->latencyStatsText())
+                             .arg(player->mixerStatsText()));
 }
 
-void MainWindow::onUpdateLight(bool state, int light)
+void MainWindow::onUpdateElapsedTime(int elapsedSeconds)
 {
-    QString image;
-    if (state == true) {
-        image = ":/indicators/lightOn.png";
-    }
-    else {
-        image = ":/indicators/lightOff.png";
-    }
-
-    QPixmap pixmap(image);
+    // Calculate minutes and seconds
+    int minutes = elapsedSeconds / 60;
+    int seconds = elapsedSeconds % 60;
 
-    if (light == 1) {
-        ui->light1->setPixmap(pixmap);
-    }
-    else if (light == 2) {
-        ui->light2->setPixmap(pixmap);
-    }
-    else if (light == 3) {
-        ui->light3->setPixmap(pixmap);
-    }
-    else if (light == 4) {
-        ui->light4->setPixmap(pixmap);
-    }
-    else if (light == 5) {
-        ui->light5->setPixmap(pixmap);
-    }
-    else if (light == 6) {
-        ui->light6->setPixmap(pixmap);
-    }
+    // Update the QLabel text with the formatted time
+    ui->elapsedtime->setText(QString("%1:%2").arg(minutes, 2, 10, QChar('0')).arg(seconds, 2, 10, QChar('0')));
 }
 
-void MainWindow::updateShockButton(bool enable){
-    ui->shockButton->setEnabled(enable);
+void MainWindow::onToggleElectrodeStates(bool state)
+{
+    ui->adultPads->setEnabled(state);
+    ui->childPads->setEnabled(state);
 }
 
-void MainWindow::deliverShock()
+void MainWindow::handleElectrode()
 {
-    if (aed->getBatteryLevel() <= 4) {
-        qInfo("change batteries\n");
-        onInformUser("change batteries");
-        onVoiceText("CHANGE BATTERIES");
-        aed->playAudio("qrc:/audio/ChangeBatteries.aiff");
-        return;
+    QCheckBox* checkBoxSender = qobject_cast<QCheckBox*>(sender());
+
+    // Only one pad type can be placed at a time
+    if(ui->aed->getVisualState().powered && checkBoxSender->isChecked()) {
+        if (checkBoxSender == ui->childPads) {
+            ui->adultPads->setEnabled(false);
+        } else {
+            ui->childPads->setEnabled(false);
+        }
     }
 
-    updateShockButton(false);
-
-    ui->userdisplay->setText("SHOCK DELIVERING IN\n 3..2..1");
-
+    publishInputs();
+}
 
-    ui->voiceprompt->setText("SHOCK DELIVERING\n IN 3..2..1");
+void MainWindow::onInformUser(QString message)
+{
+    ui->userdisplay->setText(message);
+}
 
-    aed->playAudio("qrc:/audio/ShockDelivering.aiff");
-    delay(4);
+void MainWindow::onVoiceText(QString prompt){
+    ui->voiceprompt->setText(prompt);
+}
 
-    aed->incrementShock();
-    ui->shockCount->setText("SHOCKS: " + QString::number(aed->getShockCount()));
+void MainWindow::onPlayAudio(QString audioFile)
+{
+    // Never waits: the player starts, queues or drops the prompt according to its priority
+    player->play(audioFile);
+}
 
-    int newBatteryLevel = aed->getBatteryLevel() - 5;
-    if (newBatteryLevel < 0) {
-        newBatteryLevel = 0;
+void MainWindow::setLabelPixmap(QLabel* label, QString image)
+{
+    // Shared handle from the atlas; a label already showing it is left alone
+    QPixmap pixmap = assets->pixmap(image, label->size());
+    if (label->pixmap().cacheKey() != pixmap.cacheKey()) {
+        label->setPixmap(pixmap);
     }
-    emit changeBatteryLevel(newBatteryLevel);
-    
-    aed->playAudio("qrc:/audio/ShockTone.aiff");
-    delay(2);
+}
 
-    ui->userdisplay->setText("SHOCK DELIVERED");
-    ui->voiceprompt->setText("SHOCK DELIVERED");
-    aed->playAudio("qrc:/audio/StockDelivered.aiff");
-    delay(3);
-    
-    ui->CPR->setEnabled(true);
-    aed->cprSequence();
+void MainWindow::onUpdateStatusIndicator(bool ok)
+{
+    ui->aed->setStatus(ok ? DevicePanel::StatusOk : DevicePanel::StatusNotOk);
+}
+
+void MainWindow::onUpdateShockCount(int shockCount)
+{
+    ui->shockCount->setText("SHOCKS: " + QString::number(shockCount));
 }
 
 void MainWindow::onUpdateBatteryLevel(int powerLevel)
@@ -310,160 +420,60 @@ void MainWindow::onUpdateBatteryLevel(int powerLevel)
 
 }
 
-void MainWindow::onBatteryClicked(bool batteryStatus)
+void MainWindow::onUpdateBatteryPrediction(int shocks, int runMinutes)
 {
-    if (batteryStatus == true) {
-        // Every minute (60,000 milliseconds) drain 1%
-        batteryDrainTimer->start(60000);
-        ui->userdisplay->setText("battery connected!");
+    ui->powerLevel->setToolTip(QString("About %1 shocks or %2:%3 h of use left")
+                               .arg(shocks).arg(runMinutes / 60).arg(runMinutes % 60, 2, 10, QChar('0')));
+}
+
+void MainWindow::onDisplayCprBar(bool show)
+{
+    if (show) {
+        setLabelPixmap(ui->barGraph, ":/shocks/bar.png");
     }
     else {
-        batteryDrainTimer->stop();
-        //aed->shutDownDevice();
+        ui->barGraph->clear();
     }
 }
 
-void MainWindow::handleCpr(){
-    ui->barGraph->setStyleSheet("border-image: url(:/shocks/bar.png);");
-
-    if (CPRpressed) {
-        ui->cprDepth->setEnabled(true);
-
-        // Perform actions for the first click (button pressed)
-        CPRpressed = false;
-        ui->CPR->setStyleSheet(" border:5px solid rgb(114, 47, 55); ");
-        ui->userdisplay->setText("Stop after 2 minutes.\n(10 seconds)");
-        delay(6);
-        int sliderValue = ui->cprDepth->value();
-        if (sliderValue < 40) {
-            ui->voiceprompt->setText("   Push harder.");
-            ui->userdisplay->setText("   Push harder.");
-            aed->playAudio("qrc:/audio/pushHarder.aiff");
-
-        }
-        else if (sliderValue > 60){
-            ui->voiceprompt->setText("   Push gently.");
-            ui->userdisplay->setText("   Push gently.");
-            aed->playAudio("qrc:/audio/pushGently.aiff");
-
-        }
-        else{
-            ui->voiceprompt->setText("   Maintain CPR depth.");
-            ui->userdisplay->setText("   Maintain CPR depth.");
-            aed->playAudio("qrc:/audio/maintainDepth.aiff");
-
-        }
-        delay(5);
+void MainWindow::onCprButton(bool enable)
+{
+    ui->CPR->setEnabled(enable);
+}
 
-        ui->voiceprompt->setText("STOP CPR");
-        aed->playAudio("qrc:/audio/StopCPR.aiff");
-        delay(3);
+void MainWindow::onCprStateChanged(bool active)
+{
+    ui->cprDepth->setEnabled(active);
+
+    // A palette change only repaints the button, unlike a style sheet
+    if (active) {
+        QPalette palette = ui->CPR->palette();
+        palette.setColor(QPalette::Button, QColor(114, 47, 55));
+        palette.setColor(QPalette::ButtonText, Qt::white);
+        ui->CPR->setPalette(palette);
     }
     else {
-        // Perform actions for the second click (return to normal)
-        ui->cprDepth->setEnabled(false);
-
-        ui->CPR->setStyleSheet(""); // Reset the style sheet to default
-        CPRpressed = true;
-
-        onUpdateLight(false, 5);
-        onUpdateLight(true, 4);
-
-        // Disable CPR button after CPR is performed
-        ui->CPR->setEnabled(false);
-
-        // Enable rhythm group box to select next rhythm
-        // Will trigger a slot that will call checkRhythm()
-        ui->rhythmGroupBox->setDisabled(false);
-        ui->newRhythmButton->setEnabled(true);
-        onVoiceText("DO NOT TOUCH PATIENT.\n        ANALYZING");
-        aed->playAudio("qrc:/audio/DoNotTouchPatient.aiff");
-        ui->userdisplay->setText("DO NOT TOUCH PATIENT.\n        ANALYZING");
-
+        ui->CPR->setPalette(QPalette());
     }
 }
 
-void MainWindow::checkRhythm(int rhythm)
+void MainWindow::onRhythmDetected(int rhythm)
 {
-    aed->checkShockableRhythm();
-
-    onVoiceText("DO NOT TOUCH PATIENT.\n        ANALYZING");
-    aed->playAudio("qrc:/audio/DoNotTouchPatient.aiff");
-    delay(4);
-
-    if(aed->disconnected() && aed->getPowerState()){
-
-        if (rhythm == 1 || rhythm == 2) {
-            onVoiceText("SHOCK ADVISED");
-            aed->playAudio("qrc:/audio/ShockAdvised.aiff");
-
-            if (rhythm == 1) {
-                QPixmap existingPixmap(":/shocks/shockable/vf.png");
-                // Set the existing QPixmap to the QLabel
-                ui->heartSignal->setPixmap(existingPixmap);
-                ui->userdisplay->setText("shockable rhythm detected! \n(ventricular fibrillation) ");
-                qInfo("shockable rhythm detected!!\n (ventricular fibrillation)");
-                ui->heartbeat->setText("ventricular fibrillation");
-            }
-            else {
-                QPixmap existingPixmap(":/shocks/shockable/vt.png");
-                // Set the existing QPixmap to the QLabel
-                ui->heartSignal->setPixmap(existingPixmap);
-                ui->userdisplay->setText("shockable rhythm detected!\n (ventricular tachycardia) ");
-                qInfo("shockable rhythm detected!!\n (ventricular tachycardia)");
-                ui->heartbeat->setText("ventricular tachycardia");
-            }
-
-            onUpdateLight(false, 4);
-            onUpdateLight(true, 6);
-            delay(2);
-
-            aed->shockSequence();
-        }
-        else {
-            onVoiceText("NO SHOCK ADVISED");
-            aed->playAudio("qrc:/audio/NoShockAdvised.aiff");
-
-            if (rhythm == 3) {
-                QPixmap existingPixmap(":/shocks/nonShockable/sinus.png");
-                // Set the existing QPixmap to the QLabel
-                ui->heartSignal->setPixmap(existingPixmap);
-                ui->userdisplay->setText("shockable rhythm undetected!\n(sinus)");
-                qInfo("shockable rhythm undetected!!\n(sinus)");
-                ui->heartbeat->setText("\tsinus");
-
-                delay(2);
-
-                ui->CPR->setEnabled(true);
-                aed->cprSequence();
-            }
-            else if (rhythm == 4) {
-                QPixmap existingPixmap(":/shocks/nonShockable/asystole.png");
-                // Set the existing QPixmap to the QLabel
-                ui->heartSignal->setPixmap(existingPixmap);
-                ui->userdisplay->setText("shockable rhythm not detected!\n(aystole)");
-                qInfo("shockable rhythm not detected!!\n(asystole)");
-                ui->heartbeat->setText("\taystole");
-                delay(2);
-                ui->userdisplay->setText("patient has passed\n away.");
-                qInfo("patient has passed away.\n");
-
-                // Do nothing, end program but keep device on
-            }
-            else if (rhythm == 5) {
-                QPixmap existingPixmap(":/shocks/nonShockable/sinus.png");
-                // Set the existing QPixmap to the QLabel
-                ui->heartSignal->setPixmap(existingPixmap);
-                ui->userdisplay->setText("shockable rhythm undetected!\n(regular)");
-                qInfo("shockable rhythm undetected!!\n(regular)");
-                ui->heartbeat->setText("\tregular");
-                delay(2);
-                ui->userdisplay->setText("patient has regular heartbeat.");
-
-                // Do nothing, end program but keep device on
-            }
-        }
-
+    // The trace itself comes from the device's ECG stream
+    if (rhythm == AED::VF) {
+        ui->heartbeat->setText("ventricular fibrillation");
+    }
+    else if (rhythm == AED::VT) {
+        ui->heartbeat->setText("ventricular tachycardia");
+    }
+    else if (rhythm == AED::PEA) {
+        ui->heartbeat->setText("\tsinus");
+    }
+    else if (rhythm == AED::Asystole) {
+        ui->heartbeat->setText("\tasystole");
+    }
+    else if (rhythm == AED::Regular) {
+        ui->heartbeat->setText("\tregular");
     }
 }
 
@@ -474,79 +484,49 @@ void MainWindow::onChangeBatteryLevel()
     emit changeBatteryLevel(powerLevel);
 }
 
-bool MainWindow::onGetSelfTest()
-{
-    return ui->selfTestCheckbox->isChecked();
-}
-
 void MainWindow::onNewRhythm()
 {
-    if(aed->disconnected() && aed->getPowerState()){
-        int newRhythm = -1;
-
-        if (ui->VF_RadioButton->isChecked()) {
-            newRhythm = 1;
-        }
-        else if (ui->VT_RadioButton->isChecked()) {
-            newRhythm = 2;
-        }
-        else if (ui->PEA_RadioButton->isChecked()) {
-            newRhythm = 3;
-        }
-        else if (ui->Asytole_RadioButton->isChecked()) {
-            newRhythm = 4;
-        }
-        else if (ui->Regular_RadioButton->isChecked()) {
-            newRhythm = 5;
-        }
+    int newRhythm = AED::NoRhythm;
 
-
-        if (newRhythm != -1) {
-            ui->rhythmGroupBox->setDisabled(true);
-            ui->newRhythmButton->setEnabled(false);
-
-            checkRhythm(newRhythm);
-        }
+    if (ui->VF_RadioButton->isChecked()) {
+        newRhythm = AED::VF;
+    }
+    else if (ui->VT_RadioButton->isChecked()) {
+        newRhythm = AED::VT;
+    }
+    else if (ui->PEA_RadioButton->isChecked()) {
+        newRhythm = AED::PEA;
+    }
+    else if (ui->Asytole_RadioButton->isChecked()) {
+        newRhythm = AED::Asystole;
+    }
+    else if (ui->Regular_RadioButton->isChecked()) {
+        newRhythm = AED::Regular;
     }
-}
-
-bool MainWindow::electrodeConnected(){
-    if(ui->adultPads->isChecked() || ui->childPads->isChecked()){return true;}
-    else {return false;}
-}
 
-bool MainWindow::batteryConnected(){
-    if(ui->battery->isChecked()){return true;}
-    return false;
+    if (newRhythm != AED::NoRhythm) {
+        emit rhythmSelected(newRhythm);
+    }
 }
 
 void MainWindow::onResetUI(){
-    elapsedSeconds = 0;
-    CPRpressed = true;
-    batteryDrainTimer->stop();
     ui->CPR->setEnabled(false);
-    ui->shockButton->setEnabled(false);
+    ui->CPR->setPalette(QPalette());
+    ui->cprDepth->setEnabled(false);
     onToggleElectrodeStates(false);
-    elapsedTimer->start(1000);
-    updateElapsedTimer();
-    ui->powerButton->setStyleSheet("QPushButton {image: url(:/buttons/powerButton.png);border-radius: 20px;}QPushButton:hover {image: url(:/buttons/powerbuttonON.png);border-radius: 20px;}");
+    onToggleRhythmOptions(false);
     ui->userdisplay->setText("");
     ui->voiceprompt->setText("");
-    onUpdateStatusIndicator(":/indicators/statusOff.png");
-    ui->barGraph->setStyleSheet("");
-    for (int i = 1; i<=6; i++){
-        onUpdateLight(false, i);
-    }
+    ui->barGraph->clear();
+    ui->heartSignal->clear();
+    player->stop();
+
+    // Power off, status off, every light off and the shock button disabled, in one repaint
+    ui->aed->reset();
 }
 
-void MainWindow::onToggleRhythmOptions()
+void MainWindow::onToggleRhythmOptions(bool enable)
 {
-    if (!ui->newRhythmButton->isEnabled()) {
-        ui->rhythmGroupBox->setDisabled(false);
-        ui->newRhythmButton->setEnabled(true);
-    }
-    else {
-        ui->rhythmGroupBox->setDisabled(true);
-        ui->newRhythmButton->setEnabled(false);
-    }
+    ui->rhythmGroupBox->setDisabled(!enable);
+    ui->newRhythmButton->setEnabled(enable);
 }
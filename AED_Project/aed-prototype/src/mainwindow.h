@@ -4,7 +4,17 @@
 #include <QMainWindow>
 #include <iostream>
 #include <QTimer>
+#include <QThread>
 #include "AED.h"
+#include "devicelink.h"
+#include "eventrecorder.h"
+#include "sessionreplay.h"
+#include "metricscollector.h"
+#include "loopwatchdog.h"
+#include "ecgtracewidget.h"
+#include "promptplayer.h"
+#include "assetatlas.h"
+#include "devicepanel.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -15,53 +25,86 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = nullptr);
+    // Voice prompts and images come from caches shared by every window. Not owned.
+    MainWindow(PromptCache* prompts, AssetAtlas* assets, QWidget *parent = nullptr);
     ~MainWindow();
 
+    // The device runs on its own thread once started; configure it (clock, ECG source) before that
+    AED* getAED();
+    void startDevice();
+
+    // Keeps the session's event memory in a binary log; call before startDevice()
+    bool startRecording(QString path);
+
+    // Plays a recorded session into the device instead of taking the trainee's inputs; call before
+    // startDevice()
+    bool startReplay(QString path);
+
+    // Writes the session's protocol timing metrics to a file every few seconds and on close
+    void startMetrics(QString path);
+
+    // Watches the device thread's event loop for stalls, next to a watchdog already running on the
+    // GUI thread (not owned). Ctrl+Shift+W logs both; call before startDevice()
+    void startWatchdog(int thresholdMsec, LoopWatchdog* guiWatchdog);
+
+    // Periodically log the ECG trace frame-time statistics
+    void setFrameStatsLogging(bool enabled);
+
+    // Log image decodes and pixmap allocations for every protocol step
+    void setAssetStatsLogging(bool enabled);
+
 private:
     Ui::MainWindow *ui;
     AED* aed;
-    QTimer* buttonHoldTimer;
-    QTimer *elapsedTimer;
-    int elapsedSeconds;
-    QTimer* batteryDrainTimer;
-    bool CPRpressed;
+    QThread* deviceThread;
+    DeviceLink* link;
+    PromptPlayer* player;
+    QTimer* frameStatsTimer;
+    bool replaying;
+    MetricsCollector* metrics;
+    LoopWatchdog* deviceWatchdog;
+    LoopWatchdog* guiWatchdog;
+
+    AssetAtlas* assets;
+    bool assetStatsLogging;
+    AssetAtlas::Counters stepCounters;      // atlas counters when the current step began
+    int currentStep;
 
-    void delay(int seconds);
-    void checkRhythm(int rythm);
+    void setLabelPixmap(QLabel* label, QString image);
+    void publishInputs();
+    QString watchdogReport();
 
 private slots:
     void handleElectrode();
-    void onPowerButtonPressed();
-    void onPowerButtonReleased();
-    void checkButtonHoldDuration();
-    void updateElapsedTimer();
-    void deliverShock();
-    void onBatteryClicked(bool batteryStatus);
+    void onInputWidgetChanged();
+    void onDrainUpdates();
     void onChangeBatteryLevel();
     void onNewRhythm();
+    void onLogFrameStats();
+    void onPromptStarted(QString name, double latencyMsec);
+    void onStateChanged(int state);
+    void onDumpWatchdogs();
 
 public slots:
-    void onSetPowerButtonStyleSheet(QString styleSheet);
-    void onSetAEDStleSheet(QString Stylesheet);
     void onInformUser(QString);
     void onVoiceText(QString);
-    void handleCpr();
-    bool onBatteryStatus();
-    bool shockableStatus();
-    void onUpdateStatusIndicator(QString image);
+    void onPlayAudio(QString audioFile);
+    void onUpdateStatusIndicator(bool ok);
     void onToggleElectrodeStates(bool state);
-    void onUpdateLight(bool state, int light);
-    void updateShockButton(bool enable);
     void onUpdateBatteryLevel(int batteryLevel);
-    bool onGetSelfTest();
-    bool electrodeConnected();
-    bool batteryConnected();
+    void onUpdateBatteryPrediction(int shocks, int runMinutes);
+    void onUpdateShockCount(int shockCount);
+    void onUpdateElapsedTime(int elapsedSeconds);
+    void onRhythmDetected(int rhythm);
+    void onDisplayCprBar(bool show);
+    void onCprButton(bool enable);
+    void onCprStateChanged(bool active);
     void onResetUI();
-    void onToggleRhythmOptions();
+    void onToggleRhythmOptions(bool enable);
 
 signals:
     void changeBatteryLevel(int newBatteryLevel);
+    void rhythmSelected(int rhythm);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,169 @@
+#include "metricscollector.h"
+
+MetricsCollector::MetricsCollector(AED *aed)
+    : QObject{aed}
+{
+    this->aed = aed;
+    state = aed->getState();
+    stateMsec = aed->getClock()->now();
+    sessionMsec = -1;
+    analysisMsec = -1;
+    shockEnabledMsec = -1;
+    interruptionMsec = -1;
+    cprMsec = -1;
+    cprTotalMsec = 0;
+    analyzed = false;
+    shocked = false;
+
+    exportTimer = new QTimer(this);
+    connect(exportTimer, &QTimer::timeout, this, &MetricsCollector::exportMetrics);
+
+    // Direct connections: timestamps are taken as the device emits
+    connect(aed, &AED::stateChanged, this, &MetricsCollector::onStateChanged, Qt::DirectConnection);
+    connect(aed, &AED::powerStateChanged, this, &MetricsCollector::onPowerStateChanged, Qt::DirectConnection);
+    connect(aed, &AED::shockButton, this, &MetricsCollector::onShockButton, Qt::DirectConnection);
+    connect(aed, &AED::cprStateChanged, this, &MetricsCollector::onCprStateChanged, Qt::DirectConnection);
+}
+
+MetricsCollector::~MetricsCollector()
+{
+    // The device's clock may already be gone, so a running session is not counted here
+    exportMetrics();
+}
+
+const ProtocolMetrics& MetricsCollector::getMetrics()
+{
+    return metrics;
+}
+
+void MetricsCollector::setExportPath(QString path, int intervalMsec)
+{
+    exportPath = path;
+    exportTimer->start(intervalMsec);
+}
+
+void MetricsCollector::exportMetrics()
+{
+    if (exportPath.isEmpty()) {
+        return;
+    }
+    QString error;
+    if (!metrics.save(exportPath, &error)) {
+        qWarning("metrics: cannot write %s: %s", qPrintable(exportPath), qPrintable(error));
+    }
+}
+
+void MetricsCollector::onStateChanged(int next)
+{
+    qint64 now = aed->getClock()->now();
+
+    // Time spent in the step being left; Off is the device at rest, not a step
+    if (state != AED::Off) {
+        metrics.recordStep(state, now - stateMsec);
+    }
+    if (interruptionMsec >= 0 && next != state) {
+        metrics.record(state == AED::PadsDisconnected ? ProtocolMetrics::PadsInterruption : ProtocolMetrics::BatteryInterruption,
+                       now - interruptionMsec);
+        interruptionMsec = -1;
+    }
+    metrics.count(ProtocolMetrics::Transitions);
+
+    switch (next) {
+    case AED::Analyzing:
+        metrics.count(ProtocolMetrics::Analyses);
+        if (!analyzed && sessionMsec >= 0) {
+            metrics.record(ProtocolMetrics::PowerOnToAnalysis, now - sessionMsec);
+        }
+        analyzed = true;
+        analysisMsec = now;
+        break;
+    case AED::ShockReady:
+        if (analysisMsec >= 0) {
+            metrics.record(ProtocolMetrics::AnalysisToShockReady, now - analysisMsec);
+            analysisMsec = -1;
+        }
+        break;
+    case AED::ShockDelivering:
+        if (shockEnabledMsec >= 0) {
+            metrics.record(ProtocolMetrics::ShockEnabledToDelivery, now - shockEnabledMsec);
+            shockEnabledMsec = -1;
+        }
+        break;
+    case AED::ShockRefused:
+        metrics.count(ProtocolMetrics::ShocksRefused);
+        break;
+    case AED::ShockTone:
+        metrics.count(ProtocolMetrics::Shocks);
+        if (!shocked && sessionMsec >= 0) {
+            metrics.record(ProtocolMetrics::PowerOnToFirstShock, now - sessionMsec);
+        }
+        shocked = true;
+        break;
+    case AED::PadsDisconnected:
+    case AED::BatteryDisconnected:
+        if (next != state) {
+            metrics.count(next == AED::PadsDisconnected ? ProtocolMetrics::PadsInterruptions : ProtocolMetrics::BatteryInterruptions);
+            interruptionMsec = now;
+        }
+        break;
+    default:
+        break;
+    }
+
+    state = AED::State(next);
+    stateMsec = now;
+}
+
+void MetricsCollector::onPowerStateChanged(bool on)
+{
+    qint64 now = aed->getClock()->now();
+
+    if (on) {
+        metrics.count(ProtocolMetrics::Sessions);
+        sessionMsec = now;
+        analysisMsec = -1;
+        shockEnabledMsec = -1;
+        cprMsec = -1;
+        cprTotalMsec = 0;
+        analyzed = false;
+        shocked = false;
+    }
+    else {
+        endSession();
+    }
+}
+
+void MetricsCollector::endSession()
+{
+    if (sessionMsec < 0) {
+        return;
+    }
+
+    qint64 now = aed->getClock()->now();
+    if (cprMsec >= 0) {
+        cprTotalMsec += now - cprMsec;
+        cprMsec = -1;
+    }
+    metrics.record(ProtocolMetrics::SessionLength, now - sessionMsec);
+    metrics.record(ProtocolMetrics::HandsOff, now - sessionMsec - cprTotalMsec);
+    sessionMsec = -1;
+}
+
+void MetricsCollector::onShockButton(bool enable)
+{
+    if (enable) {
+        shockEnabledMsec = aed->getClock()->now();
+    }
+}
+
+void MetricsCollector::onCprStateChanged(bool active)
+{
+    qint64 now = aed->getClock()->now();
+    if (active && cprMsec < 0) {
+        cprMsec = now;
+    }
+    else if (!active && cprMsec >= 0) {
+        cprTotalMsec += now - cprMsec;
+        cprMsec = -1;
+    }
+}
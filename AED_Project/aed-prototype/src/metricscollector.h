@@ -0,0 +1,58 @@
+#ifndef METRICSCOLLECTOR_H
+#define METRICSCOLLECTOR_H
+
+#include <QObject>
+#include <QTimer>
+#include "protocolmetrics.h"
+
+// Fills a ProtocolMetrics from one AED's signals.
+// Created as a child of the AED, it runs on the device's thread and only keeps a few timestamps
+// between signals; all times come from the device clock, so accelerated runs measure protocol time.
+// With an export path set, the metrics are written there periodically and when the device goes away.
+class MetricsCollector : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int DefaultExportMsec = 10000;
+
+    explicit MetricsCollector(AED *aed);
+    ~MetricsCollector();        // exports a last time
+
+    // Read from another thread only once the device's thread has stopped
+    const ProtocolMetrics& getMetrics();
+
+    void setExportPath(QString path, int intervalMsec = DefaultExportMsec);
+
+public slots:
+    void exportMetrics();
+
+    // Counts a session still running as ended now, e.g. a device left on when the run stops
+    void endSession();
+
+private slots:
+    void onStateChanged(int state);
+    void onPowerStateChanged(bool on);
+    void onShockButton(bool enable);
+    void onCprStateChanged(bool active);
+
+private:
+    AED* aed;
+    ProtocolMetrics metrics;
+    QString exportPath;
+    QTimer* exportTimer;
+
+    // Device time of the moments the intervals run from, -1 while not running
+    AED::State state;
+    qint64 stateMsec;
+    qint64 sessionMsec;
+    qint64 analysisMsec;
+    qint64 shockEnabledMsec;
+    qint64 interruptionMsec;
+    qint64 cprMsec;
+    qint64 cprTotalMsec;        // CPR time of the session so far
+    bool analyzed;
+    bool shocked;
+};
+
+#endif // METRICSCOLLECTOR_H
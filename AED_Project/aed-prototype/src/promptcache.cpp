@@ -0,0 +1,200 @@
+#include "promptcache.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+
+PromptCache::PromptCache()
+{
+    sampleRate = DefaultSampleRate;
+    bytes = 0;
+    decodeNsec = 0;
+}
+
+void PromptCache::setSampleRate(int hz)
+{
+    if (hz <= 0 || hz == sampleRate) {
+        return;
+    }
+
+    sampleRate = hz;
+    prompts.clear();
+    bytes = 0;
+}
+
+int PromptCache::getSampleRate()
+{
+    return sampleRate;
+}
+
+int PromptCache::preload(QString directory)
+{
+    int decoded = 0;
+    QDir dir(directory);
+    const QStringList files = dir.entryList(QStringList() << "*.aiff" << "*.aif", QDir::Files);
+    for (const QString &file : files) {
+        if (!find(dir.filePath(file)).isEmpty()) {
+            decoded++;
+        }
+    }
+    return decoded;
+}
+
+QVector<qint16> PromptCache::find(QString source)
+{
+    QString path = resourcePath(source);
+    auto it = prompts.constFind(path);
+    if (it != prompts.constEnd()) {
+        return it.value();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QVector<qint16> pcm;
+    if (!decodeAiff(path, pcm)) {
+        return QVector<qint16>();
+    }
+
+    decodeNsec += timer.nsecsElapsed();
+    bytes += pcm.size() * qint64(sizeof(qint16));
+    prompts.insert(path, pcm);
+    return pcm;
+}
+
+QString PromptCache::getError()
+{
+    return error;
+}
+
+int PromptCache::getPromptCount()
+{
+    return prompts.size();
+}
+
+qint64 PromptCache::getBytes()
+{
+    return bytes;
+}
+
+qint64 PromptCache::getDecodeNsec()
+{
+    return decodeNsec;
+}
+
+QString PromptCache::promptName(QString source)
+{
+    return QFileInfo(resourcePath(source)).completeBaseName();
+}
+
+QString PromptCache::resourcePath(QString source)
+{
+    // The protocol names prompts by URL; QFile wants the resource path
+    if (source.startsWith("qrc:")) {
+        return source.mid(3);
+    }
+    return source;
+}
+
+bool PromptCache::decodeAiff(QString path, QVector<qint16> &pcm)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = QString("%1: %2").arg(path, file.errorString());
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    const uchar* p = reinterpret_cast<const uchar*>(data.constData());
+    const qint64 size = data.size();
+
+    if (size < 12 || std::memcmp(p, "FORM", 4) != 0
+            || (std::memcmp(p + 8, "AIFF", 4) != 0 && std::memcmp(p + 8, "AIFC", 4) != 0)) {
+        error = QString("%1: not an AIFF file").arg(path);
+        return false;
+    }
+    bool aifc = std::memcmp(p + 8, "AIFC", 4) == 0;
+
+    int channels = 0;
+    qint64 frames = 0;
+    int bits = 0;
+    double rate = 0;
+    bool littleEndian = false;
+    const uchar* sound = nullptr;
+    qint64 soundBytes = 0;
+
+    qint64 pos = 12;
+    while (pos + 8 <= size) {
+        const uchar* chunk = p + pos;
+        quint32 length = qFromBigEndian<quint32>(chunk + 4);
+        const uchar* body = chunk + 8;
+        qint64 available = qMin<qint64>(length, size - pos - 8);
+
+        if (std::memcmp(chunk, "COMM", 4) == 0 && available >= 18) {
+            channels = qFromBigEndian<qint16>(body);
+            frames = qFromBigEndian<quint32>(body + 2);
+            bits = qFromBigEndian<qint16>(body + 6);
+
+            // Sample rate is an 80-bit IEEE extended float
+            int exponent = qFromBigEndian<quint16>(body + 8) & 0x7fff;
+            quint64 mantissa = qFromBigEndian<quint64>(body + 10);
+            rate = std::ldexp(double(mantissa), exponent - 16383 - 63);
+
+            if (aifc && available >= 22) {
+                QByteArray compression(reinterpret_cast<const char*>(body + 18), 4);
+                if (compression == "sowt") {
+                    littleEndian = true;
+                }
+                else if (compression != "NONE" && compression != "twos") {
+                    error = QString("%1: unsupported compression %2").arg(path, QString::fromLatin1(compression));
+                    return false;
+                }
+            }
+        }
+        else if (std::memcmp(chunk, "SSND", 4) == 0 && available >= 8) {
+            quint32 offset = qFromBigEndian<quint32>(body);
+            if (8 + qint64(offset) <= available) {
+                sound = body + 8 + offset;
+                soundBytes = available - 8 - offset;
+            }
+        }
+
+        pos += 8 + qint64(length) + (length & 1);
+    }
+
+    if (channels <= 0 || bits != 16 || rate <= 0 || sound == nullptr) {
+        error = QString("%1: only 16-bit linear PCM is supported").arg(path);
+        return false;
+    }
+    frames = qMin(frames, soundBytes / (2 * channels));
+
+    // Mix down to mono
+    QVector<qint16> mono(frames);
+    for (qint64 f = 0; f < frames; f++) {
+        int sum = 0;
+        for (int c = 0; c < channels; c++) {
+            const uchar* sample = sound + (f * channels + c) * 2;
+            sum += littleEndian ? qFromLittleEndian<qint16>(sample) : qFromBigEndian<qint16>(sample);
+        }
+        mono[f] = qint16(sum / channels);
+    }
+
+    if (qRound(rate) == sampleRate || frames < 2) {
+        pcm = mono;
+        return true;
+    }
+
+    // Linear interpolation is plenty for speech going to a small speaker
+    qint64 outFrames = qint64(frames * double(sampleRate) / rate);
+    double step = rate / sampleRate;
+    pcm.resize(outFrames);
+    for (qint64 i = 0; i < outFrames; i++) {
+        double x = i * step;
+        qint64 k = qMin(qint64(x), frames - 2);
+        double frac = x - k;
+        pcm[i] = qint16(qRound(mono[k] * (1.0 - frac) + mono[k + 1] * frac));
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef PROMPTCACHE_H
+#define PROMPTCACHE_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+// Voice prompts decoded once into PCM.
+// The prompts ship as AIFF/AIFF-C files in the resources; each one is parsed, mixed down to mono and
+// resampled to the output rate the first time it is needed (or up front with preload()), so playing
+// a prompt afterwards is only a buffer hand-over.
+// Samples are implicitly shared, so a prompt can keep playing while the cache grows.
+class PromptCache
+{
+public:
+    // Rate the shipped prompts are recorded at
+    static const int DefaultSampleRate = 22050;
+
+    PromptCache();
+
+    void setSampleRate(int hz);         // drops everything decoded so far
+    int getSampleRate();
+
+    // Decodes every .aiff file in a directory, e.g. ":/audio". Returns the number of prompts decoded.
+    int preload(QString directory = ":/audio");
+
+    // Mono samples of a prompt ("qrc:/audio/StayCalm.aiff" or ":/audio/StayCalm.aiff"), decoded on
+    // first use. Empty if the file cannot be decoded.
+    QVector<qint16> find(QString source);
+
+    QString getError();
+    int getPromptCount();
+    qint64 getBytes();
+    qint64 getDecodeNsec();             // total time spent decoding
+
+    static QString promptName(QString source);  // "StayCalm"
+
+private:
+    int sampleRate;
+    QHash<QString, QVector<qint16>> prompts;
+    QString error;
+    qint64 bytes;
+    qint64 decodeNsec;
+
+    static QString resourcePath(QString source);
+    bool decodeAiff(QString path, QVector<qint16> &pcm);
+};
+
+#endif // PROMPTCACHE_H
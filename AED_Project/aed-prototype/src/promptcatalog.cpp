@@ -0,0 +1,24 @@
+#include "promptcatalog.h"
+
+QString PromptCatalog::wrap(const char16_t* text)
+{
+    if (text == nullptr) {
+        return QString();
+    }
+    return QString::fromRawData(reinterpret_cast<const QChar*>(text), length(text));
+}
+
+QString PromptCatalog::display(Prompt prompt)
+{
+    return wrap(ENTRIES[prompt].display);
+}
+
+QString PromptCatalog::voice(Prompt prompt)
+{
+    return wrap(ENTRIES[prompt].voice);
+}
+
+QString PromptCatalog::audio(Prompt prompt)
+{
+    return wrap(ENTRIES[prompt].audio);
+}
@@ -0,0 +1,189 @@
+#ifndef PROMPTCATALOG_H
+#define PROMPTCATALOG_H
+
+#include <QString>
+#include "qrcurls.h"        // generated by engine.pri from res/aed.qrc
+
+// Everything the device shows on its display or says through its speaker.
+// A prompt pairs up to three parts: the display text, the caption of the voice prompt and the audio
+// resource played with it; a part a prompt doesn't have is nullptr. The table is constexpr UTF-16,
+// so handing a part out is a QString over the static data (QString::fromRawData) that is neither
+// allocated nor copied, and neither are the copies the front ends and the recorder take of it.
+// The checks below the class reject, at compile time, a table out of order with the enum and an
+// audio resource that aed.qrc doesn't list.
+class PromptCatalog
+{
+public:
+    // In the order of the ENTRIES table
+    enum Prompt {
+        BatteryDrained,
+        SelfTestStarting,
+        CheckingBattery,
+        BatteryOk,
+        ChangeBatteries,
+        UnitFailed,
+        SelfTestPassed,
+        UnitOk,
+        StayCalm,
+        CheckResponsiveness,
+        CallForHelp,
+        AttachPads,
+        PlacingChildPads,
+        PlacingAdultPads,
+        PadsConnected,
+        CheckingRhythm,
+        DoNotTouchPatient,
+        Analyzing,
+        ShockAdvised,
+        ShockableVf,
+        ShockableVt,
+        Shockable,
+        DeliverShock,
+        ShockDelivering,
+        ShockTone,
+        ShockDelivered,
+        NoShockAdvised,
+        NoShockSinus,
+        NoShockAsystole,
+        NoShockRegular,
+        PatientDeceased,
+        RegularHeartbeat,
+        StartCpr,
+        CprCoaching,
+        PushHarder,
+        PushGently,
+        MaintainDepth,
+        StopCpr,
+        PadsDisconnected,
+        BatteryDisconnected,
+        BatteryConnected,
+        PromptCount
+    };
+
+    struct Entry {
+        Prompt prompt;
+        const char16_t* display;
+        const char16_t* voice;
+        const char16_t* audio;      // qrc: URL
+    };
+
+    // Said while the pads analyse, and shown as well unless the display already says it
+    static constexpr char16_t DO_NOT_TOUCH[] = u"DO NOT TOUCH PATIENT.\n        ANALYZING";
+
+    static constexpr Entry ENTRIES[] = {
+        {BatteryDrained, u"Battery drained. \n Device shutting down.", nullptr, nullptr},
+        {SelfTestStarting, u"initiating self test .... ", nullptr, nullptr},
+        {CheckingBattery, u"checking battery level...", nullptr, nullptr},
+        {BatteryOk, u"battery has enough charge!", nullptr, nullptr},
+        {ChangeBatteries, u"change batteries", u"CHANGE BATTERIES", u"qrc:/audio/ChangeBatteries.aiff"},
+        {UnitFailed, u"self test failed", u"UNIT FAILED", u"qrc:/audio/UnitFailed.aiff"},
+        {SelfTestPassed, u"self test passed!", nullptr, nullptr},
+        {UnitOk, u"Self test successful! device is on \nand the user can proceed now.", u"     UNIT OK",
+            u"qrc:/audio/UnitOkay.aiff"},
+        {StayCalm, nullptr, u"     STAY CALM", u"qrc:/audio/StayCalm.aiff"},
+        {CheckResponsiveness, nullptr, u"  CHECK RESPONSIVENESS", u"qrc:/audio/CheckResponsiveness.aiff"},
+        {CallForHelp, nullptr, u"    CALL FOR HELP", u"qrc:/audio/CallForHelp.aiff"},
+        {AttachPads, u"Place adult/child electrode pads on \nthe patient's bare chest.",
+            u"ATTACH DEFIBRILLATION\n      PADS TO PATIENTS \n          BARE CHEST", u"qrc:/audio/DefibPadsToChest.aiff"},
+        {PlacingChildPads, u"Placing child electrode...", nullptr, nullptr},
+        {PlacingAdultPads, u"Placing adult electrode...", nullptr, nullptr},
+        {PadsConnected, u"electrode connected.", nullptr, nullptr},
+        {CheckingRhythm, u"checking if shockable rhythm is \npresent ...", nullptr, nullptr},
+        {DoNotTouchPatient, DO_NOT_TOUCH, DO_NOT_TOUCH, u"qrc:/audio/DoNotTouchPatient.aiff"},
+        {Analyzing, nullptr, DO_NOT_TOUCH, u"qrc:/audio/DoNotTouchPatient.aiff"},
+        {ShockAdvised, nullptr, u"SHOCK ADVISED", u"qrc:/audio/ShockAdvised.aiff"},
+        {ShockableVf, u"shockable rhythm detected! \n(ventricular fibrillation) ", nullptr, nullptr},
+        {ShockableVt, u"shockable rhythm detected!\n (ventricular tachycardia) ", nullptr, nullptr},
+        {Shockable, u"shockable rhythm detected!", nullptr, nullptr},
+        {DeliverShock, u"Deliver shock to \nthe patient.", nullptr, nullptr},
+        {ShockDelivering, u"SHOCK DELIVERING IN\n 3..2..1", u"SHOCK DELIVERING\n IN 3..2..1",
+            u"qrc:/audio/ShockDelivering.aiff"},
+        {ShockTone, nullptr, nullptr, u"qrc:/audio/ShockTone.aiff"},
+        {ShockDelivered, u"SHOCK DELIVERED", u"SHOCK DELIVERED", u"qrc:/audio/StockDelivered.aiff"},
+        {NoShockAdvised, nullptr, u"NO SHOCK ADVISED", u"qrc:/audio/NoShockAdvised.aiff"},
+        {NoShockSinus, u"shockable rhythm undetected!\n(sinus)", nullptr, nullptr},
+        {NoShockAsystole, u"shockable rhythm not detected!\n(asystole)", nullptr, nullptr},
+        {NoShockRegular, u"shockable rhythm undetected!\n(regular)", nullptr, nullptr},
+        {PatientDeceased, u"patient has passed\n away.", nullptr, nullptr},
+        {RegularHeartbeat, u"patient has regular heartbeat.", nullptr, nullptr},
+        {StartCpr, u"Perform CPR on patient.", u"START CPR", u"qrc:/audio/StartCPR.aiff"},
+        {CprCoaching, u"Stop after 2 minutes.\n(10 seconds)", nullptr, nullptr},
+        {PushHarder, u"   Push harder.", u"   Push harder.", u"qrc:/audio/pushHarder.aiff"},
+        {PushGently, u"   Push gently.", u"   Push gently.", u"qrc:/audio/pushGently.aiff"},
+        {MaintainDepth, u"   Maintain CPR depth.", u"   Maintain CPR depth.", u"qrc:/audio/maintainDepth.aiff"},
+        {StopCpr, nullptr, u"STOP CPR", u"qrc:/audio/StopCPR.aiff"},
+        {PadsDisconnected, u"Electrode disconnected.\nPlease connect electrode.", nullptr, nullptr},
+        {BatteryDisconnected, u"Battery disconnected.\nPlease connect battery.", nullptr, nullptr},
+        {BatteryConnected, u"battery connected!", nullptr, nullptr},
+    };
+
+    // Empty strings for the parts a prompt doesn't have
+    static QString display(Prompt prompt);
+    static QString voice(Prompt prompt);
+    static QString audio(Prompt prompt);
+
+    // Compile-time checks
+    static constexpr bool inOrder();
+    static constexpr bool isResource(const char16_t* url);
+    static constexpr int missingAudio();        // first prompt whose audio isn't in aed.qrc, -1 for none
+
+private:
+    static constexpr bool equal(const char16_t* a, const char16_t* b);
+    static constexpr int length(const char16_t* text);
+    static QString wrap(const char16_t* text);
+};
+
+constexpr bool PromptCatalog::equal(const char16_t* a, const char16_t* b)
+{
+    while (*a != 0 && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+constexpr int PromptCatalog::length(const char16_t* text)
+{
+    int n = 0;
+    while (text[n] != 0) {
+        n++;
+    }
+    return n;
+}
+
+constexpr bool PromptCatalog::inOrder()
+{
+    for (int i = 0; i < PromptCount; i++) {
+        if (ENTRIES[i].prompt != i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr bool PromptCatalog::isResource(const char16_t* url)
+{
+    for (const char16_t* resource : QRC_URLS) {
+        if (equal(url, resource)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+constexpr int PromptCatalog::missingAudio()
+{
+    for (int i = 0; i < PromptCount; i++) {
+        if (ENTRIES[i].audio != nullptr && !isResource(ENTRIES[i].audio)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static_assert(sizeof(PromptCatalog::ENTRIES) / sizeof(PromptCatalog::ENTRIES[0]) == PromptCatalog::PromptCount,
+              "ENTRIES must list every Prompt");
+static_assert(PromptCatalog::inOrder(), "ENTRIES must be in the order of the Prompt enum");
+static_assert(PromptCatalog::missingAudio() < 0, "a prompt plays audio that res/aed.qrc doesn't list");
+
+#endif // PROMPTCATALOG_H
@@ -0,0 +1,380 @@
+#include "promptplayer.h"
+#include <QMediaDevices>
+#include <QAudioDevice>
+#include <algorithm>
+
+namespace {
+
+struct PromptClass {
+    const char* name;
+    PromptPlayer::Priority priority;
+};
+
+// Prompts that do not take the default Guidance priority
+const PromptClass PROMPT_PRIORITIES[] = {
+    { "DoNotTouchPatient",  PromptPlayer::Safety },
+    { "StandClear",         PromptPlayer::Safety },
+    { "ShockAdvised",       PromptPlayer::Safety },
+    { "ShockDelivering",    PromptPlayer::Safety },
+    { "ShockTone",          PromptPlayer::Tone },
+    { "pushHarder",         PromptPlayer::Coaching },
+    { "pushGently",         PromptPlayer::Coaching },
+    { "maintainDepth",      PromptPlayer::Coaching },
+};
+
+// Converts mono samples (-1..1) to the sink's sample format, copied to every channel
+void writeSamples(const QAudioFormat &format, const float* mono, int frames, char* out)
+{
+    int channels = format.channelCount();
+    switch (format.sampleFormat()) {
+    case QAudioFormat::Float: {
+        float* o = reinterpret_cast<float*>(out);
+        for (int f = 0; f < frames; f++) {
+            for (int c = 0; c < channels; c++) {
+                *o++ = qBound(-1.0f, mono[f], 1.0f);
+            }
+        }
+        break;
+    }
+    case QAudioFormat::Int32: {
+        qint32* o = reinterpret_cast<qint32*>(out);
+        for (int f = 0; f < frames; f++) {
+            qint32 v = qint32(qBound(-1.0f, mono[f], 1.0f) * 2147483647.0f);
+            for (int c = 0; c < channels; c++) {
+                *o++ = v;
+            }
+        }
+        break;
+    }
+    case QAudioFormat::UInt8: {
+        quint8* o = reinterpret_cast<quint8*>(out);
+        for (int f = 0; f < frames; f++) {
+            quint8 v = quint8(128 + qBound(-128, qRound(mono[f] * 128.0f), 127));
+            for (int c = 0; c < channels; c++) {
+                *o++ = v;
+            }
+        }
+        break;
+    }
+    default: {
+        qint16* o = reinterpret_cast<qint16*>(out);
+        for (int f = 0; f < frames; f++) {
+            qint16 v = qint16(qBound(-32768, qRound(mono[f] * 32768.0f), 32767));
+            for (int c = 0; c < channels; c++) {
+                *o++ = v;
+            }
+        }
+        break;
+    }
+    }
+}
+
+}
+
+PromptPlayer::Priority PromptPlayer::promptPriority(QString name)
+{
+    for (const PromptClass &prompt : PROMPT_PRIORITIES) {
+        if (name == prompt.name) {
+            return prompt.priority;
+        }
+    }
+    return Guidance;
+}
+
+QAudioFormat PromptPlayer::outputFormat(int sampleRate)
+{
+    QAudioDevice device = QMediaDevices::defaultAudioOutput();
+
+    QAudioFormat format;
+    format.setSampleRate(sampleRate);
+    format.setChannelCount(1);
+    format.setSampleFormat(QAudioFormat::Int16);
+    if (device.isNull() || device.isFormatSupported(format)) {
+        return format;
+    }
+
+    // Fall back to the device's own layout; the cache resamples and every channel gets the same signal
+    return device.preferredFormat();
+}
+
+PromptPlayer::PromptPlayer(PromptCache* cache, QObject *parent)
+    : QIODevice(parent)
+{
+    this->cache = cache;
+    voice.position = 0;
+    voice.priority = Guidance;
+    voice.triggerNsec = 0;
+    voice.started = true;
+    voice.waited = false;
+    tone = voice;
+    mixerStats = {};
+    latencyMsec.resize(StatsWindow);
+    statsIndex = 0;
+    statsCount = 0;
+    clock.start();
+
+    format = outputFormat(cache->getSampleRate());
+    if (format.sampleRate() != cache->getSampleRate()) {
+        qWarning("audio: output runs at %d Hz, prompts are decoded at %d Hz", format.sampleRate(), cache->getSampleRate());
+    }
+
+    open(QIODevice::ReadOnly);
+
+    sink = new QAudioSink(QMediaDevices::defaultAudioOutput(), format, this);
+    sink->setBufferSize(format.bytesForDuration(BufferMsec * 1000));
+    sink->start(this);
+}
+
+PromptPlayer::~PromptPlayer()
+{
+    sink->stop();
+    close();
+}
+
+bool PromptPlayer::isSequential() const
+{
+    return true;
+}
+
+void PromptPlayer::setVolume(double volume)
+{
+    sink->setVolume(volume);
+}
+
+void PromptPlayer::play(QString source)
+{
+    // Decoding on a cache miss counts towards the latency
+    qint64 trigger = clock.nsecsElapsed();
+
+    QVector<qint16> pcm = cache->find(source);
+    if (pcm.isEmpty()) {
+        qWarning("audio: %s", qPrintable(cache->getError()));
+        return;
+    }
+
+    if (sink->state() == QAudio::StoppedState) {
+        sink->start(this);
+    }
+
+    Channel next;
+    next.pcm = pcm;
+    next.position = 0;
+    next.name = PromptCache::promptName(source);
+    next.priority = promptPriority(next.name);
+    next.triggerNsec = trigger;
+    next.started = false;
+    next.waited = false;
+
+    QMutexLocker locker(&mutex);
+    if (next.priority == Tone) {
+        if (!voice.pcm.isEmpty()) {
+            mixerStats.mixed++;
+        }
+        tone = next;
+        return;
+    }
+
+    if (voice.pcm.isEmpty() || next.priority > voice.priority) {
+        if (!voice.pcm.isEmpty()) {
+            mixerStats.preempted++;
+        }
+        voice = next;
+        return;
+    }
+
+    enqueue(next);
+}
+
+void PromptPlayer::stop()
+{
+    QMutexLocker locker(&mutex);
+    voice.pcm = QVector<qint16>();
+    tone.pcm = QVector<qint16>();
+    queue.clear();
+}
+
+// Called with the mutex held
+void PromptPlayer::enqueue(Channel next)
+{
+    // Once is enough for a prompt that is already playing or waiting
+    if (next.name == voice.name) {
+        mixerStats.dropped++;
+        return;
+    }
+    for (const Channel &waiting : queue) {
+        if (waiting.name == next.name) {
+            mixerStats.dropped++;
+            return;
+        }
+    }
+
+    // Only the latest CPR feedback matters
+    if (next.priority == Coaching) {
+        for (int i = queue.size() - 1; i >= 0; i--) {
+            if (queue[i].priority == Coaching) {
+                queue.removeAt(i);
+                mixerStats.dropped++;
+            }
+        }
+    }
+
+    if (queue.size() >= MaxQueued) {
+        mixerStats.dropped++;
+        return;
+    }
+
+    next.waited = true;
+    int at = 0;
+    while (at < queue.size() && queue[at].priority >= next.priority) {
+        at++;
+    }
+    queue.insert(at, next);
+    mixerStats.queued++;
+}
+
+// Called with the mutex held, when the voice has finished
+void PromptPlayer::nextVoice()
+{
+    voice.pcm = QVector<qint16>();
+    while (!queue.isEmpty()) {
+        Channel next = queue.takeFirst();
+        if (next.priority == Coaching && clock.nsecsElapsed() - next.triggerNsec > CoachingExpiryMsec * 1000000LL) {
+            mixerStats.dropped++;
+            continue;
+        }
+        voice = next;
+        return;
+    }
+}
+
+// Adds up to `frames` samples of a channel to `out`; returns how many it had
+int PromptPlayer::mixChannel(Channel &channel, float* out, int frames, QString &started, double &startedMsec)
+{
+    int n = int(qBound<qint64>(0, channel.pcm.size() - channel.position, frames));
+    if (n == 0) {
+        return 0;
+    }
+
+    if (!channel.started) {
+        channel.started = true;
+        mixerStats.played++;
+        started = channel.name;
+        startedMsec = (clock.nsecsElapsed() - channel.triggerNsec) / 1e6;
+
+        if (!channel.waited) {
+            latencyMsec[statsIndex] = startedMsec;
+            statsIndex = (statsIndex + 1) % StatsWindow;
+            statsCount = qMin(statsCount + 1, int(StatsWindow));
+        }
+    }
+
+    const qint16* pcm = channel.pcm.constData() + channel.position;
+    for (int i = 0; i < n; i++) {
+        out[i] += pcm[i] * (1.0f / 32768.0f);
+    }
+    channel.position += n;
+    return n;
+}
+
+qint64 PromptPlayer::readData(char *data, qint64 maxSize)
+{
+    int bytesPerFrame = format.bytesPerFrame();
+    int frames = bytesPerFrame > 0 ? int(maxSize / bytesPerFrame) : 0;
+    if (frames <= 0) {
+        return 0;
+    }
+
+    QString started;
+    double startedMsec = -1;
+    {
+        QMutexLocker locker(&mutex);
+        if (mix.size() < frames) {
+            mix.resize(frames);
+        }
+        std::fill(mix.begin(), mix.begin() + frames, 0.0f);
+
+        // Queued prompts follow each other without a gap, even within one pull
+        int done = 0;
+        while (done < frames && !voice.pcm.isEmpty()) {
+            done += mixChannel(voice, mix.data() + done, frames - done, started, startedMsec);
+            if (voice.position >= voice.pcm.size()) {
+                nextVoice();
+            }
+        }
+
+        mixChannel(tone, mix.data(), frames, started, startedMsec);
+        if (tone.position >= tone.pcm.size()) {
+            tone.pcm = QVector<qint16>();
+        }
+
+        // Samples are clipped on conversion where the tone and the voice add up past full scale
+        writeSamples(format, mix.constData(), frames, data);
+    }
+
+    // Signalled outside the lock; MainWindow receives it queued when the sink pulls from its own thread
+    if (startedMsec >= 0) {
+        emit promptStarted(started, startedMsec);
+    }
+    return qint64(frames) * bytesPerFrame;
+}
+
+qint64 PromptPlayer::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+PromptPlayer::LatencyStats PromptPlayer::getLatencyStats()
+{
+    LatencyStats stats = {};
+    stats.bufferMsec = format.durationForBytes(sink->bufferSize()) / 1000.0;
+
+    QMutexLocker locker(&mutex);
+    stats.prompts = statsCount;
+    if (statsCount == 0) {
+        return stats;
+    }
+
+    QVector<double> sorted = latencyMsec.mid(0, statsCount);
+    double total = 0;
+    for (int i = 0; i < statsCount; i++) {
+        total += sorted[i];
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    stats.lastMsec = latencyMsec[(statsIndex + StatsWindow - 1) % StatsWindow];
+    stats.meanMsec = total / statsCount;
+    stats.p95Msec = sorted[qMin(statsCount - 1, int(statsCount * 0.95))];
+    stats.maxMsec = sorted.last();
+    return stats;
+}
+
+QString PromptPlayer::latencyStatsText()
+{
+    LatencyStats stats = getLatencyStats();
+    return QString("prompt latency: last %1 ms, mean %2 ms / p95 %3 ms / max %4 ms over %5 prompts (+%6 ms output buffer)")
+        .arg(stats.lastMsec, 0, 'f', 2)
+        .arg(stats.meanMsec, 0, 'f', 2)
+        .arg(stats.p95Msec, 0, 'f', 2)
+        .arg(stats.maxMsec, 0, 'f', 2)
+        .arg(stats.prompts)
+        .arg(stats.bufferMsec, 0, 'f', 1);
+}
+
+PromptPlayer::MixerStats PromptPlayer::getMixerStats()
+{
+    QMutexLocker locker(&mutex);
+    return mixerStats;
+}
+
+QString PromptPlayer::mixerStatsText()
+{
+    MixerStats stats = getMixerStats();
+    return QString("prompts: %1 played, %2 preempted, %3 queued, %4 dropped, %5 tones mixed")
+        .arg(stats.played)
+        .arg(stats.preempted)
+        .arg(stats.queued)
+        .arg(stats.dropped)
+        .arg(stats.mixed);
+}
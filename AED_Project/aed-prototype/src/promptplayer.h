@@ -0,0 +1,120 @@
+#ifndef PROMPTPLAYER_H
+#define PROMPTPLAYER_H
+
+#include <QIODevice>
+#include <QAudioFormat>
+#include <QAudioSink>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QList>
+#include <QVector>
+#include "promptcache.h"
+
+// Plays voice prompts from a PromptCache through a QAudioSink.
+// The sink is opened once, with a short buffer, and pulls from this device for as long as the player
+// lives (silence when idle), so a trigger never waits for a decoder or for the device to open: the
+// next pull already carries the prompt. The time from play() to the pull that hands the first frame
+// to the sink is measured for every prompt.
+//
+// Prompts are scheduled by priority (see PROMPT_PRIORITIES in promptplayer.cpp). One voice speaks at
+// a time: a higher priority prompt cuts the current one, anything else waits its turn in the queue.
+// Tones have their own channel and are mixed over the voice. play() only queues, it never waits for
+// audio, so the protocol keeps running on its own timers whatever the speaker is doing.
+class PromptPlayer : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    // How a prompt competes for the speaker, lowest first
+    enum Priority {
+        Coaching,       // CPR feedback; only worth hearing while it is current
+        Guidance,       // protocol steps
+        Safety,         // shock warnings, cut anything below them
+        Tone            // signal tones, mixed with the voice instead of competing with it
+    };
+
+    struct LatencyStats {
+        int prompts;            // prompts in the measurement window
+        double lastMsec;
+        double meanMsec;
+        double p95Msec;
+        double maxMsec;
+        double bufferMsec;      // audio queued in the sink ahead of the speaker
+    };
+
+    struct MixerStats {
+        int played;
+        int preempted;          // cut by a higher priority prompt
+        int queued;             // waited for the voice to finish
+        int dropped;            // duplicates, stale coaching and queue overflow
+        int mixed;              // tones played over speech
+    };
+
+    // Output format for the default device, mono Int16 at `sampleRate` when it is supported
+    static QAudioFormat outputFormat(int sampleRate);
+
+    static Priority promptPriority(QString name);
+
+    // The cache must be decoding at the output rate (see outputFormat()). Not owned.
+    explicit PromptPlayer(PromptCache* cache, QObject *parent = nullptr);
+    ~PromptPlayer();
+
+    bool isSequential() const override;
+
+    void setVolume(double volume);
+    LatencyStats getLatencyStats();
+    QString latencyStatsText();
+    MixerStats getMixerStats();
+    QString mixerStatsText();
+
+public slots:
+    void play(QString source);
+    void stop();                // silences both channels and clears the queue
+
+signals:
+    // Latency is measured from play(), so it includes any time spent in the queue
+    void promptStarted(QString name, double latencyMsec);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    static const int BufferMsec = 20;
+    static const int StatsWindow = 64;
+    static const int MaxQueued = 8;
+    static const int CoachingExpiryMsec = 2000;
+
+    struct Channel {
+        QVector<qint16> pcm;    // empty when silent
+        qint64 position;
+        QString name;
+        Priority priority;
+        qint64 triggerNsec;
+        bool started;
+        bool waited;            // came through the queue, so not a latency sample
+    };
+
+    PromptCache* cache;
+    QAudioFormat format;
+    QAudioSink* sink;
+
+    // Shared with the pulling side, which may run on the audio thread
+    QMutex mutex;
+    Channel voice;
+    Channel tone;
+    QList<Channel> queue;       // highest priority first, in arrival order within a priority
+    MixerStats mixerStats;
+    QVector<float> mix;
+
+    QElapsedTimer clock;
+    QVector<double> latencyMsec;
+    int statsIndex;
+    int statsCount;
+
+    void enqueue(Channel next);
+    void nextVoice();
+    int mixChannel(Channel &channel, float* out, int frames, QString &started, double &startedMsec);
+};
+
+#endif // PROMPTPLAYER_H
@@ -0,0 +1,204 @@
+#include "protocolmetrics.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+namespace {
+
+struct NameInfo {
+    const char* name;
+    const char* help;
+};
+
+const NameInfo INTERVALS[ProtocolMetrics::IntervalCount] = {
+    { "power_on_to_analysis",       "Power on to the first rhythm analysis of the session." },
+    { "analysis_to_shock_ready",    "Start of a rhythm analysis to the shock button being enabled." },
+    { "shock_enabled_to_delivery",  "Shock button enabled to the trainee pressing it." },
+    { "power_on_to_first_shock",    "Power on to the first shock delivered." },
+    { "hands_off",                  "Time without CPR per session." },
+    { "pads_interruption",          "Protocol held because the pads were off." },
+    { "battery_interruption",       "Protocol held because the battery was out." },
+    { "session_length",             "Power on to power off." },
+};
+
+const NameInfo COUNTERS[ProtocolMetrics::CounterCount] = {
+    { "sessions",                   "Rescue sessions started." },
+    { "transitions",                "Protocol steps entered." },
+    { "analyses",                   "Rhythm analyses started." },
+    { "shocks",                     "Shocks delivered." },
+    { "shocks_refused",             "Shock presses refused for lack of charge." },
+    { "pads_interruptions",         "Times the pads came off during a session." },
+    { "battery_interruptions",      "Times the battery was removed during a session." },
+};
+
+// Bucket bounds of the exported histograms, in seconds
+const double BOUNDS[] = { 0.01, 0.05, 0.1, 0.25, 0.5, 1, 2, 3, 5, 10, 15, 30, 60, 120, 300, 600 };
+
+void appendHistogram(QString &text, const QString &name, const QString &labels, const Histogram &histogram)
+{
+    for (double bound : BOUNDS) {
+        text += QString("%1_bucket{%2le=\"%3\"} %4\n").arg(name, labels).arg(bound)
+            .arg(histogram.countAtOrBelow(qint64(bound * 1000)));
+    }
+    text += QString("%1_bucket{%2le=\"+Inf\"} %3\n").arg(name, labels).arg(histogram.getCount());
+
+    QString plain = labels.isEmpty() ? QString() : "{" + labels.left(labels.size() - 1) + "}";
+    text += QString("%1_sum%2 %3\n").arg(name, plain).arg(histogram.getSum() / 1000.0);
+    text += QString("%1_count%2 %3\n").arg(name, plain).arg(histogram.getCount());
+}
+
+QJsonObject histogramJson(const Histogram &histogram)
+{
+    QJsonObject object;
+    object["count"] = histogram.getCount();
+    object["sumMsec"] = histogram.getSum();
+    object["minMsec"] = histogram.getMin();
+    object["meanMsec"] = histogram.getMean();
+    object["p50Msec"] = histogram.valueAtPercentile(50);
+    object["p90Msec"] = histogram.valueAtPercentile(90);
+    object["p99Msec"] = histogram.valueAtPercentile(99);
+    object["maxMsec"] = histogram.getMax();
+    return object;
+}
+
+}
+
+ProtocolMetrics::ProtocolMetrics()
+{
+    for (int i = 0; i < CounterCount; i++) {
+        counters[i] = 0;
+    }
+}
+
+void ProtocolMetrics::count(Counter counter, qint64 n)
+{
+    counters[counter] += n;
+}
+
+void ProtocolMetrics::record(Interval interval, qint64 msec)
+{
+    intervals[interval].record(msec);
+}
+
+void ProtocolMetrics::recordStep(AED::State state, qint64 msec)
+{
+    if (state >= 0 && state < AED::StateCount) {
+        steps[state].record(msec);
+    }
+}
+
+void ProtocolMetrics::merge(const ProtocolMetrics &other)
+{
+    for (int i = 0; i < CounterCount; i++) {
+        counters[i] += other.counters[i];
+    }
+    for (int i = 0; i < IntervalCount; i++) {
+        intervals[i].merge(other.intervals[i]);
+    }
+    for (int i = 0; i < AED::StateCount; i++) {
+        steps[i].merge(other.steps[i]);
+    }
+}
+
+qint64 ProtocolMetrics::getCounter(Counter counter) const
+{
+    return counters[counter];
+}
+
+const Histogram& ProtocolMetrics::getInterval(Interval interval) const
+{
+    return intervals[interval];
+}
+
+const Histogram& ProtocolMetrics::getStep(AED::State state) const
+{
+    return steps[state];
+}
+
+double ProtocolMetrics::getHandsOffFraction() const
+{
+    qint64 session = intervals[SessionLength].getSum();
+    return session > 0 ? double(intervals[HandsOff].getSum()) / session : 0.0;
+}
+
+QString ProtocolMetrics::toPrometheus() const
+{
+    QString text;
+    for (int i = 0; i < CounterCount; i++) {
+        QString name = QString("aed_%1_total").arg(COUNTERS[i].name);
+        text += QString("# HELP %1 %2\n# TYPE %1 counter\n%1 %3\n").arg(name, COUNTERS[i].help).arg(counters[i]);
+    }
+
+    text += "# HELP aed_hands_off_ratio Share of session time without CPR.\n# TYPE aed_hands_off_ratio gauge\n";
+    text += QString("aed_hands_off_ratio %1\n").arg(getHandsOffFraction());
+
+    text += "# HELP aed_interval_seconds Protocol timing intervals.\n# TYPE aed_interval_seconds histogram\n";
+    for (int i = 0; i < IntervalCount; i++) {
+        appendHistogram(text, "aed_interval_seconds", QString("interval=\"%1\",").arg(INTERVALS[i].name), intervals[i]);
+    }
+
+    text += "# HELP aed_step_seconds Time spent in each protocol step.\n# TYPE aed_step_seconds histogram\n";
+    for (int i = 0; i < AED::StateCount; i++) {
+        if (steps[i].getCount() > 0) {
+            appendHistogram(text, "aed_step_seconds", QString("step=\"%1\",").arg(AED::stateName(AED::State(i))), steps[i]);
+        }
+    }
+    return text;
+}
+
+QByteArray ProtocolMetrics::toJson() const
+{
+    QJsonObject counterObject;
+    for (int i = 0; i < CounterCount; i++) {
+        counterObject[COUNTERS[i].name] = counters[i];
+    }
+
+    QJsonObject intervalObject;
+    for (int i = 0; i < IntervalCount; i++) {
+        intervalObject[INTERVALS[i].name] = histogramJson(intervals[i]);
+    }
+
+    QJsonObject stepObject;
+    for (int i = 0; i < AED::StateCount; i++) {
+        if (steps[i].getCount() > 0) {
+            stepObject[AED::stateName(AED::State(i))] = histogramJson(steps[i]);
+        }
+    }
+
+    QJsonObject root;
+    root["counters"] = counterObject;
+    root["handsOffFraction"] = getHandsOffFraction();
+    root["intervals"] = intervalObject;
+    root["steps"] = stepObject;
+    return QJsonDocument(root).toJson();
+}
+
+bool ProtocolMetrics::save(QString path, QString *error) const
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (error != nullptr) {
+            *error = file.errorString();
+        }
+        return false;
+    }
+
+    file.write(path.endsWith(".json") ? toJson() : toPrometheus().toUtf8());
+    if (!file.commit()) {
+        if (error != nullptr) {
+            *error = file.errorString();
+        }
+        return false;
+    }
+    return true;
+}
+
+QString ProtocolMetrics::intervalName(Interval interval)
+{
+    return INTERVALS[interval].name;
+}
+
+QString ProtocolMetrics::counterName(Counter counter)
+{
+    return COUNTERS[counter].name;
+}
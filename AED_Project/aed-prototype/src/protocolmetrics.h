@@ -0,0 +1,69 @@
+#ifndef PROTOCOLMETRICS_H
+#define PROTOCOLMETRICS_H
+
+#include <QString>
+#include <QByteArray>
+#include "AED.h"
+#include "histogram.h"
+
+// Operational metrics of rescue sessions: counters, the intervals that matter clinically (e.g. power
+// on to the first analysis, shock button enabled to delivery, hands-off time) and how long every
+// protocol step lasted, all in device milliseconds. Filled by a MetricsCollector; metrics of several
+// devices merge into one set, which exports as a Prometheus text file or as JSON.
+class ProtocolMetrics
+{
+public:
+    enum Interval {
+        PowerOnToAnalysis,      // first analysis of a session
+        AnalysisToShockReady,
+        ShockEnabledToDelivery, // shock button enabled until the trainee pressed it
+        PowerOnToFirstShock,
+        HandsOff,               // per session, time without CPR
+        PadsInterruption,       // protocol held while the pads were off
+        BatteryInterruption,
+        SessionLength,          // power on to power off
+        IntervalCount
+    };
+
+    enum Counter {
+        Sessions,
+        Transitions,
+        Analyses,
+        Shocks,
+        ShocksRefused,
+        PadsInterruptions,
+        BatteryInterruptions,
+        CounterCount
+    };
+
+    ProtocolMetrics();
+
+    void count(Counter counter, qint64 n = 1);
+    void record(Interval interval, qint64 msec);
+    void recordStep(AED::State state, qint64 msec);
+    void merge(const ProtocolMetrics &other);
+
+    qint64 getCounter(Counter counter) const;
+    const Histogram& getInterval(Interval interval) const;
+    const Histogram& getStep(AED::State state) const;
+
+    // Hands-off time over session time, of the sessions that have ended
+    double getHandsOffFraction() const;
+
+    QString toPrometheus() const;
+    QByteArray toJson() const;
+
+    // JSON for a .json file, the Prometheus text format otherwise. Replaces the file atomically, so a
+    // dashboard scraping it never sees half of it.
+    bool save(QString path, QString *error = nullptr) const;
+
+    static QString intervalName(Interval interval);     // snake_case, as exported
+    static QString counterName(Counter counter);
+
+private:
+    qint64 counters[CounterCount];
+    Histogram intervals[IntervalCount];
+    Histogram steps[AED::StateCount];
+};
+
+#endif // PROTOCOLMETRICS_H
@@ -0,0 +1,174 @@
+#include "rhythmclassifier.h"
+#include <QElapsedTimer>
+#include <QtMath>
+
+namespace {
+
+// Below this peak-to-peak amplitude (mV) there is no rhythm worth analysing
+const double ASYSTOLE_AMPLITUDE = 0.3;
+
+// Decision thresholds, each feature votes shockable on its side of the threshold
+const double TCI_FRACTION = 0.3;                // of the peak, the crossing level
+const double TCI_THRESHOLD_MSEC = 400.0;        // crossings faster than 150 per minute
+const double LEAKAGE_THRESHOLD = 0.70;
+const double CONCENTRATION_THRESHOLD = 0.75;
+
+// Maps the distance from a threshold to a 0..1 vote; `scale` is the distance that counts as sure
+double vote(double value, double threshold, double scale)
+{
+    return 1.0 / (1.0 + qExp(-4.0 * (value - threshold) / scale));
+}
+
+}
+
+RhythmClassifier::RhythmClassifier()
+{
+}
+
+RhythmClassifier::Result RhythmClassifier::classify(const float* samples, int count, int sampleRate)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    Result result = {};
+    result.dominantHz = 0;
+
+    // Decimate to the analysis rate by block averaging (also a cheap low-pass against noise)
+    int frames = int(qint64(count) * SpectrumRate / qMax(1, sampleRate));
+    if (frames < SpectrumRate) {
+        result.nsec = timer.nsecsElapsed();
+        return result;
+    }
+
+    decimated.resize(frames);
+    for (int i = 0; i < frames; i++) {
+        int from = int(qint64(i) * sampleRate / SpectrumRate);
+        int to = qMax(from + 1, int(qint64(i + 1) * sampleRate / SpectrumRate));
+        float sum = 0;
+        for (int k = from; k < to; k++) {
+            sum += samples[k];
+        }
+        decimated[i] = sum / (to - from);
+    }
+
+    // First-order high-pass at 0.5 Hz removes baseline wander and offset, then a 3-tap smoother
+    // takes out what is left of the noise above ~30 Hz
+    signal.resize(frames);
+    const float a = float(1.0 / (1.0 + 2.0 * M_PI * 0.5 / SpectrumRate));
+    float previousIn = decimated[0];
+    float previousOut = 0;
+    for (int i = 0; i < frames; i++) {
+        previousOut = a * (previousOut + decimated[i] - previousIn);
+        previousIn = decimated[i];
+        signal[i] = previousOut;
+    }
+    for (int i = frames - 1; i >= 2; i--) {
+        signal[i] = (signal[i] + signal[i - 1] + signal[i - 2]) * (1.0f / 3.0f);
+    }
+
+    // Skip the filter's settling time
+    const float* s = signal.constData() + SpectrumRate / 4;
+    int n = frames - SpectrumRate / 4;
+
+    float low = s[0];
+    float high = s[0];
+    double absSum = 0;
+    double diffSum = 0;
+    for (int i = 0; i < n; i++) {
+        low = qMin(low, s[i]);
+        high = qMax(high, s[i]);
+        absSum += qAbs(s[i]);
+        if (i > 0) {
+            diffSum += qAbs(s[i] - s[i - 1]);
+        }
+    }
+
+    if (high - low < ASYSTOLE_AMPLITUDE) {
+        result.asystole = true;
+        result.confidence = qBound(0.0, 1.0 - (high - low) / ASYSTOLE_AMPLITUDE, 1.0);
+        result.tciMsec = 1000.0 * n / SpectrumRate;
+        result.leakage = 1.0;
+        result.nsec = timer.nsecsElapsed();
+        return result;
+    }
+
+    // Threshold crossing interval: upward crossings of a fraction of the peak, re-armed below zero
+    float threshold = float(TCI_FRACTION) * qMax(high, -low);
+    if (-low > high) {
+        threshold = -threshold;     // negative dominant deflections, count those instead
+    }
+    int crossings = 0;
+    int first = -1;
+    int last = -1;
+    bool armed = true;
+    for (int i = 0; i < n; i++) {
+        float v = threshold > 0 ? s[i] : -s[i];
+        if (armed && v >= qAbs(threshold)) {
+            crossings++;
+            if (first < 0) {
+                first = i;
+            }
+            last = i;
+            armed = false;
+        }
+        else if (v < 0) {
+            armed = true;
+        }
+    }
+    result.tciMsec = crossings > 1 ? 1000.0 * (last - first) / (crossings - 1) / SpectrumRate
+                                   : 1000.0 * n / SpectrumRate;
+
+    // VF filter leakage: notch the signal at its mean frequency (half period N) and measure what passes
+    int half = qBound(1, int(M_PI * absSum / qMax(diffSum, 1e-9) + 0.5), n / 2);
+    double passed = 0;
+    double total = 0;
+    for (int i = half; i < n; i++) {
+        passed += qAbs(s[i] + s[i - half]);
+        total += qAbs(s[i]) + qAbs(s[i - half]);
+    }
+    result.leakage = total > 0 ? passed / total : 1.0;
+
+    // Spectrum with a bank of Goertzel filters every 0.5 Hz from 0.5 to 15 Hz, all run in one pass
+    // over the window so the inner loop is independent per bin and vectorises
+    float coeff[SpectrumBins];
+    float q1[SpectrumBins] = {};
+    float q2[SpectrumBins] = {};
+    for (int bin = 0; bin < SpectrumBins; bin++) {
+        coeff[bin] = float(2.0 * qCos(2.0 * M_PI * 0.5 * (bin + 1) / SpectrumRate));
+    }
+    for (int i = 0; i < n; i++) {
+        float x = s[i];
+        for (int bin = 0; bin < SpectrumBins; bin++) {
+            float q0 = coeff[bin] * q1[bin] - q2[bin] + x;
+            q2[bin] = q1[bin];
+            q1[bin] = q0;
+        }
+    }
+
+    double bandPower = 0;
+    double allPower = 0;
+    double peakPower = 0;
+    for (int bin = 0; bin < SpectrumBins; bin++) {
+        double hz = 0.5 * (bin + 1);
+        double power = double(q1[bin]) * q1[bin] + double(q2[bin]) * q2[bin] - double(coeff[bin]) * q1[bin] * q2[bin];
+
+        allPower += power;
+        if (hz >= 2.5 && hz <= 9.0) {
+            bandPower += power;
+        }
+        if (power > peakPower) {
+            peakPower = power;
+            result.dominantHz = hz;
+        }
+    }
+    result.concentration = allPower > 0 ? bandPower / allPower : 0;
+
+    // Average the soft votes; shockable when the majority of the evidence says so
+    double score = (vote(TCI_THRESHOLD_MSEC, result.tciMsec, 150.0)
+                    + vote(LEAKAGE_THRESHOLD, result.leakage, 0.2)
+                    + vote(result.concentration, CONCENTRATION_THRESHOLD, 0.2)) / 3.0;
+    result.shockable = score >= 0.5;
+    result.confidence = qAbs(score - 0.5) * 2.0;
+    result.nsec = timer.nsecsElapsed();
+    return result;
+}
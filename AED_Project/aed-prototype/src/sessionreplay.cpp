@@ -0,0 +1,179 @@
+#include "sessionreplay.h"
+#include "AED.h"
+#include "eventrecorder.h"
+#include "wfdbrecord.h"
+
+SessionReplay::SessionReplay(AED *aed)
+    : QObject{aed}
+{
+    this->aed = aed;
+    startMsec = 0;
+    endMsec = 0;
+    offset = 0;
+    next = 0;
+    running = false;
+    report = {};
+    report.firstDifference = -1;
+    ecgRecord = nullptr;
+    ecgPlayback = nullptr;
+
+    timer = new ClockTimer(aed->getClock(), this);
+    timer->setSingleShot(true);
+    connect(timer, &ClockTimer::timeout, this, &SessionReplay::onTimer);
+    connect(aed, &AED::stateChanged, this, &SessionReplay::onStateChanged);
+}
+
+SessionReplay::~SessionReplay()
+{
+    // Goes with the AED, which stops reading its source first
+    delete ecgPlayback;
+    delete ecgRecord;
+}
+
+bool SessionReplay::load(QString path)
+{
+    if (!log.load(path)) {
+        error = log.getError();
+        return false;
+    }
+
+    inputs = log.getEvents(EventRecorder::Input);
+    steps = log.getEvents(EventRecorder::StateChanged);
+    startMsec = log.getEvents().first().deviceMsec;
+    endMsec = log.getEvents().last().deviceMsec;
+    return true;
+}
+
+QString SessionReplay::getError()
+{
+    return error;
+}
+
+quint32 SessionReplay::getSeed()
+{
+    return log.getSeed();
+}
+
+bool SessionReplay::restoreEcg()
+{
+    if (!log.getEcgRecord().isEmpty()) {
+        WfdbRecord* record = new WfdbRecord;
+        if (!record->open(log.getEcgRecord())) {
+            error = QString("wfdb: %1").arg(record->getError());
+            delete record;
+            return false;
+        }
+        if (log.getEcgSignal() < 0 || log.getEcgSignal() >= record->getSignalCount()) {
+            error = QString("wfdb: %1 has no signal %2").arg(log.getEcgRecord()).arg(log.getEcgSignal());
+            delete record;
+            return false;
+        }
+        WfdbPlayback* playback = new WfdbPlayback(record, log.getEcgSignal());
+        playback->seek(log.getEcgStartSample());
+        aed->setEcgSource(playback);
+        delete ecgPlayback;
+        delete ecgRecord;
+        ecgRecord = record;
+        ecgPlayback = playback;
+    }
+    else {
+        aed->setEcgSource(nullptr);
+    }
+    aed->setEcgStreaming(log.isEcgStreaming());
+    return true;
+}
+
+void SessionReplay::start()
+{
+    // Device time of the replay lines up with the recording from here on
+    offset = aed->getClock()->now() - startMsec;
+    next = 0;
+    running = true;
+    report = {};
+    report.recordedSteps = steps.size();
+    report.firstDifference = -1;
+    wall.start();
+    scheduleNext();
+}
+
+void SessionReplay::scheduleNext()
+{
+    // After the last input the replay runs on to the end of the recording, so the steps it caused are seen
+    qint64 due = (next < inputs.size() ? inputs[next].deviceMsec : endMsec) + offset;
+    timer->start(int(qMax(qint64(0), due - aed->getClock()->now())));
+}
+
+void SessionReplay::onTimer()
+{
+    // Inputs recorded at the same time are applied together, in their recorded order
+    qint64 now = aed->getClock()->now();
+    while (next < inputs.size() && inputs[next].deviceMsec + offset <= now) {
+        aed->applyInput(inputs[next].value, inputs[next].arg);
+        report.inputs++;
+        next++;
+    }
+
+    if (next < inputs.size() || endMsec + offset > now) {
+        scheduleNext();
+    }
+    else {
+        finish();
+    }
+}
+
+void SessionReplay::onStateChanged(int state)
+{
+    if (!running) {
+        return;
+    }
+
+    int index = report.replayedSteps++;
+    if (report.firstDifference >= 0) {
+        return;
+    }
+    if (index >= steps.size() || steps[index].value != state) {
+        report.firstDifference = index;
+        report.recordedStep = index < steps.size() ? steps[index].value : -1;
+        report.replayedStep = state;
+        return;
+    }
+    qint64 drift = qAbs(aed->getClock()->now() - offset - steps[index].deviceMsec);
+    report.maxDriftMsec = qMax(report.maxDriftMsec, drift);
+}
+
+void SessionReplay::finish()
+{
+    running = false;
+    report.deviceMsec = endMsec - startMsec;
+    report.wallMsec = wall.elapsed();
+    if (report.firstDifference < 0 && report.replayedSteps < report.recordedSteps) {
+        // The replay stopped short of the recorded steps
+        report.firstDifference = report.replayedSteps;
+        report.recordedStep = steps[report.replayedSteps].value;
+        report.replayedStep = -1;
+    }
+    emit finished();
+}
+
+SessionReplay::Report SessionReplay::getReport()
+{
+    return report;
+}
+
+QString SessionReplay::reportText(const Report &report)
+{
+    QString text = QString("%1 inputs, %2 of %3 recorded steps")
+        .arg(report.inputs).arg(report.replayedSteps).arg(report.recordedSteps);
+    if (report.firstDifference < 0) {
+        text += QString(" as recorded, max drift %1 ms").arg(report.maxDriftMsec);
+    }
+    else {
+        auto name = [](int step) { return step < 0 ? QString("(none)") : AED::stateName(AED::State(step)); };
+        text += QString(", first difference at step %1: recorded %2, replayed %3 (max drift %4 ms before it)")
+            .arg(report.firstDifference).arg(name(report.recordedStep), name(report.replayedStep))
+            .arg(report.maxDriftMsec);
+    }
+    text += QString("; %1 s of session replayed in %2 ms")
+        .arg(report.deviceMsec / 1000.0, 0, 'f', 1).arg(report.wallMsec);
+    return text;
+}
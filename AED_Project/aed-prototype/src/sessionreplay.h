@@ -0,0 +1,83 @@
+#ifndef SESSIONREPLAY_H
+#define SESSIONREPLAY_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include "eventlog.h"
+
+class AED;
+class ClockTimer;
+class WfdbRecord;
+class WfdbPlayback;
+
+// Plays the inputs of a recorded session back into an AED.
+// Created as a child of the AED, so it runs on the device's thread, it applies each recorded input
+// at the device time it was recorded at, on the AED's own clock: with an Instant clock a session
+// replays as fast as the protocol can run, with a RealTime clock at the speed it was recorded.
+// Seed the AED with getSeed() and call restoreEcg() before starting so the patient signal, and the
+// history the classifier sees, are the ones the trainee had.
+// The protocol steps taken are compared with the recorded ones, which shows whether a build still
+// behaves the same on the session and how far its step timing has moved.
+class SessionReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Report {
+        int inputs;             // applied
+        int recordedSteps;
+        int replayedSteps;
+        int firstDifference;    // index of the first step that differs, -1 if none
+        int recordedStep;       // the AED::State recorded and replayed there, -1 past the end
+        int replayedStep;
+        qint64 maxDriftMsec;    // largest difference in step time among the steps that match
+        qint64 deviceMsec;      // length of the session
+        qint64 wallMsec;        // time the replay took
+    };
+
+    explicit SessionReplay(AED *aed);
+    ~SessionReplay();
+
+    bool load(QString path);
+    QString getError();
+    quint32 getSeed();
+
+    // Feeds the pads from the recorded source (the generator, or the WFDB record at the recorded
+    // sample) and turns ECG streaming on or off as recorded. Call after load(), before the device starts.
+    bool restoreEcg();
+
+    Report getReport();
+    static QString reportText(const Report &report);
+
+public slots:
+    void start();
+
+signals:
+    void finished();
+
+private slots:
+    void onTimer();
+    void onStateChanged(int state);
+
+private:
+    AED* aed;
+    EventLog log;
+    QString error;
+    WfdbRecord* ecgRecord;      // owned, while the recorded source is a WFDB record
+    WfdbPlayback* ecgPlayback;
+    QVector<EventLog::Event> inputs;
+    QVector<EventLog::Event> steps;
+    qint64 startMsec;           // recorded device time of the session start
+    qint64 endMsec;             // recorded device time of the last event
+    qint64 offset;              // replayed minus recorded device time
+    int next;
+    bool running;
+    ClockTimer* timer;
+    QElapsedTimer wall;
+    Report report;
+
+    void scheduleNext();
+    void finish();
+};
+
+#endif // SESSIONREPLAY_H
@@ -0,0 +1,261 @@
+#include "telemetryexport.h"
+#include "AED.h"
+#include <atomic>
+#include <cstring>
+
+namespace {
+
+const char MAGIC[8] = {'A', 'E', 'D', 'T', 'E', 'L', '0', '1'};
+const quint32 VERSION = 1;
+
+// A reader that loses this many races in a row to the writer reports the slot busy
+const int READ_ATTEMPTS = 64;
+
+}
+
+TelemetryExport::TelemetryExport()
+{
+}
+
+TelemetryExport::~TelemetryExport()
+{
+    // The last process to detach removes the segment
+    if (memory.isAttached()) {
+        memory.detach();
+    }
+}
+
+bool TelemetryExport::create(QString key, int devices)
+{
+    memory.setKey(key);
+    qsizetype bytes = sizeof(Header) + qsizetype(devices) * sizeof(Slot);
+    if (!memory.create(bytes)) {
+        // Left over from a process that crashed: attaching and detaching the last reference removes it
+        if (memory.error() != QSharedMemory::AlreadyExists || !memory.attach() || !memory.detach()
+            || !memory.create(bytes)) {
+            error = memory.errorString();
+            return false;
+        }
+    }
+
+    std::memset(memory.data(), 0, bytes);
+    Header* h = header();
+    h->version = VERSION;
+    h->headerBytes = sizeof(Header);
+    h->slotBytes = sizeof(Slot);
+    h->deviceCount = devices;
+    h->ecgCapacity = EcgCapacity;
+    h->textChars = TextChars;
+
+    // Readers check the magic first, so it goes in once the rest of the header is there
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(h->magic, MAGIC, sizeof(MAGIC));
+    return true;
+}
+
+QString TelemetryExport::getNativeKey()
+{
+    return memory.nativeKey();
+}
+
+void TelemetryExport::attach(AED* aed, int index)
+{
+    new TelemetryWriter(aed, slot(index));
+}
+
+bool TelemetryExport::open(QString key)
+{
+    memory.setKey(key);
+    if (!memory.attach(QSharedMemory::ReadOnly)) {
+        error = memory.errorString();
+        return false;
+    }
+
+    const Header* h = header();
+    if (memory.size() < qsizetype(sizeof(Header)) || std::memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0
+        || h->version != VERSION || h->slotBytes != sizeof(Slot)
+        || memory.size() < qsizetype(sizeof(Header) + h->deviceCount * sizeof(Slot))) {
+        error = "not an AED telemetry segment of this version";
+        memory.detach();
+        return false;
+    }
+    return true;
+}
+
+int TelemetryExport::getDeviceCount()
+{
+    return memory.isAttached() ? header()->deviceCount : 0;
+}
+
+bool TelemetryExport::read(int index, State &state)
+{
+    Slot* s = slot(index);
+    for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++) {
+        quint32 before = s->sequence.loadAcquire();
+        if (before & 1) {
+            continue;
+        }
+        std::memcpy(&state, &s->state, sizeof(State));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s->sequence.loadRelaxed() == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int TelemetryExport::readEcg(int index, quint64 &from, QVector<float> &samples, int max)
+{
+    Slot* s = slot(index);
+    quint64 written = s->ecgWritten.loadAcquire();
+    quint64 start = qMax(from, written - qMin(written, quint64(qMin(max, int(EcgCapacity)))));
+    if (start >= written) {
+        return 0;
+    }
+
+    int count = int(written - start);
+    int first = samples.size();
+    samples.resize(first + count);
+    for (int i = 0; i < count; i++) {
+        samples[first + i] = s->ecg[(start + i) % EcgCapacity];
+    }
+
+    // Samples the writer overwrote while they were being copied are not kept
+    std::atomic_thread_fence(std::memory_order_acquire);
+    quint64 after = s->ecgWritten.loadRelaxed();
+    quint64 oldestIntact = after - qMin(after, quint64(EcgCapacity));
+    if (oldestIntact > start) {
+        int lost = int(qMin(oldestIntact - start, quint64(count)));
+        samples.remove(first, lost);
+        count -= lost;
+    }
+    from = written;
+    return count;
+}
+
+QString TelemetryExport::getError()
+{
+    return error;
+}
+
+QString TelemetryExport::text(const char16_t* chars)
+{
+    int length = 0;
+    while (length < TextChars && chars[length] != 0) {
+        length++;
+    }
+    return QString::fromUtf16(chars, length);
+}
+
+TelemetryExport::Header* TelemetryExport::header()
+{
+    return static_cast<Header*>(memory.data());
+}
+
+TelemetryExport::Slot* TelemetryExport::slot(int index)
+{
+    return reinterpret_cast<Slot*>(static_cast<char*>(memory.data()) + sizeof(Header)) + index;
+}
+
+template<class F> void TelemetryWriter::update(F change)
+{
+    quint32 sequence = slot->sequence.loadRelaxed();
+    slot->sequence.storeRelaxed(sequence + 1);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    change(slot->state);
+    slot->state.deviceMsec = aed->getClock()->now();
+    slot->state.updates++;
+
+    slot->sequence.storeRelease(sequence + 2);
+}
+
+TelemetryWriter::TelemetryWriter(AED* aed, TelemetryExport::Slot* slot)
+    : QObject{aed}
+{
+    this->aed = aed;
+    this->slot = slot;
+
+    // The device isn't running yet, so the initial state is read from here
+    update([aed](TelemetryExport::State &state) {
+        state.state = aed->getState();
+        state.powerState = aed->getPowerState();
+        state.padsConnected = aed->getElectrodeConnected();
+        state.batteryLevel = aed->getBatteryLevel();
+        state.shockCount = aed->getShockCount();
+        state.elapsedSeconds = aed->getElapsedSeconds();
+        state.ecgSampleRate = aed->getEcgSampleRate();
+    });
+
+    // Direct connections: the slot is written on the device's thread as the device emits
+    connect(aed, &AED::stateChanged, this, [this](int value) {
+        update([value](TelemetryExport::State &state) { state.state = value; });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::powerStateChanged, this, [this](bool on) {
+        update([on](TelemetryExport::State &state) { state.powerState = on; });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::updateElectrodeOverlay, this, [this](bool connected) {
+        update([connected](TelemetryExport::State &state) { state.padsConnected = connected; });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::updateBatteryLevel, this, [this](int level) {
+        update([level](TelemetryExport::State &state) { state.batteryLevel = level; });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::updateShockCount, this, [this](int shocks) {
+        update([shocks](TelemetryExport::State &state) { state.shockCount = shocks; });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::updateElapsedTime, this, [this](int seconds) {
+        update([seconds](TelemetryExport::State &state) { state.elapsedSeconds = seconds; });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::updateLight, this, [this](bool on, int light) {
+        if (light < 1 || light > 31) {
+            return;
+        }
+        update([on, light](TelemetryExport::State &state) {
+            state.lights = on ? state.lights | (1 << (light - 1)) : state.lights & ~(1 << (light - 1));
+        });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::shockButton, this, [this](bool enabled) {
+        update([enabled](TelemetryExport::State &state) { state.shockEnabled = enabled; });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::cprStateChanged, this, [this](bool active) {
+        update([active](TelemetryExport::State &state) { state.cprActive = active; });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::ecgSampleRateChanged, this, [this](int hz) {
+        update([hz](TelemetryExport::State &state) { state.ecgSampleRate = hz; });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::voiceText, this, [this](QString text) {
+        update([this, &text](TelemetryExport::State &state) { setText(state.voiceText, text); });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::informUser, this, [this](QString text) {
+        update([this, &text](TelemetryExport::State &state) { setText(state.displayText, text); });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::resetUI, this, [this]() {
+        update([](TelemetryExport::State &state) {
+            state.lights = 0;
+            state.shockEnabled = false;
+            state.voiceText[0] = 0;
+            state.displayText[0] = 0;
+        });
+    }, Qt::DirectConnection);
+    connect(aed, &AED::ecgSamples, this, &TelemetryWriter::onEcgSamples, Qt::DirectConnection);
+}
+
+void TelemetryWriter::setText(char16_t* target, const QString &text)
+{
+    // constData(), not utf16(): that one detaches a raw-data string to zero-terminate it
+    int length = qMin(int(text.size()), int(TelemetryExport::TextChars));
+    std::memcpy(target, text.constData(), length * sizeof(char16_t));
+    if (length < TelemetryExport::TextChars) {
+        target[length] = 0;
+    }
+}
+
+void TelemetryWriter::onEcgSamples(QVector<float> samples)
+{
+    // Samples first, then the count that makes them visible
+    quint64 written = slot->ecgWritten.loadRelaxed();
+    for (int i = 0; i < samples.size(); i++) {
+        slot->ecg[(written + i) % TelemetryExport::EcgCapacity] = samples[i];
+    }
+    slot->ecgWritten.storeRelease(written + samples.size());
+}
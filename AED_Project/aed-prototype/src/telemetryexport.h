@@ -0,0 +1,119 @@
+#ifndef TELEMETRYEXPORT_H
+#define TELEMETRYEXPORT_H
+
+#include <QObject>
+#include <QAtomicInteger>
+#include <QSharedMemory>
+#include <QString>
+#include <QVector>
+
+class AED;
+
+// Live state of every device in the process, in a shared-memory segment that dashboards on the same
+// machine map once and then poll with plain memory reads: no log, no socket, no system call.
+//
+// Layout, native byte order: a Header, then `deviceCount` Slots of `slotBytes` each. A slot is
+// written only by its device's thread and guarded by a seqlock: the writer makes `sequence` odd,
+// updates the fields and makes it even again, so a reader copies the fields between two reads of
+// an equal, even sequence and otherwise tries again (see read()). ECG samples go into a ring after
+// the fields instead, which the writer never holds up: sample n is at ecg[n % EcgCapacity] once
+// `ecgWritten` is past n, and a reader keeps only the samples that `ecgWritten` hadn't lapped by
+// the time it finished copying.
+class TelemetryExport
+{
+public:
+    static const int EcgCapacity = 4096;    // samples per device, 16 s at 250 Hz
+    static const int TextChars = 96;        // UTF-16 code units, zero-terminated unless full
+
+    struct Header {
+        char magic[8];                      // "AEDTEL01"
+        quint32 version;
+        quint32 headerBytes;
+        quint32 slotBytes;
+        quint32 deviceCount;
+        quint32 ecgCapacity;
+        quint32 textChars;
+    };
+
+    // Everything a reader gets in one consistent copy
+    struct State {
+        qint64 deviceMsec;                  // device clock at the last update
+        quint32 updates;
+        qint32 state;                       // AED::State
+        qint32 powerState;
+        qint32 padsConnected;
+        qint32 batteryLevel;
+        qint32 shockCount;
+        qint32 elapsedSeconds;
+        qint32 lights;                      // bit n - 1 set while light n is on
+        qint32 shockEnabled;
+        qint32 cprActive;
+        qint32 ecgSampleRate;
+        char16_t voiceText[TextChars];      // the last voice prompt's caption
+        char16_t displayText[TextChars];    // what the display shows
+    };
+
+    struct Slot {
+        QAtomicInteger<quint32> sequence;   // odd while the writer is in the middle of an update
+        quint32 reserved;
+        State state;
+        QAtomicInteger<quint64> ecgWritten; // samples written since the device started
+        float ecg[EcgCapacity];             // millivolts
+    };
+
+    TelemetryExport();
+    ~TelemetryExport();
+
+    // Writer: creates the segment under a key (see QSharedMemory) with a slot per device
+    bool create(QString key, int devices);
+    QString getNativeKey();
+
+    // Writer: publishes a device into a slot from now on; call before the device starts. The
+    // segment must outlive the device.
+    // ECG samples only reach the slot while the device streams them. Attaching leaves that to the
+    // caller: AED::setEcgStreaming() also makes analysis classify the streamed history.
+    void attach(AED* aed, int slot);
+
+    // Reader: maps an existing segment read-only
+    bool open(QString key);
+    int getDeviceCount();
+
+    // Reader: a consistent copy of a slot, false if the writer kept it busy for every attempt
+    bool read(int slot, State &state);
+
+    // Reader: the latest samples up to `max`, appended oldest first; `from` is the value of
+    // ecgWritten to continue from (0 at first) and is advanced past what was returned
+    int readEcg(int slot, quint64 &from, QVector<float> &samples, int max = EcgCapacity);
+
+    QString getError();
+
+    static QString text(const char16_t* chars);
+
+private:
+    QSharedMemory memory;
+    QString error;
+
+    Header* header();
+    Slot* slot(int index);
+};
+
+// Writes one device's signals into its slot. A child of the device, so it runs on the device's
+// thread and goes away with it.
+class TelemetryWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    TelemetryWriter(AED* aed, TelemetryExport::Slot* slot);
+
+private:
+    AED* aed;
+    TelemetryExport::Slot* slot;
+
+    // Applies a change to the slot's state inside the seqlock
+    template<class F> void update(F change);
+    void setText(char16_t* target, const QString &text);
+    void onEcgSamples(QVector<float> samples);
+};
+
+#endif // TELEMETRYEXPORT_H
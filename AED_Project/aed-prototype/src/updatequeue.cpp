@@ -0,0 +1,126 @@
+#include "updatequeue.h"
+
+UpdateQueue::UpdateQueue(int capacity)
+{
+    quint32 size = 1;
+    while (size < quint32(qMax(2, capacity))) {
+        size <<= 1;
+    }
+    ring.resize(size);
+    mask = size - 1;
+
+    head.storeRelaxed(0);
+    tail.storeRelaxed(0);
+    dropped.storeRelaxed(0);
+    highWater.storeRelaxed(0);
+    wakeupPending.storeRelaxed(0);
+    overflowing.storeRelaxed(0);
+    coalesced = 0;
+}
+
+bool UpdateQueue::push(const Update &update)
+{
+    // Indices run freely and wrap; only their difference matters
+    quint32 t = tail.loadRelaxed();
+    quint32 waiting = t - head.loadAcquire();
+    if (update.kind == EcgSamples) {
+        if (waiting >= (mask + 1) / 2) {
+            dropped.fetchAndAddRelaxed(1);
+            return false;
+        }
+    }
+    else if (waiting > mask || overflowing.loadAcquire()) {
+        // Behind updates already in the overflow, so everything stays in order
+        pushOverflow(update);
+        return true;
+    }
+
+    ring[t & mask] = update;
+    tail.storeRelease(t + 1);
+
+    if (int(waiting + 1) > highWater.loadRelaxed()) {
+        highWater.storeRelaxed(waiting + 1);
+    }
+    return true;
+}
+
+bool UpdateQueue::armWakeup()
+{
+    return wakeupPending.testAndSetOrdered(0, 1);
+}
+
+void UpdateQueue::disarmWakeup()
+{
+    // Cleared before the drain: a push racing with it wakes the consumer again rather than being lost
+    wakeupPending.storeRelease(0);
+}
+
+bool UpdateQueue::pop(Update &update)
+{
+    // Taken once the ring was empty, so older than anything the ring got since
+    if (!backlog.isEmpty()) {
+        update = backlog.takeFirst();
+        return true;
+    }
+
+    quint32 h = head.loadRelaxed();
+    if (h == tail.loadAcquire()) {
+        if (!overflowing.loadAcquire()) {
+            return false;
+        }
+        QMutexLocker locker(&overflowMutex);
+        backlog.swap(overflow);
+        overflowing.storeRelease(0);
+        locker.unlock();
+
+        update = backlog.takeFirst();
+        return true;
+    }
+
+    // Moved out so the slot lets go of its strings and samples on this side
+    update = std::move(ring[h & mask]);
+    ring[h & mask] = Update();
+    head.storeRelease(h + 1);
+    return true;
+}
+
+UpdateQueue::Stats UpdateQueue::getStats()
+{
+    Stats stats;
+    stats.pushed = tail.loadAcquire();
+    stats.dropped = dropped.loadRelaxed();
+    overflowMutex.lock();
+    stats.coalesced = coalesced;
+    overflowMutex.unlock();
+    stats.highWater = highWater.loadRelaxed();
+    return stats;
+}
+
+QString UpdateQueue::statsText(const Stats &stats)
+{
+    return QString("%1 updates, %2 ECG batches dropped, %3 coalesced, at most %4 waiting")
+        .arg(stats.pushed)
+        .arg(stats.dropped)
+        .arg(stats.coalesced)
+        .arg(stats.highWater);
+}
+
+bool UpdateQueue::isSameSlot(const Update &a, const Update &b)
+{
+    // Lights are switched one by one, so each keeps its own latest state
+    return a.kind == b.kind && (a.kind != Light || a.arg == b.arg);
+}
+
+void UpdateQueue::pushOverflow(const Update &update)
+{
+    QMutexLocker locker(&overflowMutex);
+    for (int i = 0; i < overflow.size(); i++) {
+        if (isSameSlot(overflow[i], update)) {
+            overflow.removeAt(i);
+            coalesced++;
+            break;
+        }
+    }
+    overflow.append(update);
+    overflowing.storeRelease(1);
+}
@@ -0,0 +1,100 @@
+#ifndef UPDATEQUEUE_H
+#define UPDATEQUEUE_H
+
+#include <QAtomicInteger>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+// Display, light and prompt updates on their way from a protocol thread to the front end.
+// A fixed ring with one producer (the device thread) and one consumer (the GUI thread): each side
+// only ever writes its own index, so neither takes a lock or waits for the other. The protocol is
+// never stalled by a consumer that falls behind, and the front end never loses state:
+// - ECG samples are the only updates that are dropped (and counted), once they would take more than
+//   half of the ring; a stalled monitor just misses part of the trace
+// - any other update that finds the ring full goes to an overflow list instead, and so does every
+//   one after it until the consumer has caught up. The list keeps only the latest update of each
+//   kind (of each light), in the order they were last pushed, so it is bounded and replaying it
+//   leaves the front end in the device's current state. Only this path takes a lock.
+class UpdateQueue
+{
+public:
+    // One per AED output signal the front end shows
+    enum Kind {
+        InformUser,
+        VoiceText,
+        Audio,
+        ElectrodeOverlay,
+        CprBar,
+        StatusIndicator,
+        ElectrodeStates,
+        Light,
+        ShockButton,
+        BatteryLevel,
+        BatteryPrediction,
+        ShockCount,
+        ElapsedTime,
+        RhythmDetected,
+        CprButton,
+        CprState,
+        ResetUI,
+        PowerState,
+        StateChanged,
+        RhythmOptions,
+        EcgSamples,
+        EcgSampleRate
+    };
+
+    struct Update {
+        Kind kind;
+        int value;              // the signal's bool or int argument
+        int arg;                // second argument (light number, run minutes)
+        QString text;
+        QVector<float> samples;
+    };
+
+    struct Stats {
+        quint32 pushed;
+        int dropped;            // ECG sample batches
+        int coalesced;          // updates replaced by a later one of the same kind in the overflow
+        int highWater;          // most updates waiting in the ring at once
+    };
+
+    explicit UpdateQueue(int capacity = 4096);     // rounded up to a power of two
+
+    // Producer side. Returns false when the update was dropped.
+    bool push(const Update &update);
+
+    // Producer side, after a push: true when the consumer has to be woken up. Further pushes
+    // coalesce into the same wake-up until the consumer calls disarmWakeup().
+    bool armWakeup();
+
+    // Consumer side
+    void disarmWakeup();            // before draining
+    bool pop(Update &update);       // the ring first, then the overflow
+
+    Stats getStats();
+    static QString statsText(const Stats &stats);
+
+private:
+    QVector<Update> ring;
+    quint32 mask;
+    QAtomicInteger<quint32> head;   // next slot to pop, written by the consumer
+    QAtomicInteger<quint32> tail;   // next slot to fill, written by the producer
+    QAtomicInt dropped;
+    QAtomicInt highWater;
+    QAtomicInt wakeupPending;
+
+    // Overflow, guarded by the mutex; set while it holds updates the consumer hasn't taken
+    QAtomicInt overflowing;
+    QMutex overflowMutex;
+    QList<Update> overflow;
+    int coalesced;
+    QList<Update> backlog;          // consumer side: the overflow taken, served before the ring
+
+    static bool isSameSlot(const Update &a, const Update &b);
+    void pushOverflow(const Update &update);
+};
+
+#endif // UPDATEQUEUE_H
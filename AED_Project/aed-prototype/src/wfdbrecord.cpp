@@ -0,0 +1,492 @@
+#include "wfdbrecord.h"
+#include <QFileInfo>
+#include <QDir>
+#include <QTextStream>
+#include <algorithm>
+
+namespace {
+
+// Special annotation codes of the MIT format
+const int SKIP = 59;
+const int NUM = 60;
+const int SUB = 61;
+const int CHN = 62;
+const int AUX = 63;
+
+const double DEFAULT_GAIN = 200.0;
+
+inline int decode16(const uchar* p)
+{
+    return qint16(p[0] | (p[1] << 8));
+}
+
+// Format 212 packs two 12-bit samples into three bytes
+inline int decode212(const uchar* data, qint64 k)
+{
+    const uchar* p = data + (k / 2) * 3;
+    int v;
+    if ((k & 1) == 0) {
+        v = p[0] | ((p[1] & 0x0F) << 8);
+    }
+    else {
+        v = p[2] | ((p[1] & 0xF0) << 4);
+    }
+    return v >= 0x800 ? v - 0x1000 : v;
+}
+
+}
+
+WfdbRecord::WfdbRecord()
+{
+    sampleRate = 0;
+    sampleCount = 0;
+}
+
+WfdbRecord::~WfdbRecord()
+{
+    close();
+}
+
+void WfdbRecord::close()
+{
+    for (const DataFile &f : files) {
+        delete f.file;      // also unmaps
+    }
+    files.clear();
+    channels.clear();
+    annotations.clear();
+    byType.clear();
+    byRhythm.clear();
+    path.clear();
+    sampleRate = 0;
+    sampleCount = 0;
+}
+
+QString WfdbRecord::getError()
+{
+    return error;
+}
+
+QString WfdbRecord::getPath()
+{
+    return path;
+}
+
+bool WfdbRecord::open(QString path, QString annotator)
+{
+    close();
+    error.clear();
+
+    if (!parseHeader(path + ".hea")) {
+        close();
+        return false;
+    }
+
+    // Annotations are optional
+    QString annotations = path + "." + annotator;
+    if (!annotator.isEmpty() && QFileInfo::exists(annotations) && !parseAnnotations(annotations)) {
+        close();
+        return false;
+    }
+    this->path = QFileInfo(path).absoluteFilePath();
+    return true;
+}
+
+bool WfdbRecord::parseHeader(QString path)
+{
+    QFile header(path);
+    if (!header.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    QString directory = QFileInfo(path).absolutePath();
+    QTextStream in(&header);
+    bool recordLine = true;
+    int signalCount = 0;
+
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        QStringList fields = line.split(' ', Qt::SkipEmptyParts);
+
+        if (recordLine) {
+            // name[/segments] signals [frequency[/counter][(base)] [samples [time [date]]]]
+            recordLine = false;
+            if (fields[0].contains('/')) {
+                error = "multi-segment records are not supported";
+                return false;
+            }
+            signalCount = fields.value(1).toInt();
+            QString frequency = fields.value(2, "250");
+            sampleRate = frequency.section('/', 0, 0).section('(', 0, 0).toDouble();
+            sampleCount = fields.value(3, "0").toLongLong();
+            if (signalCount <= 0 || sampleRate <= 0) {
+                error = "bad record line in " + path;
+                return false;
+            }
+            continue;
+        }
+
+        if (channels.size() == signalCount) {
+            break;
+        }
+
+        // file format[xsamples][:skew][+offset] gain[(baseline)][/units] resolution zero initial checksum blocksize description
+        Signal signal;
+        QString spec = fields.value(1);
+        signal.format = spec.section('+', 0, 0).section(':', 0, 0).section('x', 0, 0).toInt();
+        signal.byteOffset = spec.contains('+') ? spec.section('+', 1, 1).toLongLong() : 0;
+        if (spec.contains('x')) {
+            error = "oversampled signals are not supported";
+            return false;
+        }
+        if (signal.format != Format212 && signal.format != Format16) {
+            error = QString("signal format %1 is not supported (212 and 16 are)").arg(signal.format);
+            return false;
+        }
+
+        QString gain = fields.value(2);
+        signal.gain = gain.section('/', 0, 0).section('(', 0, 0).toDouble();
+        if (signal.gain == 0) {
+            signal.gain = DEFAULT_GAIN;
+        }
+        if (gain.contains('(')) {
+            signal.baseline = gain.section('(', 1, 1).section(')', 0, 0).toInt();
+        }
+        else {
+            signal.baseline = fields.value(4, "0").toInt();     // ADC zero
+        }
+        signal.name = fields.mid(8).join(' ');
+        if (signal.name.isEmpty()) {
+            signal.name = QString("signal %1").arg(channels.size());
+        }
+
+        if (!mapSignalFile(QDir(directory).filePath(fields.value(0)), signal)) {
+            return false;
+        }
+        channels.append(signal);
+    }
+
+    if (channels.size() != signalCount) {
+        error = "header lists fewer signals than announced";
+        return false;
+    }
+
+    // Frames available in the signal files, when the header leaves it out
+    for (const Signal &signal : channels) {
+        const DataFile &f = files[signal.file];
+        qint64 bytes = f.size - signal.byteOffset;
+        qint64 frames = (signal.format == Format16) ? bytes / (2 * signal.columns)
+                                                    : bytes * 2 / 3 / signal.columns;
+        if (sampleCount == 0 || frames < sampleCount) {
+            sampleCount = frames;
+        }
+    }
+    return true;
+}
+
+bool WfdbRecord::mapSignalFile(QString path, Signal &signal)
+{
+    // Consecutive signals in the same file form one group, interleaved frame by frame
+    if (!channels.isEmpty()) {
+        Signal &previous = channels.last();
+        if (files[previous.file].file->fileName() == path) {
+            signal.file = previous.file;
+            signal.column = previous.column + 1;
+            signal.columns = signal.column + 1;
+            for (Signal &s : channels) {
+                if (s.file == signal.file) {
+                    s.columns = signal.columns;
+                }
+            }
+            return true;
+        }
+    }
+
+    DataFile f;
+    f.file = new QFile(path);
+    if (!f.file->open(QIODevice::ReadOnly)) {
+        error = "cannot open " + path;
+        delete f.file;
+        return false;
+    }
+    f.size = f.file->size();
+    f.data = f.file->map(0, f.size);
+    if (f.data == nullptr) {
+        error = "cannot map " + path;
+        delete f.file;
+        return false;
+    }
+
+    signal.file = files.size();
+    signal.column = 0;
+    signal.columns = 1;
+    files.append(f);
+    return true;
+}
+
+bool WfdbRecord::parseAnnotations(QString path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = "cannot open " + path;
+        return false;
+    }
+    qint64 size = file.size();
+    const uchar* data = file.map(0, size);
+    if (data == nullptr) {
+        error = "cannot map " + path;
+        return false;
+    }
+
+    qint64 time = 0;
+    int channel = 0;
+    int num = 0;
+    qint64 pos = 0;
+
+    while (pos + 2 <= size) {
+        int word = data[pos] | (data[pos + 1] << 8);
+        pos += 2;
+        int code = word >> 10;
+        int value = word & 0x3FF;
+
+        if (code == 0 && value == 0) {
+            break;
+        }
+
+        if (code == SKIP) {
+            if (pos + 4 > size) {
+                break;
+            }
+            // 32-bit interval, high word first, each word little-endian
+            qint32 interval = qint32((quint32(data[pos] | (data[pos + 1] << 8)) << 16)
+                                     | quint32(data[pos + 2] | (data[pos + 3] << 8)));
+            time += interval;
+            pos += 4;
+        }
+        else if (code == NUM || code == SUB || code == CHN || code == AUX) {
+            // Modifiers of the annotation just read; NUM and CHN carry over to the next ones
+            if (annotations.isEmpty()) {
+                continue;
+            }
+            Annotation &last = annotations.last();
+            if (code == NUM) {
+                num = value;
+                last.num = value;
+            }
+            else if (code == SUB) {
+                last.subtype = value;
+            }
+            else if (code == CHN) {
+                channel = value;
+                last.channel = value;
+            }
+            else {
+                qint64 length = qMin(qint64(value), size - pos);
+                QByteArray aux(reinterpret_cast<const char*>(data + pos), int(length));
+                last.aux = QString::fromLatin1(aux.constData(), int(qstrnlen(aux.constData(), aux.size())));
+                pos += value + (value & 1);
+            }
+        }
+        else {
+            time += value;
+            Annotation a;
+            a.sample = time;
+            a.type = code;
+            a.subtype = 0;
+            a.channel = channel;
+            a.num = num;
+            annotations.append(a);
+        }
+    }
+
+    std::stable_sort(annotations.begin(), annotations.end(), [](const Annotation &a, const Annotation &b) {
+        return a.sample < b.sample;
+    });
+
+    for (int i = 0; i < annotations.size(); i++) {
+        byType[annotations[i].type].append(i);
+        if (annotations[i].type == RhythmChange) {
+            byRhythm[annotations[i].aux].append(i);
+        }
+    }
+    return true;
+}
+
+int WfdbRecord::getSignalCount()
+{
+    return channels.size();
+}
+
+double WfdbRecord::getSampleRate()
+{
+    return sampleRate;
+}
+
+qint64 WfdbRecord::getSampleCount()
+{
+    return sampleCount;
+}
+
+QString WfdbRecord::getSignalName(int signal)
+{
+    return channels.value(signal).name;
+}
+
+int WfdbRecord::findSignal(QString name)
+{
+    for (int i = 0; i < channels.size(); i++) {
+        if (channels[i].name.compare(name, Qt::CaseInsensitive) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int WfdbRecord::read(int signal, qint64 start, float* samples, int count)
+{
+    if (signal < 0 || signal >= channels.size() || start < 0 || start >= sampleCount) {
+        return 0;
+    }
+
+    const Signal &s = channels[signal];
+    const uchar* data = files[s.file].data + s.byteOffset;
+    int n = int(qMin(qint64(count), sampleCount - start));
+    float scale = float(1.0 / s.gain);
+
+    if (s.format == Format16) {
+        const uchar* p = data + (start * s.columns + s.column) * 2;
+        int stride = s.columns * 2;
+        for (int i = 0; i < n; i++, p += stride) {
+            samples[i] = (decode16(p) - s.baseline) * scale;
+        }
+    }
+    else {
+        qint64 k = start * s.columns + s.column;
+        for (int i = 0; i < n; i++, k += s.columns) {
+            samples[i] = (decode212(data, k) - s.baseline) * scale;
+        }
+    }
+    return n;
+}
+
+const QVector<WfdbRecord::Annotation>& WfdbRecord::getAnnotations()
+{
+    return annotations;
+}
+
+int WfdbRecord::firstAnnotationFrom(qint64 sample)
+{
+    auto it = std::lower_bound(annotations.begin(), annotations.end(), sample, [](const Annotation &a, qint64 s) {
+        return a.sample < s;
+    });
+    return it == annotations.end() ? -1 : int(it - annotations.begin());
+}
+
+int WfdbRecord::lowerBound(const QVector<int> &indices, qint64 sample)
+{
+    auto it = std::lower_bound(indices.begin(), indices.end(), sample, [this](int index, qint64 s) {
+        return annotations[index].sample < s;
+    });
+    return it == indices.end() ? -1 : *it;
+}
+
+int WfdbRecord::findAnnotation(int type, qint64 fromSample)
+{
+    return lowerBound(byType.value(type), fromSample);
+}
+
+int WfdbRecord::findRhythm(QString label, qint64 fromSample)
+{
+    return lowerBound(byRhythm.value(label), fromSample);
+}
+
+QString WfdbRecord::rhythmAt(qint64 sample)
+{
+    const QVector<int> rhythms = byType.value(RhythmChange);
+    auto it = std::upper_bound(rhythms.begin(), rhythms.end(), sample, [this](qint64 s, int index) {
+        return s < annotations[index].sample;
+    });
+    if (it == rhythms.begin()) {
+        return QString();
+    }
+    return annotations[*(it - 1)].aux;
+}
+
+QStringList WfdbRecord::getRhythmLabels()
+{
+    QStringList labels = byRhythm.keys();
+    labels.sort();
+    return labels;
+}
+
+WfdbPlayback::WfdbPlayback(WfdbRecord* record, int signal)
+    : record(record)
+    , signal(signal)
+{
+    position = 0;
+    segmentStart = 0;
+    segmentEnd = record->getSampleCount();
+}
+
+WfdbRecord* WfdbPlayback::getRecord()
+{
+    return record;
+}
+
+int WfdbPlayback::getSignal()
+{
+    return signal;
+}
+
+int WfdbPlayback::getSampleRate()
+{
+    return qRound(record->getSampleRate());
+}
+
+void WfdbPlayback::readSamples(float* samples, int frames)
+{
+    while (frames > 0) {
+        if (position >= segmentEnd || position < segmentStart) {
+            position = segmentStart;
+        }
+        int n = record->read(signal, position, samples, int(qMin(qint64(frames), segmentEnd - position)));
+        if (n <= 0) {
+            std::fill(samples, samples + frames, 0.0f);
+            return;
+        }
+        samples += n;
+        frames -= n;
+        position += n;
+    }
+}
+
+void WfdbPlayback::seek(qint64 sample)
+{
+    position = qBound(segmentStart, sample, segmentEnd);
+}
+
+qint64 WfdbPlayback::getPosition()
+{
+    return position;
+}
+
+bool WfdbPlayback::seekToRhythm(QString label)
+{
+    int index = record->findRhythm(label);
+    if (index < 0) {
+        return false;
+    }
+    seek(record->getAnnotations()[index].sample);
+    return true;
+}
+
+void WfdbPlayback::setSegment(qint64 start, qint64 end)
+{
+    segmentStart = qBound(qint64(0), start, record->getSampleCount());
+    segmentEnd = qBound(segmentStart, end, record->getSampleCount());
+    seek(position);
+}
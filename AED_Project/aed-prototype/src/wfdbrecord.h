@@ -0,0 +1,130 @@
+#ifndef WFDBRECORD_H
+#define WFDBRECORD_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+#include <QFile>
+#include "ecgsource.h"
+
+// Read-only access to a PhysioNet WFDB record (e.g. the MIT-BIH databases): the .hea header, the
+// signal files in format 212 or 16 and a MIT-format annotation file.
+// Signal files are memory mapped and samples are decoded straight from the mapping on demand, so
+// opening an hour-long record costs nothing and any segment can be read in O(segment length).
+// Annotations are indexed by type and by rhythm label, so any annotated event is found in O(log n).
+class WfdbRecord
+{
+public:
+    // MIT annotation codes used by the trainer
+    enum AnnotationCode {
+        Normal = 1,
+        Pvc = 5,
+        Noise = 14,
+        Note = 22,
+        RhythmChange = 28,
+        VfOnset = 32,
+        VfEnd = 33
+    };
+
+    struct Annotation {
+        qint64 sample;
+        int type;
+        int subtype;
+        int channel;
+        int num;
+        QString aux;            // rhythm label for RhythmChange, e.g. "(N", "(VT", "(VFL"
+    };
+
+    WfdbRecord();
+    ~WfdbRecord();
+
+    // `path` is the record name without extension; the annotator is the annotation file suffix
+    bool open(QString path, QString annotator = "atr");
+    void close();
+    QString getError();
+    QString getPath();          // absolute, without extension; empty while closed
+
+    int getSignalCount();
+    double getSampleRate();
+    qint64 getSampleCount();
+    QString getSignalName(int signal);
+    int findSignal(QString name);
+
+    // Decodes up to `count` samples of one signal starting at `start`, in millivolts.
+    // Returns the number of samples written.
+    int read(int signal, qint64 start, float* samples, int count);
+
+    const QVector<Annotation>& getAnnotations();
+    int firstAnnotationFrom(qint64 sample);                 // index, or -1 past the end
+    int findAnnotation(int type, qint64 fromSample = 0);
+    int findRhythm(QString label, qint64 fromSample = 0);
+    QString rhythmAt(qint64 sample);                        // label in effect at a sample
+    QStringList getRhythmLabels();
+
+private:
+    enum Format {
+        Format212 = 212,
+        Format16 = 16
+    };
+
+    struct Signal {
+        QString name;
+        int format;
+        int file;               // index into files
+        int column;             // position within the file's frame
+        int columns;            // signals sharing the file
+        double gain;            // ADC units per millivolt
+        int baseline;
+        qint64 byteOffset;
+    };
+
+    struct DataFile {
+        QFile* file;
+        const uchar* data;
+        qint64 size;
+    };
+
+    QString error;
+    QString path;
+    double sampleRate;
+    qint64 sampleCount;
+    QVector<Signal> channels;
+    QList<DataFile> files;
+
+    QVector<Annotation> annotations;
+    QHash<int, QVector<int>> byType;
+    QHash<QString, QVector<int>> byRhythm;
+
+    bool parseHeader(QString path);
+    bool mapSignalFile(QString path, Signal &signal);
+    bool parseAnnotations(QString path);
+    int lowerBound(const QVector<int> &indices, qint64 sample);
+};
+
+// Plays one signal of a record into the AED as its ECG input, looping over a segment
+class WfdbPlayback : public EcgSource
+{
+public:
+    explicit WfdbPlayback(WfdbRecord* record, int signal = 0);
+
+    int getSampleRate() override;
+    void readSamples(float* samples, int frames) override;
+
+    WfdbRecord* getRecord();
+    int getSignal();
+    void seek(qint64 sample);
+    qint64 getPosition();
+    bool seekToRhythm(QString label);       // first occurrence of a rhythm label, e.g. "(VFL"
+    void setSegment(qint64 start, qint64 end);
+
+private:
+    WfdbRecord* record;
+    int signal;
+    qint64 position;
+    qint64 segmentStart;
+    qint64 segmentEnd;
+};
+
+#endif // WFDBRECORD_H